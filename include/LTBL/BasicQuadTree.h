@@ -0,0 +1,420 @@
+#ifndef LTBL_BASIC_QUAD_TREE_H
+#define LTBL_BASIC_QUAD_TREE_H
+
+#include "QuadTreeNode.h"
+#include "BoundsIntersect.h"
+#include <vector>
+
+namespace qdt
+{
+// Quad tree over values of any copyable, default constructible type, such as pointers to game objects or ids, with no base class
+// to inherit from and no virtual calls. BoundsFn is a function object that returns the AABB of a value,
+// AABB operator()(const T &value) const, which is read when a value is inserted or updated.
+// insert returns a handle that update and remove take, much like the proxies of the dynamic AABB tree.
+// Values outside the region stay in the root. Queries are const and may run on several threads at once,
+// they only read the bound copies kept by the tree.
+// This is a separate, simpler tree than QuadTree and shares only the node constants and the intersectBounds kernel
+// with it. Nodes split once they hold more than MaxOccupants and merge when their subtree drops back to that,
+// without the loose mode, root growth, deferred updates or bulk loading of QuadTree.
+template<class T, class BoundsFn, unsigned int MaxOccupants = MaximumOccupants, unsigned int MaxLevels = qdt::MaxLevels>
+class BasicQuadTree {
+ private:
+  static_assert(MaxOccupants > 0, "Nodes must hold at least one value before they split");
+
+  struct Entry {
+    T value;
+
+    // Node holding the value and its index in the node lists, node is -1 while the entry is free
+    int node;
+    unsigned int slot;
+
+    // Next free entry while in the free list
+    int nextFree;
+  };
+
+  struct Node {
+    AABB region;
+
+    int parent;
+
+    // Index of the first of 4 contiguous children, child (x, y) at firstChild + x * 2 + y, -1 for leaves
+    int firstChild;
+
+    unsigned int level;
+
+    // Values in this node and below
+    unsigned int numOccupants;
+
+    // Entries held by this node along with copies of their bounds, one array per coordinate for intersectBounds.
+    // The bound arrays are kept at least as long as the entries rounded up to a multiple of 4.
+    std::vector<int> entries;
+    std::vector<float> lowerX;
+    std::vector<float> lowerY;
+    std::vector<float> upperX;
+    std::vector<float> upperY;
+  };
+
+  BoundsFn boundsFn;
+
+  std::vector<Entry> entries;
+  int freeEntry;
+
+  // The root is node 0, the other nodes come in blocks of 4 siblings
+  std::vector<Node> nodes;
+  std::vector<int> freeBlocks;
+
+  AABB getChildRegion(int nodeIndex, unsigned int x, unsigned int y) const
+  {
+    const AABB &region = nodes[nodeIndex].region;
+
+    Vec2f halfDims = region.getDims() / 2.0f;
+    Vec2f lowerBound(region.lowerBound.x + x * halfDims.x, region.lowerBound.y + y * halfDims.y);
+
+    return AABB(lowerBound, lowerBound + halfDims);
+  }
+
+  // Child of nodeIndex that contains bounds, -1 if it has none or bounds straddles them
+  int getContainingChild(int nodeIndex, const AABB &bounds) const
+  {
+    const Node &node = nodes[nodeIndex];
+
+    if(node.firstChild == -1)
+      return -1;
+
+    Vec2f center = node.region.getCenter();
+
+    if(bounds.upperBound.x > center.x && bounds.lowerBound.x < center.x)
+      return -1;
+
+    if(bounds.upperBound.y > center.y && bounds.lowerBound.y < center.y)
+      return -1;
+
+    int child = node.firstChild + (bounds.lowerBound.x >= center.x ? 2 : 0) + (bounds.lowerBound.y >= center.y ? 1 : 0);
+
+    return nodes[child].region.contains(bounds) ? child : -1;
+  }
+
+  void addToNode(int nodeIndex, int entryIndex, const AABB &bounds)
+  {
+    Node &node = nodes[nodeIndex];
+
+    Entry &entry = entries[entryIndex];
+
+    entry.node = nodeIndex;
+    entry.slot = node.entries.size();
+
+    node.entries.push_back(entryIndex);
+
+    if(node.lowerX.size() < node.entries.size())
+    {
+      unsigned int paddedSize = node.lowerX.size() + 4;
+
+      node.lowerX.resize(paddedSize);
+      node.lowerY.resize(paddedSize);
+      node.upperX.resize(paddedSize);
+      node.upperY.resize(paddedSize);
+    }
+
+    setNodeBounds(node, entry.slot, bounds);
+  }
+
+  static void setNodeBounds(Node &node, unsigned int slot, const AABB &bounds)
+  {
+    node.lowerX[slot] = bounds.lowerBound.x;
+    node.lowerY[slot] = bounds.lowerBound.y;
+    node.upperX[slot] = bounds.upperBound.x;
+    node.upperY[slot] = bounds.upperBound.y;
+  }
+
+  static AABB getNodeBounds(const Node &node, unsigned int slot)
+  {
+    return AABB(Vec2f(node.lowerX[slot], node.lowerY[slot]), Vec2f(node.upperX[slot], node.upperY[slot]));
+  }
+
+  // Swap-and-pop, the last entry of the node takes over the slot
+  void removeFromNode(int entryIndex)
+  {
+    Entry &entry = entries[entryIndex];
+    Node &node = nodes[entry.node];
+
+    unsigned int last = node.entries.size() - 1;
+
+    if(entry.slot != last)
+    {
+      int movedIndex = node.entries[last];
+
+      node.entries[entry.slot] = movedIndex;
+      setNodeBounds(node, entry.slot, getNodeBounds(node, last));
+
+      entries[movedIndex].slot = entry.slot;
+    }
+
+    node.entries.pop_back();
+  }
+
+  void insertEntry(int entryIndex, const AABB &bounds)
+  {
+    int nodeIndex = 0;
+
+    for(;;)
+    {
+      nodes[nodeIndex].numOccupants++;
+
+      int child = getContainingChild(nodeIndex, bounds);
+
+      if(child == -1)
+        break;
+
+      nodeIndex = child;
+    }
+
+    addToNode(nodeIndex, entryIndex, bounds);
+
+    const Node &node = nodes[nodeIndex];
+
+    if(node.firstChild == -1 && node.entries.size() > MaxOccupants && node.level < MaxLevels)
+      partition(nodeIndex);
+  }
+
+  // Takes an entry out of the tree, merging the subtrees that became small enough
+  void detachEntry(int entryIndex)
+  {
+    int nodeIndex = entries[entryIndex].node;
+
+    removeFromNode(entryIndex);
+
+    // The highest ancestor that is now small enough to hold its whole subtree
+    int mergeIndex = -1;
+
+    for(; nodeIndex != -1; nodeIndex = nodes[nodeIndex].parent)
+    {
+      Node &node = nodes[nodeIndex];
+
+      node.numOccupants--;
+
+      if(node.firstChild != -1 && node.numOccupants <= MaxOccupants)
+        mergeIndex = nodeIndex;
+    }
+
+    if(mergeIndex != -1)
+      merge(mergeIndex);
+  }
+
+  int allocateBlock()
+  {
+    if(!freeBlocks.empty())
+    {
+      int block = freeBlocks.back();
+
+      freeBlocks.pop_back();
+
+      return block;
+    }
+
+    int block = nodes.size();
+
+    nodes.resize(nodes.size() + 4);
+
+    return block;
+  }
+
+  void partition(int nodeIndex)
+  {
+    int block = allocateBlock();
+
+    for(unsigned int x = 0; x < 2; x++)
+      for(unsigned int y = 0; y < 2; y++)
+      {
+        Node &child = nodes[block + x * 2 + y];
+
+        child.region = getChildRegion(nodeIndex, x, y);
+        child.parent = nodeIndex;
+        child.firstChild = -1;
+        child.level = nodes[nodeIndex].level + 1;
+        child.numOccupants = 0;
+      }
+
+    nodes[nodeIndex].firstChild = block;
+
+    // Move down whatever fits in a child, going backwards since removal swaps in the last entry
+    for(unsigned int slot = nodes[nodeIndex].entries.size(); slot-- > 0;)
+    {
+      AABB bounds(getNodeBounds(nodes[nodeIndex], slot));
+
+      int child = getContainingChild(nodeIndex, bounds);
+
+      if(child != -1)
+      {
+        int entryIndex = nodes[nodeIndex].entries[slot];
+
+        removeFromNode(entryIndex);
+        addToNode(child, entryIndex, bounds);
+
+        nodes[child].numOccupants++;
+      }
+    }
+  }
+
+  // Pulls the entries of all descendants into nodeIndex and recycles the child blocks
+  void merge(int nodeIndex)
+  {
+    int block = nodes[nodeIndex].firstChild;
+
+    if(block == -1)
+      return;
+
+    for(int child = block; child < block + 4; child++)
+    {
+      merge(child);
+
+      Node &childNode = nodes[child];
+
+      for(unsigned int slot = 0; slot < childNode.entries.size(); slot++)
+        addToNode(nodeIndex, childNode.entries[slot], getNodeBounds(childNode, slot));
+
+      childNode.entries.clear();
+      childNode.numOccupants = 0;
+    }
+
+    nodes[nodeIndex].firstChild = -1;
+
+    freeBlocks.push_back(block);
+  }
+
+  template<class Visitor> bool queryNode(int nodeIndex, const AABB &queryRegion, Visitor &visitor) const
+  {
+    const Node &node = nodes[nodeIndex];
+
+    for(unsigned int first = 0; first < node.entries.size(); first += BoundsBatchSize)
+    {
+      unsigned int count = node.entries.size() - first < BoundsBatchSize ? node.entries.size() - first : BoundsBatchSize;
+
+      unsigned int mask = intersectBounds(&node.lowerX[first], &node.lowerY[first], &node.upperX[first], &node.upperY[first], count, queryRegion);
+
+      for(; mask != 0; mask &= mask - 1)
+        if(!visitor(entries[node.entries[first + lowestBitIndex(mask)]].value))
+          return false;
+    }
+
+    if(node.firstChild != -1)
+    {
+      for(int child = node.firstChild; child < node.firstChild + 4; child++)
+        if(nodes[child].numOccupants != 0 && nodes[child].region.intersects(queryRegion) && !queryNode(child, queryRegion, visitor))
+          return false;
+    }
+
+    return true;
+  }
+
+ public:
+  BasicQuadTree(const AABB &region, const BoundsFn &bounds = BoundsFn())
+  : boundsFn(bounds)
+  {
+    clear(region);
+  }
+
+  // Removes everything and starts over with a new region, invalidating all handles
+  void clear(const AABB &region)
+  {
+    entries.clear();
+    freeEntry = -1;
+
+    nodes.clear();
+    freeBlocks.clear();
+
+    nodes.resize(1);
+    nodes[0].region = region;
+    nodes[0].parent = -1;
+    nodes[0].firstChild = -1;
+    nodes[0].level = 1;
+    nodes[0].numOccupants = 0;
+  }
+
+  int insert(const T &value)
+  {
+    int entryIndex;
+
+    if(freeEntry != -1)
+    {
+      entryIndex = freeEntry;
+      freeEntry = entries[entryIndex].nextFree;
+    }
+    else
+    {
+      entryIndex = entries.size();
+      entries.resize(entries.size() + 1);
+    }
+
+    entries[entryIndex].value = value;
+
+    insertEntry(entryIndex, boundsFn(value));
+
+    return entryIndex;
+  }
+
+  // Reads the bounds of the value again, call this whenever they change
+  void update(int handle)
+  {
+    assert(handle >= 0 && handle < static_cast<int>(entries.size()) && entries[handle].node != -1);
+
+    Entry &entry = entries[handle];
+
+    AABB bounds(boundsFn(entry.value));
+
+    // Still in the right node, so only the bound copy changes
+    if((entry.node == 0 || nodes[entry.node].region.contains(bounds)) && getContainingChild(entry.node, bounds) == -1)
+    {
+      setNodeBounds(nodes[entry.node], entry.slot, bounds);
+
+      return;
+    }
+
+    detachEntry(handle);
+    insertEntry(handle, bounds);
+  }
+
+  void remove(int handle)
+  {
+    assert(handle >= 0 && handle < static_cast<int>(entries.size()) && entries[handle].node != -1);
+
+    detachEntry(handle);
+
+    entries[handle].node = -1;
+    entries[handle].nextFree = freeEntry;
+    freeEntry = handle;
+  }
+
+  const T &get(int handle) const
+  {
+    assert(handle >= 0 && handle < static_cast<int>(entries.size()) && entries[handle].node != -1);
+
+    return entries[handle].value;
+  }
+
+  // Appends the values whose bounds intersect queryRegion
+  void query(const AABB &queryRegion, std::vector<T> &queryResult) const
+  {
+    query(queryRegion, [&](const T &value) { queryResult.push_back(value); return true; });
+  }
+
+  // Calls visitor(value) for every value whose bounds intersect queryRegion until it returns false.
+  // Returns false if the visitor stopped the query.
+  template<class Visitor> bool query(const AABB &queryRegion, Visitor visitor) const
+  {
+    // The root also holds the values outside its region, so it is always searched
+    return queryNode(0, queryRegion, visitor);
+  }
+
+  unsigned int getNumOccupants() const
+  {
+    return nodes[0].numOccupants;
+  }
+
+  AABB getRootAABB() const
+  {
+    return nodes[0].region;
+  }
+};
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef LTBL_BOUNDS_INTERSECT_H
+#define LTBL_BOUNDS_INTERSECT_H
+
+#include "QuadTreeOccupant.h"
+
+#include <assert.h>
+
+// The instruction set is picked at compile time from the target flags, define LTBL_NO_SIMD to force the scalar path
+#if !defined(LTBL_NO_SIMD)
+#if defined(__AVX2__) || defined(__AVX__)
+#define LTBL_SIMD_AVX
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LTBL_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace qdt
+{
+// Maximum number of boxes tested by one intersectBounds call
+const unsigned int BoundsBatchSize = 32;
+
+inline unsigned int lowestBitIndex(unsigned int mask)
+{
+  assert(mask != 0);
+
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward(&index, mask);
+
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+inline unsigned int highestBitIndex(unsigned int mask)
+{
+  assert(mask != 0);
+
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanReverse(&index, mask);
+
+  return index;
+#else
+  return 31 - __builtin_clz(mask);
+#endif
+}
+
+inline unsigned int bitCount(unsigned int mask)
+{
+#ifdef _MSC_VER
+  return __popcnt(mask);
+#else
+  return __builtin_popcount(mask);
+#endif
+}
+
+// Tests up to BoundsBatchSize boxes, stored as one array per coordinate, against region.
+// Returns a mask with bit i set if box i intersects it. Uses the same comparisons as
+// AABB::intersects, so the results match exactly, NaN coordinates included.
+// The arrays must be readable up to count rounded up to a multiple of 4, the extra boxes are ignored.
+inline unsigned int intersectBounds(const float* lowerX, const float* lowerY, const float* upperX, const float* upperY,
+                                    unsigned int count, const AABB &region)
+{
+  assert(count <= BoundsBatchSize);
+
+  // Bits of the boxes that are separated from the region on some axis
+  unsigned int rejected = 0;
+
+  unsigned int i = 0;
+
+#if defined(LTBL_SIMD_AVX) || defined(LTBL_SIMD_SSE2)
+  const unsigned int paddedCount = (count + 3) & ~3u;
+#endif
+
+#if defined(LTBL_SIMD_AVX)
+  {
+    const __m256 regionLowerX = _mm256_set1_ps(region.lowerBound.x);
+    const __m256 regionLowerY = _mm256_set1_ps(region.lowerBound.y);
+    const __m256 regionUpperX = _mm256_set1_ps(region.upperBound.x);
+    const __m256 regionUpperY = _mm256_set1_ps(region.upperBound.y);
+
+    for(; i + 8 <= paddedCount; i += 8)
+    {
+      // Ordered comparisons are false for NaN, like the scalar operators
+      __m256 separated = _mm256_or_ps(
+        _mm256_or_ps(_mm256_cmp_ps(_mm256_loadu_ps(upperX + i), regionLowerX, _CMP_LT_OQ),
+                     _mm256_cmp_ps(_mm256_loadu_ps(upperY + i), regionLowerY, _CMP_LT_OQ)),
+        _mm256_or_ps(_mm256_cmp_ps(_mm256_loadu_ps(lowerX + i), regionUpperX, _CMP_GT_OQ),
+                     _mm256_cmp_ps(_mm256_loadu_ps(lowerY + i), regionUpperY, _CMP_GT_OQ)));
+
+      rejected |= static_cast<unsigned int>(_mm256_movemask_ps(separated)) << i;
+    }
+  }
+#endif
+
+#if defined(LTBL_SIMD_SSE2)
+  {
+    const __m128 regionLowerX = _mm_set1_ps(region.lowerBound.x);
+    const __m128 regionLowerY = _mm_set1_ps(region.lowerBound.y);
+    const __m128 regionUpperX = _mm_set1_ps(region.upperBound.x);
+    const __m128 regionUpperY = _mm_set1_ps(region.upperBound.y);
+
+    for(; i < paddedCount; i += 4)
+    {
+      __m128 separated = _mm_or_ps(
+        _mm_or_ps(_mm_cmplt_ps(_mm_loadu_ps(upperX + i), regionLowerX),
+                  _mm_cmplt_ps(_mm_loadu_ps(upperY + i), regionLowerY)),
+        _mm_or_ps(_mm_cmpgt_ps(_mm_loadu_ps(lowerX + i), regionUpperX),
+                  _mm_cmpgt_ps(_mm_loadu_ps(lowerY + i), regionUpperY)));
+
+      rejected |= static_cast<unsigned int>(_mm_movemask_ps(separated)) << i;
+    }
+  }
+#endif
+
+  // Scalar fallback, also the AVX tail if SSE2 is somehow unavailable
+  for(; i < count; i++)
+    if(upperX[i] < region.lowerBound.x || upperY[i] < region.lowerBound.y ||
+       lowerX[i] > region.upperBound.x || lowerY[i] > region.upperBound.y)
+      rejected |= 1u << i;
+
+  const unsigned int countMask = count == BoundsBatchSize ? ~0u : (1u << count) - 1;
+
+  return ~rejected & countMask;
+}
+}
+
+#endif
@@ -8,6 +8,9 @@
 
 namespace ltbl
 {
+class LightSystem;
+class Light;
+
 template<class T> T Wrap(T val, T size)
 {
   if((signed)val < 0)
@@ -33,7 +36,57 @@ class ConvexHull : public qdt::QuadTreeOccupant
 
   Vec2f worldCenter;
 
+  // Rotation in radians and uniform scale, applied to the vertices before they are moved to the world center
+  float rotation;
+  float scale;
+  float rotationCos;
+  float rotationSin;
+
+  unsigned int transformVersion;
+
+  // World space vertices and normals, one array per coordinate for classifyEdges. Rebuilt by updateWorldVertices as soon as
+  // the transform or the vertices change, so the const readers never write them and may run on several threads at once.
+  // The arrays are padded to a multiple of 4, and the vertex arrays repeat the first vertex after the last one.
+  // Not valid while the vertices changed and calculateNormals has yet to run.
+  bool worldVerticesValid;
+  std::vector<float> vertexX;
+  std::vector<float> vertexY;
+  std::vector<float> normalX;
+  std::vector<float> normalY;
+
+  void updateWorldVertices();
+
+  // Set while the hull is in a light system, which is told about every change so that it can update the light pairs
+  LightSystem* pLightSystem;
+
+  // Kept by LightSystem: the lights paired with the hull, and whether the hull waits to have its pairs updated
+  std::vector<Light*> pairedLights;
+  bool pairsDirty;
+
+  void notifyLightSystem();
+
+  void invalidateTransform();
+
+  // For findSilhouette, the vertex average in local space and the local vertices sorted by their angle around it.
+  // Only used if the vertices were convex and in order when calculateNormals last ran.
+  bool silhouetteSearch;
+
+  // Winding of the vertices when calculateNormals last ran, also used by intersectSegment. The scale is positive, so the transform keeps it.
+  bool counterClockwise;
+  Vec2f innerPoint;
+  std::vector<float> sortedAngles;
+  std::vector<unsigned int> sortedVertices;
+
+  void prepareSilhouetteSearch();
+
+  bool isEdgeBackFacing(unsigned int edge, const Vec2f &lightCenter, float lightSize) const;
+
+  // Edge whose wedge of the fan around innerPoint contains the direction angle
+  unsigned int getEdgeInDirection(float angle) const;
+
  public:
+  // Deprecated, hulls tell the light system about their changes on their own now. Setting it still has the static lights
+  // that reach the hull draw again in the next renderLights, which then clears it. False by default.
   bool updateRequired;
 
   bool render;
@@ -49,8 +102,26 @@ class ConvexHull : public qdt::QuadTreeOccupant
   bool loadShape(const char* fileName);
   Vec2f getWorldVertex(unsigned int index) const;
 
+  // The normal of edge index in world space, rotated and scaled along with the vertices
+  Vec2f getWorldNormal(unsigned int index) const;
+
+  // Call after changing the vertices
   void calculateNormals();
 
+  unsigned int getNumEdgeMaskWords() const;
+
+  // Sets bit i % 32 of word i / 32 of pBackFacing if edge i, from vertex i to i + 1, faces away from a light of the given size
+  // at lightCenter. Writes getNumEdgeMaskWords words, the bits past the last edge are left clear.
+  void classifyEdges(const Vec2f &lightCenter, float lightSize, unsigned int* pBackFacing) const;
+
+  // The vertices where the edges classified by classifyEdges turn from back to front facing (first) and back again (second).
+  // Binary searches the vertices sorted at calculateNormals time, so it takes O(log n) for convex hulls with many vertices.
+  // Falls back to classifying every edge for small hulls, or when the light is inside the hull or its size makes the search unsafe.
+  // A light larger than the hull can make the classification turn more than twice, the pair found may then differ.
+  // Hulls with more than 256 vertices classify into edgeMaskScratch, which is grown as needed and may be reused across calls.
+  void findSilhouette(const Vec2f &lightCenter, float lightSize, std::vector<unsigned int> &edgeMaskScratch,
+                      int &firstBoundryIndex, int &secondBoundryIndex) const;
+
   void renderHull(float depth);
 
   void generateAABB();
@@ -62,7 +133,25 @@ class ConvexHull : public qdt::QuadTreeOccupant
 
   Vec2f getWorldCenter() const;
 
+  // Rotation in radians about the world center, 0 by default
+  void setRotation(float angle);
+  float getRotation() const;
+
+  // Uniform scale about the world center, must be positive, 1 by default
+  void setScale(float newScale);
+  float getScale() const;
+
+  // Incremented whenever the hull moves, turns or scales, or calculateNormals picks up new vertices, so that cached shadows can tell they are out of date
+  unsigned int getTransformVersion() const;
+
   bool pointInsideHull(const Vec2f &point);
+
+  // Clips the segment against the edges (Cyrus-Beck). On a hit, fraction is where the segment enters the hull,
+  // 0 at from and 1 at to, and normal is the unit outward normal of the edge it enters through.
+  // Segments starting inside the hull hit at fraction 0 with a zero normal.
+  bool intersectSegment(const Vec2f &from, const Vec2f &to, float &fraction, Vec2f &normal) const;
+
+  friend class LightSystem;
 };
 
 float getFloatVal(std::string strConvert);
@@ -0,0 +1,137 @@
+#ifndef LTBL_DYNAMIC_AABB_TREE_H
+#define LTBL_DYNAMIC_AABB_TREE_H
+
+#include "SpatialIndex.h"
+#include <vector>
+
+namespace qdt
+{
+// Distance by which leaf AABBs are grown beyond the occupant AABB,
+// so that small movements do not require the leaf to be reinserted
+const float DefaultAABBTreeMargin = 8.0f;
+
+// Leaf AABBs are additionally stretched in the direction of movement by this multiple of the last displacement
+const float AABBTreeDisplacementMultiplier = 2.0f;
+
+// Number of nodes allocated when the tree starts out
+const unsigned int AABBTreeInitialCapacity = 16;
+
+struct DynamicAABBTreeNode {
+  // Fattened bounds for leaves, union of the children otherwise
+  AABB aabb;
+
+  // Copy of the occupant AABB as of the last update, leaves only
+  AABB occupantAABB;
+
+  QuadTreeOccupant* pOccupant;
+
+  // Next free node while in the free list
+  int parent;
+
+  int child1;
+  int child2;
+
+  // Leaves have height 0, free nodes -1
+  int height;
+
+  bool isLeaf() const
+  {
+    return child1 == -1;
+  }
+};
+
+// Bounding volume hierarchy with one leaf per occupant. Unlike the quad tree it does not need
+// a region, so it copes with large sparse worlds and with occupants of any size.
+// Insertion picks the sibling with the smallest perimeter increase and the tree is
+// kept balanced with rotations while the ancestors are refit.
+class DynamicAABBTree : public SpatialIndex {
+ private:
+  std::vector<DynamicAABBTreeNode> nodes;
+
+  int root;
+  int freeList;
+
+  unsigned int numOccupants;
+
+  float margin;
+
+  int allocateNode();
+  void freeNode(int index);
+
+  void insertLeaf(int leaf);
+  void removeLeaf(int leaf);
+
+  // Walks up from index, rebalancing and recomputing bounds and heights
+  void refit(int index);
+  int balance(int index);
+
+  // Shape is an AABB, Sector or ConvexPolygon
+  template<class Shape, class Visitor> bool queryShape(int index, const Shape &shape, Visitor &visitor) const
+  {
+    const DynamicAABBTreeNode &node = nodes[index];
+
+    LTBL_COUNT_QUERY(queryCounters.add(0, 1, 1, 0));
+
+    if(!shape.intersects(node.aabb))
+      return true;
+
+    if(node.isLeaf())
+    {
+      bool hit = shape.intersects(node.occupantAABB);
+
+      LTBL_COUNT_QUERY(queryCounters.add(0, 0, 1, hit ? 1 : 0));
+
+      return !hit || visitor(node.pOccupant);
+    }
+
+    return queryShape(node.child1, shape, visitor) && queryShape(node.child2, shape, visitor);
+  }
+
+  void collectStats(int index, unsigned int depth, SpatialIndexStats &stats) const;
+
+ protected:
+  void applyUpdate(QuadTreeOccupant* pOc);
+  void removeOccupant(QuadTreeOccupant* pOc);
+
+  // Occupants are counted at the depth of their leaf
+  void collectStats(SpatialIndexStats &stats) const;
+
+ public:
+  DynamicAABBTree(float fatMargin = DefaultAABBTreeMargin);
+  ~DynamicAABBTree();
+
+  void addOccupant(QuadTreeOccupant* pOc);
+
+  // The region is ignored, the tree just becomes empty
+  void clearTree(const AABB &newStartRegion);
+
+  void query(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult) const;
+
+  // Calls visitor(pOc) for every occupant intersecting queryRegion until it returns false.
+  // Returns false if the visitor stopped the query.
+  template<class Visitor> bool query(const AABB &queryRegion, Visitor visitor) const
+  {
+    LTBL_COUNT_QUERY(queryCounters.add(1, 0, 0, 0));
+
+    if(root == -1)
+      return true;
+
+    return queryShape(root, queryRegion, visitor);
+  }
+
+  bool visit(const AABB &queryRegion, QueryVisitor &visitor) const;
+
+  void querySector(const Sector &sector, std::vector<QuadTreeOccupant*> &queryResult) const;
+  void queryPolygon(const ConvexPolygon &polygon, std::vector<QuadTreeOccupant*> &queryResult) const;
+  bool visitSegment(const Segment &segment, QueryVisitor &visitor) const;
+
+  unsigned int getNumOccupants() const;
+
+  // Height of the root, 0 for a single leaf and -1 when empty
+  int getHeight() const;
+
+  void debugRender();
+};
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef LTBL_JOB_POOL_H
+#define LTBL_JOB_POOL_H
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace ltbl
+{
+// Fixed set of worker threads that run batches of independent jobs. Each thread starts on its own
+// contiguous share of the batch and steals from the others once it runs out, so uneven jobs still
+// keep every thread busy. The calling thread takes part as thread 0.
+class JobPool {
+ private:
+  // Jobs of one thread, the owner takes them from the back and thieves from the front
+  struct JobQueue {
+    std::mutex mutex;
+
+    std::vector<unsigned int> jobs;
+    unsigned int first;
+  };
+
+  std::vector<std::thread> workers;
+  std::vector<std::unique_ptr<JobQueue> > queues;
+
+  // Guards everything below
+  std::mutex poolMutex;
+  std::condition_variable startCondition;
+  std::condition_variable doneCondition;
+
+  const std::function<void(unsigned int, unsigned int)>* pJob;
+
+  // Incremented for every batch, so that workers can tell a new batch from a spurious wake up
+  unsigned int batch;
+
+  unsigned int numBusyWorkers;
+
+  bool quit;
+
+  bool takeJob(unsigned int threadIndex, unsigned int &job);
+  void runJobs(unsigned int threadIndex);
+
+  void workerLoop(unsigned int threadIndex);
+
+  // Not copyable, the workers refer to the pool
+  JobPool(const JobPool &other);
+  JobPool &operator=(const JobPool &other);
+
+ public:
+  // numThreads includes the calling thread, so 1 runs everything inline without starting any threads
+  explicit JobPool(unsigned int numThreads);
+  ~JobPool();
+
+  unsigned int getNumThreads() const;
+
+  // Calls job(jobIndex, threadIndex) for every jobIndex below numJobs and returns once all calls are done.
+  // threadIndex is below getNumThreads, so it can select per thread scratch space.
+  void run(unsigned int numJobs, const std::function<void(unsigned int, unsigned int)> &job);
+};
+}
+
+#endif
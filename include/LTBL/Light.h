@@ -12,6 +12,7 @@ namespace ltbl
 const float LightSubdivisionSize = static_cast<float>(PI) / 24.0f;
 
 class LightSystem;
+class ConvexHull;
 
 class Light : public qdt::QuadTreeOccupant {
  private:
@@ -23,6 +24,27 @@ class Light : public qdt::QuadTreeOccupant {
 
   sf::RenderWindow* pWin;
 
+  // The shadow inputs as of the last updateTransformVersion call
+  unsigned int transformVersion;
+  Vec2f versionCenter;
+  float versionRadius;
+  float versionSize;
+
+  // Set while the light is in a light system, which updateTreeStatus tells that the pairs need updating
+  LightSystem* pLightSystem;
+  bool pairsDirty;
+
+  // Kept by LightSystem: the hulls paired with the light, and the light as it was when they were found
+  std::vector<ConvexHull*> pairedHulls;
+  bool pairsFound;
+  qdt::AABB pairAABB;
+  float pairDirectionAngle;
+  float pairSpreadAngle;
+  unsigned int pairVersion;
+
+  // Pair update in which the hulls were last found again
+  unsigned int pairUpdate;
+
  public:
   bool updateRequired;
 
@@ -42,12 +64,41 @@ class Light : public qdt::QuadTreeOccupant {
 
   virtual void renderLightSolidPortion(float depth);
   virtual void renderLightSoftPortion(float depth);
+  // Fits the AABB to the circle, or to the sector of directional lights
   virtual void calculateAABB();
   qdt::AABB* getAABB();
 
+  // Lights that only cover part of their bounding box, so that hulls are better found with queryHulls
+  virtual bool isDirectional() const;
+
+  // Appends the hulls that may cast shadows into the light. Directional lights query a sector
+  // grown by the light size, so that hulls just outside it still cast their soft shadows.
+  virtual void queryHulls(const qdt::SpatialIndex &hullIndex, std::vector<qdt::QuadTreeOccupant*> &hulls) const;
+
+  // Whether queryHulls would report a hull with these bounds
+  virtual bool affectsHull(const qdt::AABB &hullBounds) const;
+
+  // Bounds of the region in which affectsHull can report hulls. The light system uses how far they reach
+  // past the AABB to find the lights of a moved hull through the light index.
+  virtual qdt::AABB getHullQueryBounds() const;
+
+  // Intensity the light contributes at point, falling off linearly to 0 at its radius like the rendered light.
+  // Points outside the spread of directional lights get 0.
+  virtual float getIntensityAt(const Vec2f &point) const;
+
   bool alwaysUpdate();
   void setAlwaysUpdate(bool always);
 
+  // Incremented whenever center, radius or size changed since the last call, and returned. These are set directly,
+  // so the light system calls this once per frame to find out whether cached shadows of the light are still good.
+  unsigned int updateTransformVersion();
+  unsigned int getTransformVersion() const;
+
+  // Call after changing center, radius, size, the angles or the AABB. Moves the light in the light index like
+  // QuadTreeOccupant::updateTreeStatus, and has the light system find the hulls of the light again.
+  // Lights that are changed without it keep their hull pairs until they are.
+  void updateTreeStatus();
+
   friend class LightSystem;
 };
 }
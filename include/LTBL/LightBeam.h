@@ -21,6 +21,17 @@ class LightBeam : public Light {
   void renderLightSolidPortion(float depth);
   void renderLightSoftPortion(float depth);
   void calculateAABB();
+  bool isDirectional() const;
+
+  // Falls off along the beam direction, 0 outside the quad
+  float getIntensityAt(const Vec2f &point) const;
+
+  // Queries the quad of the beam
+  void queryHulls(const qdt::SpatialIndex &hullIndex, std::vector<qdt::QuadTreeOccupant*> &hulls) const;
+  bool affectsHull(const qdt::AABB &hullBounds) const;
+
+  // The AABB, which calculateAABB fits to the quad
+  qdt::AABB getHullQueryBounds() const;
 };
 }
 
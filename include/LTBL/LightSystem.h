@@ -3,11 +3,15 @@
 
 #include "Light.h"
 #include "ConvexHull.h"
-#include "ShadowFin.h"
+#include "ShadowGeometryBuilder.h"
+#include "ShadowGeometryCache.h"
+#include "JobPool.h"
+#include "SpatialIndex.h"
 #include "SFML_OpenGL.h"
 #include <unordered_set>
 #include <vector>
 #include <memory>
+#include <mutex>
 
 namespace ltbl
 {
@@ -17,8 +21,6 @@ namespace ltbl
 const float lightRadiusCullMultiplier = 1.0f;
 const float renderDepth = 50.0f;
 
-const int maxFins = 2;
-
 class EmissiveLight : public qdt::QuadTreeOccupant {
  private:
   sf::Texture* text;
@@ -42,6 +44,50 @@ class EmissiveLight : public qdt::QuadTreeOccupant {
   void update();
 };
 
+// Result of LightSystem::raycast
+struct RaycastHit {
+  // NULL if the segment is clear
+  ConvexHull* pHull;
+
+  // Where the segment enters the hull, as a point and as a fraction of the segment
+  Vec2f point;
+  float fraction;
+
+  // Unit outward normal of the edge that was hit
+  Vec2f normal;
+
+  RaycastHit();
+};
+
+struct RaycastSegment {
+  Vec2f from;
+  Vec2f to;
+};
+
+// Result of LightSystem::lightsAffecting
+struct LightContribution {
+  Light* pLight;
+
+  // See Light::getIntensityAt
+  float intensity;
+};
+
+// Change of a (light, hull) pair, see LightSystem::getPairEvents
+struct LightHullPairEvent {
+  enum Type {
+    // The light started or stopped reaching the hull
+    Added, Removed,
+
+    // The light or the hull moved while the light kept reaching the hull, so the shadow changed
+    Moved
+  };
+
+  Type type;
+
+  Light* pLight;
+  ConvexHull* pHull;
+};
+
 class LightSystem
 {
  private:
@@ -53,24 +99,96 @@ class LightSystem
 
   std::vector<Light*> lightsToPreBuild;
 
-  std::unique_ptr<qdt::QuadTree> lightTree;
-  std::unique_ptr<qdt::QuadTree> hullTree;
-  std::unique_ptr<qdt::QuadTree> emissiveTree;
+  // Region the trees were created with, used when switching index types
+  qdt::AABB treeRegion;
+
+  std::unique_ptr<qdt::SpatialIndex> lightTree;
+  std::unique_ptr<qdt::SpatialIndex> hullTree;
+  std::unique_ptr<qdt::SpatialIndex> emissiveTree;
 
   sf::RenderTexture renderTexture;
   sf::RenderTexture lightTemp;
 
-  std::vector<ShadowFin> finsToRender;
+  // Builds the shadows of the lights in parallel, with one builder per thread
+  std::unique_ptr<JobPool> shadowJobPool;
+  std::vector<ShadowGeometryBuilder> shadowGeometryBuilders;
+
+  // Shadows of each visible light, built on the CPU and then drawn in one call per kind
+  std::vector<ShadowGeometry> lightShadowGeometry;
+
+  // Shadows of single (light, hull) pairs from earlier frames, and the entry of each of lightHulls, NULL if the pair is not cached
+  ShadowGeometryCache shadowCache;
+  std::vector<ShadowGeometryCache::Entry*> lightHullEntries;
+
+  // checkForHullIntersect as of the cached shadows, which depend on it
+  bool shadowCacheHullCheck;
+
+  // Query results of renderLights, kept around so that culling stops allocating once warmed up
+  std::vector<qdt::QuadTreeOccupant*> visibleLights;
+  std::vector<qdt::QuadTreeOccupant*> visibleEmissiveLights;
+
+  // Hulls of the visible lights, those of light l start at lightHullOffsets[l] and end at lightHullOffsets[l + 1]
+  std::vector<qdt::QuadTreeOccupant*> lightHulls;
+  std::vector<unsigned int> lightHullOffsets;
+
+  // Whether each visible light is drawn again this frame, and the indices of those that are
+  std::vector<bool> lightUpdates;
+  std::vector<unsigned int> lightsToUpdate;
+
+  // Hulls whose deprecated ConvexHull::updateRequired was seen this frame, cleared once all lights are checked
+  std::vector<ConvexHull*> flaggedHulls;
+
+  // The pairs themselves are kept in Light::pairedHulls and ConvexHull::pairedLights from one renderLights to the next.
+  // Lights report their changes through lightChanged and hulls through hullChanged, which may be called on other threads
+  // while tree updates are deferred. So the pair updates cost as much as the lights and hulls that changed.
+  std::vector<Light*> movedLights;
+  std::mutex movedLightMutex;
+  std::vector<ConvexHull*> movedHulls;
+  std::mutex movedHullMutex;
+
+  // How far Light::getHullQueryBounds reached past the AABB of any light when its pairs were found. The lights of a moved hull
+  // are queried with the hull bounds grown by this, so that the soft edges of directional lights are found as well. Never shrinks.
+  float lightQueryMargin;
+
+  // Scratch space of updatePairs
+  std::vector<Light*> lightPairsToUpdate;
+  std::vector<ConvexHull*> hullsToUpdate;
+  std::vector<ConvexHull*> oldPairedHulls;
+  std::vector<Light*> oldPairedLights;
+  std::vector<Light*> foundLights;
+  std::vector<qdt::QuadTreeOccupant*> pairQueryResult;
+
+  std::vector<LightHullPairEvent> pairEvents;
+
+  // Incremented for every updatePairs call, see Light::pairUpdate
+  unsigned int pairUpdateCount;
 
   sf::Texture softShadowTexture;
 
   int prebuildTimer;
 
-  void maskShadow(Light* light, ConvexHull* convexHull, float depth);
-  void addExtraFins(const ConvexHull &hull, ShadowFin* fin, const Light &light, Vec2f &mainUmbra, Vec2f &mainUmbraRoot, int boundryIndex, bool wrapCW);
+  // Draws a triangle list from client memory, with texture coordinates if textured
+  void submitShadowVertices(const std::vector<ShadowVertex> &vertices, bool textured);
   void cameraSetup();
   void setUp(const qdt::AABB &region);
 
+  // Queue a light or hull to have its pairs updated in the next updatePairs
+  void lightChanged(Light* pLight);
+  void trackLight(Light* pLight);
+  void hullChanged(ConvexHull* pHull);
+  void trackHull(ConvexHull* pHull);
+
+  // Brings the pairs up to date with the lights and hulls that changed since the last call
+  void updatePairs();
+  void updateLightPairs(Light* pLight);
+  void updateHullPairs(ConvexHull* pHull);
+
+  // Drops all pairs of a light or hull that leaves the system
+  void detachLight(Light* pLight);
+  void detachHull(ConvexHull* pHull);
+
+  void raisePairEvent(LightHullPairEvent::Type type, Light* pLight, ConvexHull* pHull);
+
  public:
   sf::View view;
   sf::Color ambientColor;
@@ -84,12 +202,87 @@ class LightSystem
   void addConvexHull(ConvexHull* newConvexHull);
   void addEmissiveLight(EmissiveLight* newEmissiveLight);
 
+  // Adds a range of hulls at once, building the hull tree in one pass. Meant for static level geometry.
+  // This is a convenience rather than a speedup: loading takes about as long as adding the hulls one by one,
+  // but the root of the hull tree is sized for the whole level at once and the hulls are placed in Morton order.
+  template<class Iterator> void addConvexHulls(Iterator first, Iterator last)
+  {
+    for(Iterator it = first; it != last; it++)
+    {
+      convexHulls.insert(*it);
+      trackHull(*it);
+    }
+
+    hullTree->bulkLoad(first, last);
+  }
+
   void removeLight(Light* pLight);
   void removeConvexHull(ConvexHull* pHull);
   void removeEmissiveLight(EmissiveLight* pEmissiveLight);
 
   void buildLight(Light* pLight);
 
+  // Selects the spatial index used for each kind of object, quad trees by default.
+  // Objects that were already added are moved over to the new index.
+  void setLightIndexType(qdt::SpatialIndexType type);
+  void setHullIndexType(qdt::SpatialIndexType type);
+  void setEmissiveIndexType(qdt::SpatialIndexType type);
+
+  // Same as above with an index configured by the caller, such as a hash grid with a custom cell size.
+  // The light system takes ownership of the index.
+  void setLightIndex(qdt::SpatialIndex* pIndex);
+  void setHullIndex(qdt::SpatialIndex* pIndex);
+  void setEmissiveIndex(qdt::SpatialIndex* pIndex);
+
+  // Read-only access to the indices, for visibility queries of your own
+  const qdt::SpatialIndex* getLightIndex() const;
+  const qdt::SpatialIndex* getHullIndex() const;
+  const qdt::SpatialIndex* getEmissiveIndex() const;
+
+  // Finds the hull the segment from from to to hits first, using the hull index to find the candidates.
+  // Like the queries this may run on several threads at once, but it reads the hull vertices, so hulls must not move meanwhile.
+  RaycastHit raycast(const Vec2f &from, const Vec2f &to) const;
+
+  // Casts numSegments segments, writing one hit per segment
+  void raycastMany(const RaycastSegment* pSegments, unsigned int numSegments, RaycastHit* pHits) const;
+
+  // Finds the k lights that contribute the most intensity at point and writes them to pResults, brightest first.
+  // pResults must have room for k entries. Returns how many lights were found, lights that don't reach the point are left out.
+  // Nothing is allocated, so like raycast this may run on several threads as long as the lights don't change meanwhile.
+  unsigned int lightsAffecting(const Vec2f &point, unsigned int k, LightContribution* pResults) const;
+
+  // Structure and query statistics of the indices, for tuning. See SpatialIndex::getStats.
+  qdt::SpatialIndexStats getLightIndexStats() const;
+  qdt::SpatialIndexStats getHullIndexStats() const;
+  qdt::SpatialIndexStats getEmissiveIndexStats() const;
+
+  void resetIndexQueryCounters();
+
+  // Defers the tree updates of moving lights, hulls and emissive lights until the next renderLights call,
+  // which then reinserts them all in one batch. With deferral on, worker threads may query the indices
+  // and move objects while the main thread is not adding, removing or rendering (see SpatialIndex).
+  // renderLights is the sync point.
+  void setDeferredTreeUpdates(bool defer);
+
+  // Number of threads that build shadow geometry in renderLights, including the calling thread.
+  // 1, the default, builds everything on the calling thread, 0 uses one thread per hardware thread.
+  // Building only reads the lights and hulls and all drawing stays on the calling thread.
+  void setShadowThreadCount(unsigned int numThreads);
+  unsigned int getShadowThreadCount() const;
+
+  // Memory the shadows of (light, hull) pairs may take up, DefaultShadowCacheBudget by default. Pairs whose light and hull
+  // kept their transform versions reuse the shadow of the last frame instead of building it again, the least recently
+  // used pairs are dropped once over budget. 0 turns the cache off.
+  void setShadowCacheBudget(unsigned int bytes);
+  unsigned int getShadowCacheBudget() const;
+  unsigned int getShadowCacheMemoryUsage() const;
+
+  // Pairs of lights and the hulls they reach that were added, removed or moved by the last renderLights call, which
+  // keeps the pairs from one frame to the next and only looks at lights and hulls that changed. Static lights are drawn
+  // again exactly when one of their pairs changes. Removing a light or hull drops its pairs without events, since it
+  // is usually deleted right after.
+  const std::vector<LightHullPairEvent> &getPairEvents() const;
+
   // Clears all lights
   void clearLights();
 
@@ -102,6 +295,9 @@ class LightSystem
   void renderLights();
 
   void renderLightTexture(float renderDepth = 1.0f);
+
+  friend class Light;
+  friend class ConvexHull;
 };
 }
 
@@ -0,0 +1,152 @@
+#ifndef LTBL_LINEAR_QUAD_TREE_H
+#define LTBL_LINEAR_QUAD_TREE_H
+
+#include "QuadTreeOccupant.h"
+#include "BoundsIntersect.h"
+#include <vector>
+#include <string>
+#include <utility>
+
+namespace qdt
+{
+// Nodes of a linear tree hold more items than dynamic ones, since they are never split or merged again
+const unsigned int LinearMaximumOccupants = 8;
+
+// Deeper levels would be finer than the 16 bit item bounds of the root
+const unsigned int LinearMaxLevels = 16;
+
+// Children of a node are stored next to each other in Morton order, so a node
+// only needs the index of its first child and which of the 4 quadrants exist
+struct LinearQuadTreeNode {
+  // Index of the first child << 4 | mask of the existing children, bit x + 2 * y for child (x, y)
+  unsigned int children;
+
+  // The items of node i are firstItem of node i to firstItem of node i + 1
+  unsigned int firstItem;
+};
+
+static_assert(sizeof(LinearQuadTreeNode) == 8, "The file format stores nodes as they are in memory");
+
+// Item bounds quantized to 16 bits relative to the region of their node.
+// Lower bounds are rounded down and upper bounds up, so the quantized bounds contain the original ones.
+struct LinearQuadTreeItem {
+  unsigned short lowerX;
+  unsigned short lowerY;
+  unsigned short upperX;
+  unsigned short upperY;
+
+  // Index of the bounds the tree was built from
+  unsigned int id;
+};
+
+static_assert(sizeof(LinearQuadTreeItem) == 12, "The file format stores items as they are in memory");
+
+// Immutable quad tree for static sets such as level hulls. Nodes and items live in two flat arrays
+// without pointers, so the tree can be built offline, saved, and loaded back with two reads.
+// Queries report the ids given at build time, and since item bounds are quantized they may report
+// items up to 1 / 65535 of their node's size outside the query region.
+// All queries are const and may run on several threads at once.
+class LinearQuadTree {
+ private:
+  AABB rootRegion;
+
+  // One extra node at the end marks where the items of the last node end
+  std::vector<LinearQuadTreeNode> nodes;
+  std::vector<LinearQuadTreeItem> items;
+
+  static AABB getChildRegion(const AABB &region, unsigned int childIndex);
+
+  // Converts a coordinate to the 16 bit space of a node, rounding down or up
+  static unsigned short quantizeLower(float value, float lower, float scale);
+  static unsigned short quantizeUpper(float value, float lower, float scale);
+
+  static float getQuantizationScale(float lower, float upper);
+
+  // Checks that the nodes and items read from a file form a tree the queries can walk safely
+  bool isStructureValid() const;
+
+  // Splits ids[first, last) among the children of the node with the same counting sort as QuadTreeNode::bulkLoad,
+  // leaving the ones that stay in this node at the end of the range. Records the node regions and item ranges for build to pack.
+  void buildNode(unsigned int nodeIndex, const AABB &region, unsigned int level, const AABB* pBounds,
+                 std::vector<unsigned int> &ids, unsigned int first, unsigned int last, std::vector<unsigned int> &scratch,
+                 std::vector<AABB> &nodeRegions, std::vector<std::pair<unsigned int, unsigned int> > &nodeItemRanges);
+
+  template<class Visitor> bool queryNode(unsigned int nodeIndex, const AABB &region, const AABB &queryRegion, Visitor &visitor) const
+  {
+    const LinearQuadTreeNode &node = nodes[nodeIndex];
+
+    unsigned int firstItem = node.firstItem;
+    unsigned int lastItem = nodes[nodeIndex + 1].firstItem;
+
+    if(firstItem != lastItem)
+    {
+      // The query region in the 16 bit space of this node
+      float scaleX = getQuantizationScale(region.lowerBound.x, region.upperBound.x);
+      float scaleY = getQuantizationScale(region.lowerBound.y, region.upperBound.y);
+
+      unsigned short lowerX = quantizeLower(queryRegion.lowerBound.x, region.lowerBound.x, scaleX);
+      unsigned short lowerY = quantizeLower(queryRegion.lowerBound.y, region.lowerBound.y, scaleY);
+      unsigned short upperX = quantizeUpper(queryRegion.upperBound.x, region.lowerBound.x, scaleX);
+      unsigned short upperY = quantizeUpper(queryRegion.upperBound.y, region.lowerBound.y, scaleY);
+
+      for(unsigned int i = firstItem; i < lastItem; i++)
+      {
+        const LinearQuadTreeItem &item = items[i];
+
+        if(item.upperX >= lowerX && item.upperY >= lowerY && item.lowerX <= upperX && item.lowerY <= upperY && !visitor(item.id))
+          return false;
+      }
+    }
+
+    unsigned int childMask = node.children & 0xf;
+    unsigned int childIndex = node.children >> 4;
+
+    for(; childMask != 0; childMask &= childMask - 1, childIndex++)
+    {
+      AABB childRegion(getChildRegion(region, lowestBitIndex(childMask)));
+
+      if(childRegion.intersects(queryRegion) && !queryNode(childIndex, childRegion, queryRegion, visitor))
+        return false;
+    }
+
+    return true;
+  }
+
+ public:
+  LinearQuadTree();
+
+  // Builds the tree over the bounds of numBounds items, which are reported by their index in pBounds.
+  // The root region is the union of all bounds.
+  void build(const AABB* pBounds, unsigned int numBounds);
+
+  void clear();
+
+  // Native byte order, meant for files built for and shipped with one platform
+  // Loading fails and leaves the tree empty if the counts don't match the file size or the nodes don't form a valid tree
+  bool saveToFile(const std::string &fileName) const;
+  bool loadFromFile(const std::string &fileName);
+
+  // Appends the ids of the items intersecting queryRegion
+  void query(const AABB &queryRegion, std::vector<unsigned int> &queryResult) const;
+
+  // Calls visitor(id) for every item intersecting queryRegion until it returns false.
+  // Returns false if the visitor stopped the query.
+  template<class Visitor> bool query(const AABB &queryRegion, Visitor visitor) const
+  {
+    if(nodes.empty() || !rootRegion.intersects(queryRegion))
+      return true;
+
+    return queryNode(0, rootRegion, queryRegion, visitor);
+  }
+
+  AABB getRootAABB() const;
+
+  unsigned int getNumNodes() const;
+  unsigned int getNumItems() const;
+
+  // Bytes taken by the node and item arrays
+  unsigned int getMemoryUsage() const;
+};
+}
+
+#endif
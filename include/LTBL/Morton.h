@@ -0,0 +1,48 @@
+#ifndef LTBL_MORTON_H
+#define LTBL_MORTON_H
+
+#include "QuadTreeOccupant.h"
+
+namespace qdt
+{
+// Spreads the lower 16 bits of a value out to the even bits
+inline unsigned int spreadBits(unsigned int value)
+{
+  value &= 0x0000ffff;
+  value = (value | (value << 8)) & 0x00ff00ff;
+  value = (value | (value << 4)) & 0x0f0f0f0f;
+  value = (value | (value << 2)) & 0x33333333;
+  value = (value | (value << 1)) & 0x55555555;
+
+  return value;
+}
+
+// Interleaves two 16 bit cell coordinates, x ending up in the even bits
+inline unsigned int mortonCode(unsigned int x, unsigned int y)
+{
+  return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+// Morton code of a point quantized to a 65536 x 65536 grid over the region, points outside are clamped
+inline unsigned int mortonCode(const Vec2f &point, const AABB &region)
+{
+  Vec2f dims = region.getDims();
+
+  float fx = dims.x > 0.0f ? (point.x - region.lowerBound.x) / dims.x : 0.0f;
+  float fy = dims.y > 0.0f ? (point.y - region.lowerBound.y) / dims.y : 0.0f;
+
+  if(fx < 0.0f)
+    fx = 0.0f;
+  else if(fx > 1.0f)
+    fx = 1.0f;
+
+  if(fy < 0.0f)
+    fy = 0.0f;
+  else if(fy > 1.0f)
+    fy = 1.0f;
+
+  return mortonCode(static_cast<unsigned int>(fx * 65535.0f), static_cast<unsigned int>(fy * 65535.0f));
+}
+}
+
+#endif
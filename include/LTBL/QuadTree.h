@@ -12,31 +12,237 @@
 #define LTBL_QUAD_TREE_H
 
 #include "QuadTreeNode.h"
+#include "QuadTreeNodePool.h"
 #include "QuadTreeOccupant.h"
+#include "QuadTreeOccupantList.h"
+#include "SpatialIndex.h"
 
-#include <unordered_set>
+#include <vector>
+#include <utility>
 
 namespace qdt
 {
-class QuadTree {
+// The root grows once more than RootGrowthMinOutside occupants are outside of it
+// and they make up more than 1 / RootGrowthOutsideRatio of all occupants
+const unsigned int RootGrowthMinOutside = 8;
+const unsigned int RootGrowthOutsideRatio = 8;
+
+// Doublings per check, so a single far away occupant can't stall a frame
+const unsigned int MaxRootGrowthSteps = 4;
+
+class QuadTree : public SpatialIndex {
  private:
-  std::unordered_set<QuadTreeOccupant*> outsideRoot;
+  // Declared first so that it outlives the nodes it hands out
+  QuadTreeNodePool nodePool;
+
+  // Occupants that don't fit in the root node, nodeIndex is their index in this list
+  QuadTreeOccupantList outsideRoot;
 
   QuadTreeNode* rootNode;
 
+  // Loose trees place occupants by size and center alone, rootCell is the tight root region
+  bool looseTree;
+  AABB rootCell;
+
+  Vec2f getCellDims(unsigned int level) const;
+  void getLooseCell(const AABB &aabb, unsigned int &targetLevel, Point2i &cell) const;
+
+  // Scratch space for batched insertions
+  std::vector<std::pair<unsigned int, QuadTreeOccupant*> > sortedOccupants;
+  std::vector<std::pair<unsigned int, QuadTreeOccupant*> > sortScratch;
+  std::vector<BulkOccupant> bulkBuildOccupants;
+
+  bool rootGrowth;
+
+  // Adds without growing the root, for use in the middle of a batch
+  void insertOccupant(QuadTreeOccupant* pOc);
+
+  void growRootIfNeeded();
+
+  // Doubles the root cell towards the given side, the old root becomes one of the new root's children
+  void growRoot(bool towardsNegativeX, bool towardsNegativeY);
+
+  static AABB getGrownCell(const AABB &cell, bool towardsNegativeX, bool towardsNegativeY);
+
+  // The root cell growRootIfNeeded would end up with after adding bulkOccupants
+  AABB getBulkRootCell() const;
+
+  // Sets the root cell to newRootCell and builds the tree again from all of its occupants and the bulk occupants
+  void rebuild(const AABB &newRootCell);
+
+  void detachOccupant(QuadTreeOccupant* pOc);
+
+  void sortOccupantsByMortonCode();
+
+  // Tests the bound copy kept by the node of an occupant, which unlike the occupant's own AABB
+  // does not change until the next update is applied
+  static bool storedBoundsIntersect(const QuadTreeOccupant* pOc, const AABB &region)
+  {
+    return pOc->pQuadTreeNode->occupants.boundsIntersect(pOc->nodeIndex, region);
+  }
+
+  template<class Shape, class Visitor> bool queryShape(const Shape &shape, Visitor &visitor) const
+  {
+    const AABB &shapeBounds = shape.getAABB();
+
+    LTBL_COUNT_QUERY(queryCounters.add(1, 0, outsideRoot.size(), 0));
+
+    for(unsigned int i = 0; i < outsideRoot.size(); i++)
+      if(outsideRoot.boundsIntersect(i, shapeBounds) && shape.intersects(outsideRoot.getBounds(i)))
+      {
+        LTBL_COUNT_QUERY(queryCounters.add(0, 0, 0, 1));
+
+        if(!visitor(outsideRoot.getOccupant(i)))
+          return false;
+      }
+
+    return rootNode->queryShape(shape, shapeBounds, visitor);
+  }
+
+  // Pairs of occupants of the subtrees of pNodeA and pNodeB, see queryPairs
+  template<class Callback> static void queryNodePairs(const QuadTreeNode* pNodeA, const QuadTreeNode* pNodeB, const AABB &queryRegion, Callback &callback)
+  {
+    // Occupants are contained in their node regions, so disjoint nodes have no pairs
+    if(!pNodeA->region.intersects(pNodeB->region) || !pNodeA->region.intersects(queryRegion))
+      return;
+
+    // Occupants of pNodeA against everything below pNodeB
+    for(unsigned int i = 0; i < pNodeA->occupants.size(); i++)
+      if(pNodeA->occupants.boundsIntersect(i, queryRegion))
+      {
+        QuadTreeOccupant* pOcA = pNodeA->occupants.getOccupant(i);
+
+        auto visitor = [&](QuadTreeOccupant* pOcB) { callback(pOcA, pOcB); return true; };
+
+        pNodeB->query(pNodeA->occupants.getBounds(i), visitor);
+      }
+
+    if(!pNodeA->hasChildren)
+      return;
+
+    // Occupants of pNodeB against everything below the children of pNodeA
+    for(unsigned int i = 0; i < pNodeB->occupants.size(); i++)
+    {
+      QuadTreeOccupant* pOcB = pNodeB->occupants.getOccupant(i);
+
+      AABB bounds(pNodeB->occupants.getBounds(i));
+
+      auto visitor = [&](QuadTreeOccupant* pOcA) { if(storedBoundsIntersect(pOcA, queryRegion)) callback(pOcA, pOcB); return true; };
+
+      for(unsigned int x = 0; x < 2; x++)
+        for(unsigned int y = 0; y < 2; y++)
+          pNodeA->children[x][y]->query(bounds, visitor);
+    }
+
+    if(!pNodeB->hasChildren)
+      return;
+
+    // Everything else is below the children of both
+    for(unsigned int xA = 0; xA < 2; xA++)
+      for(unsigned int yA = 0; yA < 2; yA++)
+        for(unsigned int xB = 0; xB < 2; xB++)
+          for(unsigned int yB = 0; yB < 2; yB++)
+            queryNodePairs(pNodeA->children[xA][yA], pNodeB->children[xB][yB], queryRegion, callback);
+  }
+
+ protected:
+  void applyUpdate(QuadTreeOccupant* pOc);
+  void removeOccupant(QuadTreeOccupant* pOc);
+
+  // Sizes the root for all occupants, sorts them by Morton code and builds each node exactly once.
+  // This takes about as long as adding the occupants one by one, since creating the nodes costs the most either way.
+  void buildFromBulkOccupants();
+
+  void collectStats(SpatialIndexStats &stats) const;
+
  public:
-  QuadTree(const AABB &startRegion);
+  // A loose tree oversizes every node by LooseMultiplier, including the root,
+  // and computes the target node of an occupant directly instead of testing each level
+  QuadTree(const AABB &startRegion, bool loose = false);
   ~QuadTree();
 
   void addOccupant(QuadTreeOccupant* pOc);
   void clearTree(const AABB &newStartRegion);
 
-  void query(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult);
-  void queryToDepth(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult, int depth);
+  // Reinserts all dirty occupants in spatial order, merging each affected subtree once
+  void commitUpdates();
+
+  // When enabled, which is the default, the root region grows towards occupants that don't fit in it.
+  // Each growth step needs proportionally more outliers than the previous one, so the cost is amortized.
+  void setRootGrowth(bool grow);
+  bool getRootGrowth() const;
+
+  void query(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult) const;
+
+  // Calls visitor(pOc) for every occupant intersecting queryRegion until it returns false.
+  // The visitor is taken by value like in the standard algorithms, so let it capture any state by reference.
+  // Returns false if the visitor stopped the query.
+  template<class Visitor> bool query(const AABB &queryRegion, Visitor visitor) const
+  {
+    LTBL_COUNT_QUERY(queryCounters.add(1, 0, outsideRoot.size(), 0));
+
+    for(unsigned int i = 0; i < outsideRoot.size(); i++)
+      if(outsideRoot.boundsIntersect(i, queryRegion))
+      {
+        LTBL_COUNT_QUERY(queryCounters.add(0, 0, 0, 1));
+
+        if(!visitor(outsideRoot.getOccupant(i)))
+          return false;
+      }
+
+    return rootNode->query(queryRegion, visitor);
+  }
+
+  bool visit(const AABB &queryRegion, QueryVisitor &visitor) const;
+
+  void querySector(const Sector &sector, std::vector<QuadTreeOccupant*> &queryResult) const;
+  void queryPolygon(const ConvexPolygon &polygon, std::vector<QuadTreeOccupant*> &queryResult) const;
+  bool visitSegment(const Segment &segment, QueryVisitor &visitor) const;
+
+  // Calls callback(pOc, pOtherOc) once for every occupant of this tree intersecting queryRegion
+  // and every occupant of the other tree intersecting it. Both trees are walked together,
+  // so pairs of subtrees that cannot overlap are skipped as a whole.
+  template<class Callback> void queryPairs(const QuadTree &other, const AABB &queryRegion, Callback callback) const
+  {
+    LTBL_COUNT_QUERY(queryCounters.add(1, 0, 0, 0));
+
+    // Occupants outside this root against the whole other tree
+    for(unsigned int i = 0; i < outsideRoot.size(); i++)
+      if(outsideRoot.boundsIntersect(i, queryRegion))
+      {
+        QuadTreeOccupant* pOc = outsideRoot.getOccupant(i);
+
+        other.query(outsideRoot.getBounds(i), [&](QuadTreeOccupant* pOtherOc) { callback(pOc, pOtherOc); return true; });
+      }
+
+    // Occupants outside the other root against the nodes of this tree
+    for(unsigned int i = 0; i < other.outsideRoot.size(); i++)
+    {
+      QuadTreeOccupant* pOtherOc = other.outsideRoot.getOccupant(i);
+
+      auto visitor = [&](QuadTreeOccupant* pOc) { if(storedBoundsIntersect(pOc, queryRegion)) callback(pOc, pOtherOc); return true; };
+
+      rootNode->query(other.outsideRoot.getBounds(i), visitor);
+    }
+
+    queryNodePairs(rootNode, other.rootNode, queryRegion, callback);
+  }
+  void queryToDepth(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult, int depth) const;
+
+  // Finds the k occupants whose bounds are closest to point and writes them to pResults, nearest first.
+  // pResults must have room for k entries, it also serves as the heap of the search so nothing is allocated.
+  // Returns how many were found, which is less than k only if the tree has fewer occupants.
+  unsigned int queryNearest(const Vec2f &point, unsigned int k, NearestOccupant* pResults) const;
+
+  unsigned int getNumOccupants() const;
+
+  AABB getRootAABB() const;
 
-  unsigned int getNumOccupants();
+  bool isLoose() const;
 
-  AABB getRootAABB();
+  // Node pool usage, counted in blocks of 4 children
+  unsigned int getNumLiveNodeBlocks() const;
+  unsigned int getNumPooledNodeBlocks() const;
 
   void debugRender();
 
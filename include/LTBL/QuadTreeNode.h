@@ -2,7 +2,8 @@
 #define LTBL_QUAD_TREE_NODE_H
 
 #include "QuadTreeOccupant.h"
-#include <unordered_set>
+#include "QuadTreeOccupantList.h"
+#include "SpatialIndex.h"
 #include <vector>
 
 namespace qdt
@@ -11,10 +12,36 @@ const unsigned int MaximumOccupants = 3;
 const unsigned int MinimumOccupants = 1;
 const float OversizedMultiplier = 1.2f;
 
+// Node regions of loose trees are this many times the size of their cell
+const float LooseMultiplier = 2.0f;
+
 const unsigned int MaxLevels = 20;
 
 class QuadTree;
 
+// Occupant being bulk loaded along with a copy of its bounds, so that the build reads them in order
+// instead of following the occupant pointers at every level
+struct BulkOccupant {
+  AABB bounds;
+  QuadTreeOccupant* pOccupant;
+
+  // Child that fits the occupant, 4 for none, while its node is being built
+  unsigned int group;
+};
+
+// Result of QuadTree::queryNearest
+struct NearestOccupant {
+  QuadTreeOccupant* pOccupant;
+
+  // Squared distance from the query point to the occupant's bounds, 0 if the point is inside them
+  float distanceSquared;
+
+  bool operator<(const NearestOccupant &other) const
+  {
+    return distanceSquared < other.distanceSquared;
+  }
+};
+
 class QuadTreeNode {
  private:
   AABB region;
@@ -23,7 +50,7 @@ class QuadTreeNode {
   QuadTreeNode* pParentNode;
   QuadTree* pQuadTree;
 
-  std::unordered_set<QuadTreeOccupant*> occupants;
+  QuadTreeOccupantList occupants;
 
   QuadTreeNode* children[2][2];
   bool hasChildren;
@@ -32,27 +59,138 @@ class QuadTreeNode {
 
   unsigned int level;
 
+  // Set on the path of occupants taken out during QuadTree::commitUpdates
+  bool mergeCheckRequired;
+
   void partition();
 
   void destroyChildren();
 
+  // Sets the node up again after being handed out by the node pool
+  void reset(const AABB &newRegion, unsigned int numLevels, QuadTreeNode* pParent, QuadTree* pContainer);
+
+  // Takes over the occupants and children of pOther, which becomes an empty leaf.
+  // Used when the root grows, so this node's region must contain pOther's.
+  void adopt(QuadTreeNode* pOther);
+  void incrementLevels();
+
   void merge();
-  void getOccupants(std::unordered_set<QuadTreeOccupant*> &upperOccupants, QuadTreeNode* newNode);
-  void getOccupants(std::vector<QuadTreeOccupant*> &queryResult);
+  void mergeEmptied();
+  void getOccupants(QuadTreeOccupantList &upperOccupants, QuadTreeNode* newNode);
+  void getOccupants(std::vector<QuadTreeOccupant*> &queryResult) const;
+  void collectStats(SpatialIndexStats &stats) const;
   Point2i getPossibleOccupantPos(QuadTreeOccupant* pOc);
 
+  // Loose trees place an occupant from its center and size alone. The target level and cell come from QuadTree::getLooseCell,
+  // with the level cut back to this node's if the cell is not below it. Finding the node still walks down from here,
+  // since every node on the way counts the occupants below it and nodes are only partitioned once they fill up.
+  void getLooseTarget(QuadTreeOccupant* pOc, unsigned int &targetLevel, Point2i &cell) const;
+  void addOccupantLoose(QuadTreeOccupant* pOc);
+
+  // Whether the occupant, already in this node, would be placed here again after moving
+  bool keepsLooseOccupant(QuadTreeOccupant* pOc) const;
+
+  // Builds this empty node and everything below it from a Morton ordered range of occupants,
+  // pScratch must have room for as many occupants as the range
+  void bulkLoad(BulkOccupant* pFirst, BulkOccupant* pLast, BulkOccupant* pScratch);
+
+  // Branch and bound search for QuadTree::queryNearest. pResults holds a max heap of the numResults
+  // closest occupants found so far, which stops growing at k.
+  void queryNearest(const Vec2f &point, unsigned int k, NearestOccupant* pResults, unsigned int &numResults) const;
+
+  // Puts an occupant in the heap of queryNearest if it is closer than the furthest one found so far
+  static void offerNearest(QuadTreeOccupant* pOc, float distanceSquared, unsigned int k, NearestOccupant* pResults, unsigned int &numResults);
+
+  // Adds to the query counters of the tree, see LTBL_QUERY_STATS
+  void countQuery(unsigned int numNodes, unsigned int numBoundsTests, unsigned int numHits) const;
+
  public:
+  QuadTreeNode();
   QuadTreeNode(const AABB &newRegion, unsigned int numLevels, QuadTreeNode* pParent = NULL, QuadTree* pContainer = NULL);
   ~QuadTreeNode();
 
   void addOccupant(QuadTreeOccupant* pOc);
-  void query(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult);
-  void queryToDepth(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult, int depth);
+  void query(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult) const;
+  void queryToDepth(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult, int depth) const;
+
+  // Calls visitor(pOc) for every occupant intersecting queryRegion until it returns false.
+  // Returns false if the visitor stopped the query.
+  template<class Visitor> bool query(const AABB &queryRegion, Visitor &visitor) const
+  {
+    if(!region.intersects(queryRegion))
+    {
+      LTBL_COUNT_QUERY(countQuery(1, 1, 0));
+
+      return true;
+    }
+
+    LTBL_COUNT_QUERY(countQuery(1, 1 + occupants.size(), 0));
+
+    for(unsigned int first = 0; first < occupants.size(); first += BoundsBatchSize)
+    {
+      unsigned int mask = occupants.boundsIntersectMask(first, queryRegion);
+
+      LTBL_COUNT_QUERY(countQuery(0, 0, bitCount(mask)));
+
+      for(; mask != 0; mask &= mask - 1)
+        if(!visitor(occupants.getOccupant(first + lowestBitIndex(mask))))
+          return false;
+    }
+
+    if(hasChildren)
+    {
+      for(unsigned int x = 0; x < 2; x++)
+        for(unsigned int y = 0; y < 2; y++)
+          if(!children[x][y]->query(queryRegion, visitor))
+            return false;
+    }
+
+    return true;
+  }
+
+  // Same for a Sector or ConvexPolygon. Nodes are rejected against the shape itself,
+  // occupants against its bounds first and then against the shape.
+  template<class Shape, class Visitor> bool queryShape(const Shape &shape, const AABB &shapeBounds, Visitor &visitor) const
+  {
+    if(!shape.intersects(region))
+    {
+      LTBL_COUNT_QUERY(countQuery(1, 1, 0));
+
+      return true;
+    }
+
+    LTBL_COUNT_QUERY(countQuery(1, 1 + occupants.size(), 0));
+
+    for(unsigned int first = 0; first < occupants.size(); first += BoundsBatchSize)
+      for(unsigned int mask = occupants.boundsIntersectMask(first, shapeBounds); mask != 0; mask &= mask - 1)
+      {
+        unsigned int index = first + lowestBitIndex(mask);
+
+        if(shape.intersects(occupants.getBounds(index)))
+        {
+          LTBL_COUNT_QUERY(countQuery(0, 0, 1));
+
+          if(!visitor(occupants.getOccupant(index)))
+            return false;
+        }
+      }
+
+    if(hasChildren)
+    {
+      for(unsigned int x = 0; x < 2; x++)
+        for(unsigned int y = 0; y < 2; y++)
+          if(!children[x][y]->queryShape(shape, shapeBounds, visitor))
+            return false;
+    }
+
+    return true;
+  }
 
   void debugRender();
   
   friend class QuadTreeOccupant;
   friend class QuadTree;
+  friend class QuadTreeNodePool;
 };
 }
 
@@ -0,0 +1,35 @@
+#ifndef LTBL_QUAD_TREE_NODE_POOL_H
+#define LTBL_QUAD_TREE_NODE_POOL_H
+
+#include "QuadTreeNode.h"
+#include <vector>
+#include <memory>
+
+namespace qdt
+{
+// Number of 4-child blocks allocated at once when the pool runs dry
+const unsigned int NodeBlocksPerChunk = 64;
+
+// Hands out blocks of 4 contiguous nodes for partitions and recycles
+// them on merge, so a warmed up tree no longer touches the heap
+class QuadTreeNodePool {
+ private:
+  std::vector<std::unique_ptr<QuadTreeNode[]>> chunks;
+  std::vector<QuadTreeNode*> freeBlocks;
+
+  unsigned int numLiveBlocks;
+
+  void allocateChunk();
+
+ public:
+  QuadTreeNodePool();
+
+  QuadTreeNode* allocateBlock();
+  void releaseBlock(QuadTreeNode* pBlock);
+
+  unsigned int getNumLiveBlocks() const;
+  unsigned int getNumPooledBlocks() const;
+};
+}
+
+#endif
@@ -7,6 +7,10 @@ namespace qdt
 {
 class QuadTreeNode;
 class QuadTree;
+class QuadTreeOccupantList;
+class SpatialIndex;
+class DynamicAABBTree;
+class SpatialHashGrid;
 
 struct AABB {
   // Members
@@ -32,14 +36,28 @@ struct AABB {
   bool intersects(const AABB &other) const;
   bool contains(const AABB &other) const;
 
+  // Squared distance from point to the closest point of the box, 0 inside it
+  float distanceSquared(const Vec2f &point) const;
+
   // Render the AABB for debugging purposes
   void debugRender();
 };
 
 class QuadTreeOccupant {
  private:
+  // The index this occupant is in, if any
+  SpatialIndex* pSpatialIndex;
+
+  // Quad tree backend: the node and the index into its occupant list
   QuadTreeNode* pQuadTreeNode;
-  QuadTree* pQuadTree;
+  unsigned int nodeIndex;
+
+  // Dynamic AABB tree and hash grid backends: the leaf node or proxy
+  int proxyId;
+
+  // Waiting for SpatialIndex::commitUpdates, at dirtyIndex in the index's dirty list
+  bool dirty;
+  unsigned int dirtyIndex;
 
  public:
   AABB aabb;
@@ -49,11 +67,16 @@ class QuadTreeOccupant {
   virtual ~QuadTreeOccupant();
 
   // Call this whenever the AABB is modified or else stuff will break!
+  // If the index defers updates, this only queues the occupant for SpatialIndex::commitUpdates.
   void updateTreeStatus();
   void removeFromTree();
 
   friend class QuadTreeNode;
   friend class QuadTree;
+  friend class QuadTreeOccupantList;
+  friend class SpatialIndex;
+  friend class DynamicAABBTree;
+  friend class SpatialHashGrid;
 };
 }
 
@@ -0,0 +1,77 @@
+#ifndef LTBL_QUAD_TREE_OCCUPANT_LIST_H
+#define LTBL_QUAD_TREE_OCCUPANT_LIST_H
+
+#include "QuadTreeOccupant.h"
+#include "BoundsIntersect.h"
+#include <vector>
+
+namespace qdt
+{
+// Number of occupants a node stores without touching the heap
+const unsigned int InlineOccupants = 4;
+
+static_assert(InlineOccupants % 4 == 0, "intersectBounds reads the bounds in groups of 4");
+
+// Occupants of a node along with copies of their bounds, stored structure-of-arrays style
+// so that queries can test the bounds without dereferencing the occupants themselves.
+// Lists only grow past InlineOccupants when a node goes over MaximumOccupants, and keep
+// that storage when cleared so that recycled nodes don't allocate again.
+class QuadTreeOccupantList {
+ private:
+  unsigned int numOccupants;
+  unsigned int capacity;
+
+  QuadTreeOccupant** occupants;
+  float* lowerX;
+  float* lowerY;
+  float* upperX;
+  float* upperY;
+
+  QuadTreeOccupant* inlineOccupants[InlineOccupants];
+  alignas(16) float inlineBounds[4][InlineOccupants];
+
+  std::vector<QuadTreeOccupant*> spillOccupants;
+  std::vector<float> spillBounds;
+
+  void grow();
+
+  // Not copyable, the array pointers may point into the inline storage
+  QuadTreeOccupantList(const QuadTreeOccupantList &other);
+  QuadTreeOccupantList &operator=(const QuadTreeOccupantList &other);
+
+ public:
+  QuadTreeOccupantList();
+
+  unsigned int size() const { return numOccupants; }
+  bool empty() const { return numOccupants == 0; }
+
+  QuadTreeOccupant* getOccupant(unsigned int index) const { return occupants[index]; }
+  AABB getBounds(unsigned int index) const;
+  void setBounds(unsigned int index, const AABB &bounds);
+
+  bool boundsIntersect(unsigned int index, const AABB &region) const
+  {
+    return !(upperX[index] < region.lowerBound.x || upperY[index] < region.lowerBound.y ||
+             lowerX[index] > region.upperBound.x || lowerY[index] > region.upperBound.y);
+  }
+
+  // Mask of the occupants first to first + BoundsBatchSize - 1 whose bounds intersect region, bit 0 being first.
+  // The capacity is always a multiple of 4, so the SIMD kernel may read past the last occupant.
+  unsigned int boundsIntersectMask(unsigned int first, const AABB &region) const
+  {
+    unsigned int count = numOccupants - first < BoundsBatchSize ? numOccupants - first : BoundsBatchSize;
+
+    return intersectBounds(lowerX + first, lowerY + first, upperX + first, upperY + first, count, region);
+  }
+
+  // Stores the occupant's index in the list inside the occupant for O(1) removal
+  void add(QuadTreeOccupant* pOc, const AABB &bounds);
+
+  // Swap-and-pop, the last occupant takes over the removed index
+  void remove(unsigned int index);
+
+  void clear();
+};
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef LTBL_QUERY_SHAPES_H
+#define LTBL_QUERY_SHAPES_H
+
+#include "QuadTreeOccupant.h"
+
+namespace qdt
+{
+const unsigned int ConvexPolygonMaxVertices = 8;
+
+// Circular sector, such as the area lit by a spotlight, for SpatialIndex::querySector.
+// Angles are in radians, the sector spans directionAngle - spreadAngle / 2 to directionAngle + spreadAngle / 2.
+class Sector {
+ private:
+  Vec2f center;
+  float radius;
+  float margin;
+
+  // Outward normals of the two straight edges
+  Vec2f edgeNormal1;
+  Vec2f edgeNormal2;
+
+  // Spread of at least 2 pi, so just a circle
+  bool full;
+
+  // Spread of at most pi, so the wedge is the intersection of the edge half planes instead of their union
+  bool convex;
+
+  AABB bounds;
+
+ public:
+  // The margin grows the sector by that distance in every direction, for instance to account for the size of a light
+  Sector(const Vec2f &sectorCenter, float sectorRadius, float directionAngle, float spreadAngle, float sectorMargin = 0.0f);
+
+  const AABB &getAABB() const;
+
+  // Conservative, may report a box near the arc that just misses the sector, but never misses one that intersects it
+  bool intersects(const AABB &aabb) const;
+};
+
+// Line segment for SpatialIndex::visitSegment
+class Segment {
+ private:
+  Vec2f from;
+  Vec2f delta;
+
+  AABB bounds;
+
+ public:
+  Segment(const Vec2f &segmentFrom, const Vec2f &segmentTo);
+
+  const AABB &getAABB() const;
+
+  // Exact slab test
+  bool intersects(const AABB &aabb) const;
+};
+
+// Convex polygon in either winding order, for SpatialIndex::queryPolygon
+class ConvexPolygon {
+ private:
+  Vec2f vertices[ConvexPolygonMaxVertices];
+  unsigned int numVertices;
+
+  // 1 for counter-clockwise, -1 for clockwise
+  float winding;
+
+  AABB bounds;
+
+ public:
+  ConvexPolygon(const Vec2f* polygonVertices, unsigned int numPolygonVertices);
+
+  unsigned int getNumVertices() const;
+  const Vec2f &getVertex(unsigned int index) const;
+
+  const AABB &getAABB() const;
+
+  // Exact separating axis test
+  bool intersects(const AABB &aabb) const;
+};
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef LTBL_SHADOW_GEOMETRY_BUILDER_H
+#define LTBL_SHADOW_GEOMETRY_BUILDER_H
+
+#include "Light.h"
+#include "ConvexHull.h"
+#include "ShadowFin.h"
+#include <vector>
+
+namespace ltbl
+{
+const int maxFins = 2;
+
+struct ShadowVertex {
+  float x, y, z;
+
+  // Coordinates into the soft shadow texture, fins only
+  float u, v;
+};
+
+// Shadow triangles of one light, ready to be drawn as triangle lists
+struct ShadowGeometry {
+  // Masks the light in the depth buffer
+  std::vector<ShadowVertex> umbraVertices;
+
+  // Multiplies the light by the soft shadow texture
+  std::vector<ShadowVertex> finVertices;
+
+  // Keeps the storage, so that geometry reused across frames stops allocating
+  void clear();
+
+  bool empty() const;
+
+  void append(const ShadowGeometry &other);
+};
+
+// Computes the umbra and fins that hulls cast from a light on the CPU. Nothing here touches OpenGL,
+// LightSystem submits the finished geometry. A builder may keep scratch space, so use one per thread.
+class ShadowGeometryBuilder {
+ private:
+  // Edge classification of hulls too large for findSilhouette's stack mask
+  std::vector<unsigned int> edgeMaskScratch;
+
+  void addFin(const ShadowFin &fin, float depth, ShadowGeometry &geometry);
+
+  // Adds a fin along the hull edge next to the boundary when the penumbra of fin cuts into the hull.
+  // Returns the fin that the umbra should start from.
+  ShadowFin addExtraFins(const ConvexHull &hull, ShadowFin fin, const Light &light, int boundryIndex, bool wrapCW, float finDepth, ShadowGeometry &geometry);
+
+ public:
+  // Appends the umbra of the hull at umbraDepth and its fins at finDepth
+  void addHullShadow(const Light &light, const ConvexHull &hull, float umbraDepth, float finDepth, ShadowGeometry &geometry);
+};
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef LTBL_SHADOW_GEOMETRY_CACHE_H
+#define LTBL_SHADOW_GEOMETRY_CACHE_H
+
+#include "ShadowGeometryBuilder.h"
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <utility>
+
+namespace ltbl
+{
+// Default memory budget of the shadow geometry cache
+const unsigned int DefaultShadowCacheBudget = 8 * 1024 * 1024;
+
+// Shadow geometry of (light, hull) pairs, kept for as long as neither the light nor the hull changes
+// their transform version. The least recently used pairs are evicted once the budget is exceeded.
+class ShadowGeometryCache {
+ public:
+  struct Entry {
+    const Light* pLight;
+    const ConvexHull* pHull;
+
+    unsigned int lightVersion;
+    unsigned int hullVersion;
+
+    // False until the geometry is built for the versions above
+    bool upToDate;
+
+    ShadowGeometry geometry;
+
+    // Bytes counted against the budget at the last trim
+    unsigned int bytes;
+
+    // Frame of the last acquire call
+    unsigned int frame;
+
+    // The other entries of the same light and of the same hull, so that removing either only visits its own entries
+    Entry* pPreviousOfLight;
+    Entry* pNextOfLight;
+    Entry* pPreviousOfHull;
+    Entry* pNextOfHull;
+  };
+
+ private:
+  typedef std::pair<const Light*, const ConvexHull*> Key;
+
+  struct KeyHash {
+    std::size_t operator()(const Key &key) const;
+  };
+
+  // Most recently used first
+  std::list<Entry> entries;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> entryMap;
+
+  // First entry of each light and hull
+  std::unordered_map<const Light*, Entry*> lightEntries;
+  std::unordered_map<const ConvexHull*, Entry*> hullEntries;
+
+  std::vector<Entry*> acquiredEntries;
+
+  unsigned int budget;
+  unsigned int memoryUsage;
+
+  unsigned int frame;
+
+  unsigned int getEntryBytes(const Entry &entry) const;
+
+  void link(Entry* pEntry);
+  void unlink(Entry* pEntry);
+
+  void evict(std::list<Entry>::iterator it);
+
+ public:
+  ShadowGeometryCache();
+
+  // Starts a new frame, acquire hands each pair out at most once per frame
+  void beginFrame();
+
+  // Finds or creates the entry of the pair and marks it as most recently used. The entry is not up to date if it is new or
+  // either version changed, the caller then rebuilds the geometry and sets upToDate. Returns NULL if the pair was already acquired
+  // this frame, so that entries can be rebuilt on several threads without two threads sharing one.
+  // Entries stay valid until trim.
+  Entry* acquire(const Light* pLight, unsigned int lightVersion, const ConvexHull* pHull, unsigned int hullVersion);
+
+  // Counts the rebuilt geometry against the budget and evicts the least recently used entries until it fits
+  void trim();
+
+  // Drops the entries of a light or hull that is going away, taking time in proportion to their number
+  void removeLight(const Light* pLight);
+  void removeHull(const ConvexHull* pHull);
+
+  void clear();
+
+  // 0 disables the cache
+  void setBudget(unsigned int bytes);
+  unsigned int getBudget() const;
+
+  unsigned int getMemoryUsage() const;
+  unsigned int getNumEntries() const;
+};
+}
+
+#endif
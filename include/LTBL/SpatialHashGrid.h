@@ -0,0 +1,156 @@
+#ifndef LTBL_SPATIAL_HASH_GRID_H
+#define LTBL_SPATIAL_HASH_GRID_H
+
+#include "SpatialIndex.h"
+#include <vector>
+
+namespace qdt
+{
+const float DefaultGridCellSize = 64.0f;
+
+// Regions that would need more cells along an axis are covered by this many, the last row and column
+// then also take everything beyond them
+const int MaxGridCellsPerAxis = 4096;
+
+// Proxy indices per chunk, so that a chunk with its count and link fills 32 bytes
+const unsigned int GridChunkSize = 6;
+
+// Occupant as stored by the grid, cells refer to these by index
+struct SpatialHashGridProxy {
+  QuadTreeOccupant* pOccupant;
+
+  // Copy of the occupant AABB as of the last update
+  AABB aabb;
+
+  // Inclusive range of cells the occupant is registered in
+  Point2i lowerCell;
+  Point2i upperCell;
+};
+
+// Proxy indices of a cell, chunks of one cell are linked from the cell's head chunk
+struct SpatialHashGridChunk {
+  int proxyIds[GridChunkSize];
+  int numProxies;
+
+  // Next chunk of the cell or, for unused chunks, of the free list. -1 ends the list.
+  int next;
+};
+
+// Uniform grid over a fixed region. The cells are one flat array of head chunk indices into a single
+// chunk pool, so there is no heap block per cell and the short cells of an even spread take one chunk each.
+// Only the head chunk of a cell may be partly filled. Suited for many occupants of similar size
+// spread evenly, such as tile walls, where a tree only adds depth.
+// Occupants outside the region are clamped into the border cells.
+class SpatialHashGrid : public SpatialIndex {
+ private:
+  AABB region;
+
+  float cellSize;
+  int numCellsX;
+  int numCellsY;
+
+  // Head chunk per cell, row major, -1 for empty cells
+  std::vector<int> cellHeads;
+
+  std::vector<SpatialHashGridChunk> chunks;
+  int freeChunk;
+
+  std::vector<SpatialHashGridProxy> proxies;
+  std::vector<int> freeProxies;
+
+  unsigned int numOccupants;
+
+  void setRegion(const AABB &newRegion);
+
+  // Cell containing offset along an axis with numCells cells, clamped into the grid
+  int getCell(float offset, int numCells) const;
+  void getCellRange(const AABB &aabb, Point2i &lowerCell, Point2i &upperCell) const;
+
+  void addToCell(int cellIndex, int proxyId);
+  void removeFromCell(int cellIndex, int proxyId);
+
+  void insertProxy(int proxyId);
+  void removeProxy(int proxyId);
+
+  // Visits the occupants in the cells covered by shapeBounds whose bounds intersect the shape,
+  // which is an AABB, Sector or ConvexPolygon
+  template<class Shape, class Visitor> bool queryShape(const Shape &shape, const AABB &shapeBounds, Visitor &visitor) const
+  {
+    Point2i lowerCell;
+    Point2i upperCell;
+
+    getCellRange(shapeBounds, lowerCell, upperCell);
+
+    LTBL_COUNT_QUERY(queryCounters.add(1, 0, 0, 0));
+
+    for(int y = lowerCell.y; y <= upperCell.y; y++)
+      for(int x = lowerCell.x; x <= upperCell.x; x++)
+      {
+        LTBL_COUNT_QUERY(queryCounters.add(0, 1, 0, 0));
+
+        for(int chunkIndex = cellHeads[y * numCellsX + x]; chunkIndex != -1; chunkIndex = chunks[chunkIndex].next)
+        {
+          const SpatialHashGridChunk &chunk = chunks[chunkIndex];
+
+          for(int i = 0; i < chunk.numProxies; i++)
+          {
+            const SpatialHashGridProxy &proxy = proxies[chunk.proxyIds[i]];
+
+            // Skip occupants that were already seen in an earlier cell of the query
+            int firstX = proxy.lowerCell.x > lowerCell.x ? proxy.lowerCell.x : lowerCell.x;
+            int firstY = proxy.lowerCell.y > lowerCell.y ? proxy.lowerCell.y : lowerCell.y;
+
+            if(x != firstX || y != firstY)
+              continue;
+
+            bool hit = shape.intersects(proxy.aabb);
+
+            LTBL_COUNT_QUERY(queryCounters.add(0, 0, 1, hit ? 1 : 0));
+
+            if(hit && !visitor(proxy.pOccupant))
+              return false;
+          }
+        }
+      }
+
+    return true;
+  }
+
+ protected:
+  void applyUpdate(QuadTreeOccupant* pOc);
+  void removeOccupant(QuadTreeOccupant* pOc);
+
+  // Every occupant is at depth 0, cells count as nodes
+  void collectStats(SpatialIndexStats &stats) const;
+
+ public:
+  SpatialHashGrid(const AABB &startRegion, float gridCellSize = DefaultGridCellSize);
+
+  void addOccupant(QuadTreeOccupant* pOc);
+  void clearTree(const AABB &newStartRegion);
+
+  // Each occupant is reported once, by the first cell that both it and the query region cover
+  void query(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult) const;
+
+  // Calls visitor(pOc) for every occupant intersecting queryRegion until it returns false.
+  // Returns false if the visitor stopped the query.
+  template<class Visitor> bool query(const AABB &queryRegion, Visitor visitor) const
+  {
+    return queryShape(queryRegion, queryRegion, visitor);
+  }
+
+  bool visit(const AABB &queryRegion, QueryVisitor &visitor) const;
+
+  void querySector(const Sector &sector, std::vector<QuadTreeOccupant*> &queryResult) const;
+  void queryPolygon(const ConvexPolygon &polygon, std::vector<QuadTreeOccupant*> &queryResult) const;
+  bool visitSegment(const Segment &segment, QueryVisitor &visitor) const;
+
+  unsigned int getNumOccupants() const;
+
+  float getCellSize() const;
+
+  void debugRender();
+};
+}
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef LTBL_SPATIAL_INDEX_H
+#define LTBL_SPATIAL_INDEX_H
+
+#include "QuadTreeOccupant.h"
+#include "QueryShapes.h"
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+// Query counters cost an atomic add per node, so they are only compiled in on request
+#ifdef LTBL_QUERY_STATS
+#define LTBL_COUNT_QUERY(statement) statement
+#else
+#define LTBL_COUNT_QUERY(statement)
+#endif
+
+namespace qdt
+{
+enum SpatialIndexType
+{
+  SpatialIndexQuadTree, SpatialIndexLooseQuadTree, SpatialIndexDynamicAABBTree, SpatialIndexHashGrid
+};
+
+// Shape of an index and the work done by its queries, see SpatialIndex::getStats
+struct SpatialIndexStats {
+  // Nodes of the trees, cells of the hash grid
+  unsigned int numNodes;
+
+  // Depth 0 is the root, the average is taken over the occupants
+  unsigned int maxDepth;
+  float averageDepth;
+  std::vector<unsigned int> occupantsPerDepth;
+
+  // Occupants kept in non-leaf quad tree nodes, because they straddle the children or were added before the node split,
+  // or registered in more than one cell of the hash grid
+  unsigned int numStraddling;
+
+  // Occupants in the outside root list of a quad tree
+  unsigned int numOutsideRoot;
+
+  // Totals since the last resetQueryCounters, always zero unless built with LTBL_QUERY_STATS
+  unsigned long long numQueries;
+  unsigned long long nodesVisited;
+  unsigned long long boundsTests;
+  unsigned long long hits;
+
+  SpatialIndexStats();
+};
+
+// Running totals of the query work of an index. Queries may run concurrently, so they are atomic.
+struct QueryCounters {
+  std::atomic<unsigned long long> numQueries;
+  std::atomic<unsigned long long> nodesVisited;
+  std::atomic<unsigned long long> boundsTests;
+  std::atomic<unsigned long long> hits;
+
+  QueryCounters();
+
+  void add(unsigned int queries, unsigned int nodes, unsigned int tests, unsigned int numHits);
+  void reset();
+};
+
+// Callback for SpatialIndex::visit. The concrete indices also have a templated query
+// that takes any function object and can be inlined.
+class QueryVisitor {
+ public:
+  virtual ~QueryVisitor();
+
+  // Return false to stop the query
+  virtual bool visit(QuadTreeOccupant* pOc) = 0;
+};
+
+// Common interface of the structures that store QuadTreeOccupants.
+// Occupants keep a pointer to the index they are in, so updateTreeStatus and removeFromTree
+// work the same regardless of the backend.
+//
+// Concurrency: a frame alternates between sync points and read phases.
+// - During a read phase any number of threads may run the const queries at the same time.
+//   Queries only read the bound copies kept by the index, never the occupants' AABBs.
+// - While deferred updates are on, any thread may also modify occupant AABBs and call
+//   updateTreeStatus during a read phase, the dirty list is protected by a mutex.
+//   This only makes the move safe against the index queries, not against other readers of the
+//   occupant itself. ConvexHull::setWorldCenter for example writes the AABB, transformVersion and
+//   the world vertices, so a hull must not be moved while another thread builds its shadows.
+// - Everything else changes the structure and must only happen at a sync point, when no
+//   queries are running: adding and removing occupants, commitUpdates, clearTree, bulkLoad,
+//   setDeferredUpdates and updateTreeStatus without deferral.
+class SpatialIndex {
+ protected:
+  // Deferred update mode, see setDeferredUpdates
+  bool deferUpdates;
+  std::vector<QuadTreeOccupant*> dirtyOccupants;
+
+  // Guards dirtyOccupants and the dirty flags against concurrent updateTreeStatus calls
+  mutable std::mutex dirtyMutex;
+
+  // Filled by bulkLoad
+  std::vector<QuadTreeOccupant*> bulkOccupants;
+
+  // Only updated when built with LTBL_QUERY_STATS
+  mutable QueryCounters queryCounters;
+
+  void markDirty(QuadTreeOccupant* pOc);
+  void unmarkDirty(QuadTreeOccupant* pOc);
+  void clearDirtyOccupants();
+
+  void updateOccupant(QuadTreeOccupant* pOc);
+
+  // Moves an occupant whose AABB has changed
+  virtual void applyUpdate(QuadTreeOccupant* pOc) = 0;
+  virtual void removeOccupant(QuadTreeOccupant* pOc) = 0;
+
+  // Adds the contents of bulkOccupants, one by one unless the backend knows better
+  virtual void buildFromBulkOccupants();
+
+  // Fills in everything but the query counters
+  virtual void collectStats(SpatialIndexStats &stats) const = 0;
+
+ public:
+  SpatialIndex();
+  virtual ~SpatialIndex();
+
+  virtual void addOccupant(QuadTreeOccupant* pOc) = 0;
+  virtual void clearTree(const AABB &newStartRegion) = 0;
+
+  // When deferred, QuadTreeOccupant::updateTreeStatus only marks the occupant as dirty
+  // and commitUpdates() applies all pending updates in one batch. Turning deferral
+  // off commits whatever is still pending.
+  void setDeferredUpdates(bool defer);
+  bool getDeferredUpdates() const;
+
+  virtual void commitUpdates();
+
+  unsigned int getNumDirtyOccupants() const;
+
+  // Adds a range of occupant pointers at once. Quad trees size the root for all of them first and build every node once
+  // from the occupants in Morton order. That is not noticeably faster than adding the occupants one by one.
+  template<class Iterator> void bulkLoad(Iterator first, Iterator last)
+  {
+    bulkOccupants.clear();
+
+    for(; first != last; first++)
+      bulkOccupants.push_back(*first);
+
+    buildFromBulkOccupants();
+  }
+
+  // Appends the occupants intersecting queryRegion. Nothing is cleared, so a vector kept
+  // and cleared by the caller serves as a scratch buffer that stops allocating once warmed up.
+  virtual void query(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult) const = 0;
+
+  // Calls the visitor for every occupant intersecting queryRegion until it returns false.
+  // Returns false if the visitor stopped the query.
+  virtual bool visit(const AABB &queryRegion, QueryVisitor &visitor) const = 0;
+
+  // Append the occupants whose bounds intersect the shape, see Sector::intersects and ConvexPolygon::intersects.
+  // The trees reject whole subtrees against the shape itself rather than against its bounding box.
+  virtual void querySector(const Sector &sector, std::vector<QuadTreeOccupant*> &queryResult) const = 0;
+  virtual void queryPolygon(const ConvexPolygon &polygon, std::vector<QuadTreeOccupant*> &queryResult) const = 0;
+
+  // Calls the visitor for every occupant whose bounds the segment passes through, in no particular order.
+  // Returns false if the visitor stopped the query.
+  virtual bool visitSegment(const Segment &segment, QueryVisitor &visitor) const = 0;
+
+  virtual unsigned int getNumOccupants() const = 0;
+
+  // Walks the whole index, so this is meant for tuning rather than for every frame
+  SpatialIndexStats getStats() const;
+
+  // Safe to call during a read phase, since the counters are atomic
+  void resetQueryCounters() const;
+
+  virtual void debugRender() = 0;
+
+  friend class QuadTreeOccupant;
+};
+
+// Visitor that appends every occupant to a vector
+class QueryResultAppender {
+ private:
+  std::vector<QuadTreeOccupant*>* pQueryResult;
+
+ public:
+  QueryResultAppender(std::vector<QuadTreeOccupant*> &queryResult)
+  : pQueryResult(&queryResult)
+  {
+  }
+
+  bool operator()(QuadTreeOccupant* pOc)
+  {
+    pQueryResult->push_back(pOc);
+
+    return true;
+  }
+};
+
+// Adapts a QueryVisitor to the templated queries of the concrete indices
+class QueryVisitorAdapter {
+ private:
+  QueryVisitor* pVisitor;
+
+ public:
+  QueryVisitorAdapter(QueryVisitor &visitor)
+  : pVisitor(&visitor)
+  {
+  }
+
+  bool operator()(QuadTreeOccupant* pOc)
+  {
+    return pVisitor->visit(pOc);
+  }
+};
+
+// Creates an empty index of the given type covering startRegion. The dynamic AABB tree does not need a region,
+// the hash grid uses DefaultGridCellSize.
+SpatialIndex* createSpatialIndex(SpatialIndexType type, const AABB &startRegion);
+}
+
+#endif
@@ -1,6 +1,10 @@
 #include "LTBL/ConvexHull.h"
+#include "LTBL/LightSystem.h"
+#include "LTBL/BoundsIntersect.h"
 
 #include <assert.h>
+#include <math.h>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -8,11 +12,239 @@
 using namespace ltbl;
 using namespace qdt;
 
+namespace
+{
+// Hulls with fewer vertices are classified whole by findSilhouette, the SIMD loop is as fast as searching up to about here
+const unsigned int MinSilhouetteSearchVertices = 64;
+
+// Maximum number of edges classified by one classifyEdgeBatch call, one mask word
+const unsigned int EdgeBatchSize = 32;
+
+// The classification of one edge, which the vectorized paths repeat operation for operation.
+// The light is moved sideways by its size, away from the hull center, and the edge is back facing unless
+// its normal points towards that side of the light. This keeps the shadow from popping.
+inline bool edgeBackFacing(float firstX, float firstY, float secondX, float secondY, float normalX, float normalY,
+                           const Vec2f &hullCenter, const Vec2f &lightCenter, float lightSize)
+{
+  // Spelled out in floats so that the silhouette search does not pay for the out of line Vec2f operators
+  float middleX = (firstX + secondX) / 2.0f;
+  float middleY = (firstY + secondY) / 2.0f;
+
+  float lightNormalX = -(lightCenter.y - middleY);
+  float lightNormalY = lightCenter.x - middleX;
+
+  if((middleX - hullCenter.x) * lightNormalX + (middleY - hullCenter.y) * lightNormalY < 0)
+  {
+    lightNormalX = -lightNormalX;
+    lightNormalY = -lightNormalY;
+  }
+
+  float magnitude = sqrtf(lightNormalX * lightNormalX + lightNormalY * lightNormalY);
+
+  lightNormalX = lightNormalX / magnitude * lightSize;
+  lightNormalY = lightNormalY / magnitude * lightSize;
+
+  float toLightX = (lightCenter.x - lightNormalX) - middleX;
+  float toLightY = (lightCenter.y - lightNormalY) - middleY;
+
+  return !(normalX * toLightX + normalY * toLightY > 0);
+}
+
+// Classifies up to EdgeBatchSize edges with edgeBackFacing, setting bit i for back facing edge i.
+// The vectorized paths use the same operations in the same order, so every path gives the same mask.
+// The vertices are in world space. The vertex arrays must be readable up to count rounded up to a multiple of 4 plus one, the normal arrays up to count rounded up.
+unsigned int classifyEdgeBatch(const float* vertexX, const float* vertexY, const float* normalX, const float* normalY,
+                               unsigned int count, const Vec2f &hullCenter, const Vec2f &lightCenter, float lightSize)
+{
+  assert(count <= EdgeBatchSize);
+
+  unsigned int backFacing = 0;
+
+  unsigned int i = 0;
+
+#if defined(LTBL_SIMD_AVX) || defined(LTBL_SIMD_SSE2)
+  const unsigned int paddedCount = (count + 3) & ~3u;
+#endif
+
+#if defined(LTBL_SIMD_AVX)
+  {
+    const __m256 centerX = _mm256_set1_ps(hullCenter.x);
+    const __m256 centerY = _mm256_set1_ps(hullCenter.y);
+    const __m256 lCenterX = _mm256_set1_ps(lightCenter.x);
+    const __m256 lCenterY = _mm256_set1_ps(lightCenter.y);
+    const __m256 size = _mm256_set1_ps(lightSize);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+    for(; i + 8 <= paddedCount; i += 8)
+    {
+      __m256 middleX = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(vertexX + i), _mm256_loadu_ps(vertexX + i + 1)), half);
+      __m256 middleY = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(vertexY + i), _mm256_loadu_ps(vertexY + i + 1)), half);
+
+      __m256 lightNormalX = _mm256_xor_ps(_mm256_sub_ps(lCenterY, middleY), signBit);
+      __m256 lightNormalY = _mm256_sub_ps(lCenterX, middleX);
+
+      __m256 side = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(middleX, centerX), lightNormalX),
+                                  _mm256_mul_ps(_mm256_sub_ps(middleY, centerY), lightNormalY));
+
+      __m256 flip = _mm256_and_ps(_mm256_cmp_ps(side, zero, _CMP_LT_OQ), signBit);
+
+      lightNormalX = _mm256_xor_ps(lightNormalX, flip);
+      lightNormalY = _mm256_xor_ps(lightNormalY, flip);
+
+      __m256 magnitude = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(lightNormalX, lightNormalX), _mm256_mul_ps(lightNormalY, lightNormalY)));
+
+      lightNormalX = _mm256_mul_ps(_mm256_div_ps(lightNormalX, magnitude), size);
+      lightNormalY = _mm256_mul_ps(_mm256_div_ps(lightNormalY, magnitude), size);
+
+      __m256 toLightX = _mm256_sub_ps(_mm256_sub_ps(lCenterX, lightNormalX), middleX);
+      __m256 toLightY = _mm256_sub_ps(_mm256_sub_ps(lCenterY, lightNormalY), middleY);
+
+      __m256 facing = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(normalX + i), toLightX),
+                                    _mm256_mul_ps(_mm256_loadu_ps(normalY + i), toLightY));
+
+      // Not greater is true for NaN, like the negated scalar comparison
+      backFacing |= static_cast<unsigned int>(_mm256_movemask_ps(_mm256_cmp_ps(facing, zero, _CMP_NGT_UQ))) << i;
+    }
+  }
+#endif
+
+#if defined(LTBL_SIMD_SSE2)
+  {
+    const __m128 centerX = _mm_set1_ps(hullCenter.x);
+    const __m128 centerY = _mm_set1_ps(hullCenter.y);
+    const __m128 lCenterX = _mm_set1_ps(lightCenter.x);
+    const __m128 lCenterY = _mm_set1_ps(lightCenter.y);
+    const __m128 size = _mm_set1_ps(lightSize);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+
+    for(; i < paddedCount; i += 4)
+    {
+      __m128 middleX = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(vertexX + i), _mm_loadu_ps(vertexX + i + 1)), half);
+      __m128 middleY = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(vertexY + i), _mm_loadu_ps(vertexY + i + 1)), half);
+
+      __m128 lightNormalX = _mm_xor_ps(_mm_sub_ps(lCenterY, middleY), signBit);
+      __m128 lightNormalY = _mm_sub_ps(lCenterX, middleX);
+
+      __m128 side = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(middleX, centerX), lightNormalX),
+                               _mm_mul_ps(_mm_sub_ps(middleY, centerY), lightNormalY));
+
+      __m128 flip = _mm_and_ps(_mm_cmplt_ps(side, zero), signBit);
+
+      lightNormalX = _mm_xor_ps(lightNormalX, flip);
+      lightNormalY = _mm_xor_ps(lightNormalY, flip);
+
+      __m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(lightNormalX, lightNormalX), _mm_mul_ps(lightNormalY, lightNormalY)));
+
+      lightNormalX = _mm_mul_ps(_mm_div_ps(lightNormalX, magnitude), size);
+      lightNormalY = _mm_mul_ps(_mm_div_ps(lightNormalY, magnitude), size);
+
+      __m128 toLightX = _mm_sub_ps(_mm_sub_ps(lCenterX, lightNormalX), middleX);
+      __m128 toLightY = _mm_sub_ps(_mm_sub_ps(lCenterY, lightNormalY), middleY);
+
+      __m128 facing = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(normalX + i), toLightX),
+                                 _mm_mul_ps(_mm_loadu_ps(normalY + i), toLightY));
+
+      backFacing |= static_cast<unsigned int>(_mm_movemask_ps(_mm_cmpngt_ps(facing, zero))) << i;
+    }
+  }
+#endif
+
+  // Scalar fallback, also the AVX tail if SSE2 is somehow unavailable
+  for(; i < count; i++)
+    if(edgeBackFacing(vertexX[i], vertexY[i], vertexX[i + 1], vertexY[i + 1], normalX[i], normalY[i], hullCenter, lightCenter, lightSize))
+      backFacing |= 1u << i;
+
+  const unsigned int countMask = count == EdgeBatchSize ? ~0u : (1u << count) - 1;
+
+  return backFacing & countMask;
+}
+
+// Vertex i starts edge i and ends edge i - 1, so it is a boundary where the two differ.
+// Only one of each for a convex hull, but with several this keeps the last one met going from vertex 1 around to vertex 0.
+void findBoundries(const unsigned int* pBackFacing, unsigned int numVertices, int &firstBoundryIndex, int &secondBoundryIndex)
+{
+  const unsigned int numWords = (numVertices + EdgeBatchSize - 1) / EdgeBatchSize;
+
+  // Bit of the edge before edge 0, which wraps around to the last edge
+  unsigned int carry = (pBackFacing[(numVertices - 1) / EdgeBatchSize] >> ((numVertices - 1) % EdgeBatchSize)) & 1;
+
+  unsigned int lastEntering = 0, lastLeaving = 0;
+  int enteringWord = -1, leavingWord = -1;
+  bool enteringAtZero = false, leavingAtZero = false;
+
+  for(unsigned int w = 0; w < numWords; w++)
+  {
+    unsigned int current = pBackFacing[w];
+    unsigned int previous = (current << 1) | carry;
+
+    carry = current >> 31;
+
+    unsigned int validMask = w == numWords - 1 && numVertices % EdgeBatchSize != 0 ? (1u << (numVertices % EdgeBatchSize)) - 1 : ~0u;
+
+    unsigned int entering = previous & ~current & validMask;
+    unsigned int leaving = ~previous & current & validMask;
+
+    if(w == 0)
+    {
+      enteringAtZero = (entering & 1) != 0;
+      leavingAtZero = (leaving & 1) != 0;
+    }
+
+    if(entering != 0)
+    {
+      lastEntering = entering;
+      enteringWord = w;
+    }
+
+    if(leaving != 0)
+    {
+      lastLeaving = leaving;
+      leavingWord = w;
+    }
+  }
+
+  if(enteringAtZero || enteringWord == -1)
+    firstBoundryIndex = 0;
+  else
+    firstBoundryIndex = enteringWord * EdgeBatchSize + highestBitIndex(lastEntering);
+
+  if(leavingAtZero || leavingWord == -1)
+    secondBoundryIndex = 0;
+  else
+    secondBoundryIndex = leavingWord * EdgeBatchSize + highestBitIndex(lastLeaving);
+}
+
+// Increases with the angle of direction like atan2 does, from 0 along +x up to 4 just short of it, and is cheaper.
+// Zero for a zero direction.
+float getPseudoAngle(const Vec2f &direction)
+{
+  float x = direction.x;
+  float y = direction.y;
+
+  if(x == 0.0f && y == 0.0f)
+    return 0.0f;
+
+  if(y >= 0.0f)
+    return x >= 0.0f ? y / (x + y) : 1.0f - x / (y - x);
+
+  return x < 0.0f ? 2.0f - y / (-x - y) : 3.0f + x / (x - y);
+}
+}
+
 ConvexHull::ConvexHull() :
-    worldCenter(0.0f, 0.0f),
-    shadowDepthOffset(0.0f),
     aabbGenerated(false),
-    updateRequired(true) // Remains true permanently unless user purposely changes it
+    worldCenter(0.0f, 0.0f),
+    rotation(0.0f), scale(1.0f), rotationCos(1.0f), rotationSin(0.0f),
+    transformVersion(1),
+    worldVerticesValid(false),
+    pLightSystem(NULL), pairsDirty(false),
+    silhouetteSearch(false), counterClockwise(false),
+    updateRequired(false),
+    shadowDepthOffset(0.0f)
 {
 }
 
@@ -75,8 +307,83 @@ bool ConvexHull::loadShape(const char* fileName)
 
 Vec2f ConvexHull::getWorldVertex(unsigned int index) const
 {
-  assert(index >= 0 && index < vertices.size());
-  return Vec2f(vertices[index].position.x + worldCenter.x, vertices[index].position.y + worldCenter.y);
+  assert(worldVerticesValid && index < vertices.size());
+
+  return Vec2f(vertexX[index], vertexY[index]);
+}
+
+Vec2f ConvexHull::getWorldNormal(unsigned int index) const
+{
+  assert(worldVerticesValid && index < normals.size());
+
+  return Vec2f(normalX[index], normalY[index]);
+}
+
+void ConvexHull::updateWorldVertices()
+{
+  const unsigned int numVertices = vertices.size();
+
+  // The vertices changed and calculateNormals has yet to run, it rebuilds them then
+  if(normals.size() != numVertices)
+  {
+    worldVerticesValid = false;
+
+    return;
+  }
+
+  // Padding edges repeat the first vertex and have zero normals, their bits are masked off anyway
+  const unsigned int paddedSize = (numVertices + 3) & ~3u;
+
+  vertexX.resize(paddedSize + 1);
+  vertexY.resize(paddedSize + 1);
+  normalX.assign(paddedSize, 0.0f);
+  normalY.assign(paddedSize, 0.0f);
+
+  // Without rotation and scale the world vertices are the same sums as they always were
+  const bool translationOnly = rotation == 0.0f && scale == 1.0f;
+
+  for(unsigned int i = 0; i < numVertices; i++)
+  {
+    const Vec2f &position = vertices[i].position;
+
+    if(translationOnly)
+    {
+      vertexX[i] = position.x + worldCenter.x;
+      vertexY[i] = position.y + worldCenter.y;
+      normalX[i] = normals[i].x;
+      normalY[i] = normals[i].y;
+    }
+    else
+    {
+      vertexX[i] = (position.x * rotationCos - position.y * rotationSin) * scale + worldCenter.x;
+      vertexY[i] = (position.x * rotationSin + position.y * rotationCos) * scale + worldCenter.y;
+      normalX[i] = (normals[i].x * rotationCos - normals[i].y * rotationSin) * scale;
+      normalY[i] = (normals[i].x * rotationSin + normals[i].y * rotationCos) * scale;
+    }
+  }
+
+  for(unsigned int i = numVertices; i < paddedSize + 1; i++)
+  {
+    vertexX[i] = numVertices == 0 ? 0.0f : vertexX[0];
+    vertexY[i] = numVertices == 0 ? 0.0f : vertexY[0];
+  }
+
+  worldVerticesValid = true;
+}
+
+void ConvexHull::notifyLightSystem()
+{
+  if(pLightSystem != NULL)
+    pLightSystem->hullChanged(this);
+}
+
+void ConvexHull::invalidateTransform()
+{
+  updateWorldVertices();
+
+  transformVersion++;
+
+  notifyLightSystem();
 }
 
 void ConvexHull::calculateNormals()
@@ -97,6 +404,218 @@ void ConvexHull::calculateNormals()
     normals[i].x = -(vertices[index2].position.y - vertices[i].position.y);
     normals[i].y = vertices[index2].position.x - vertices[i].position.x;
   }
+
+  prepareSilhouetteSearch();
+
+  invalidateTransform();
+}
+
+void ConvexHull::prepareSilhouetteSearch()
+{
+  const unsigned int numVertices = vertices.size();
+
+  silhouetteSearch = false;
+  counterClockwise = false;
+
+  sortedAngles.clear();
+  sortedVertices.clear();
+
+  if(numVertices < 3)
+    return;
+
+  innerPoint = Vec2f(0.0f, 0.0f);
+
+  float doubleArea = 0.0f;
+
+  for(unsigned int i = 0; i < numVertices; i++)
+  {
+    innerPoint += vertices[i].position;
+    doubleArea += vertices[i].position.cross(vertices[Wrap(i + 1, numVertices)].position);
+  }
+
+  innerPoint /= static_cast<float>(numVertices);
+
+  // Also read by intersectSegment, so it is set even for hulls that can't be searched
+  counterClockwise = doubleArea > 0.0f;
+
+  if(doubleArea == 0.0f)
+    return;
+
+  // Walk the vertices in the direction of increasing angle, starting at the smallest
+  unsigned int start = 0;
+
+  for(unsigned int i = 1; i < numVertices; i++)
+    if(getPseudoAngle(vertices[i].position - innerPoint) < getPseudoAngle(vertices[start].position - innerPoint))
+      start = i;
+
+  sortedAngles.resize(numVertices);
+  sortedVertices.resize(numVertices);
+
+  for(unsigned int k = 0; k < numVertices; k++)
+  {
+    unsigned int vertex = counterClockwise ? (start + k) % numVertices : (start + numVertices - k) % numVertices;
+
+    sortedVertices[k] = vertex;
+    sortedAngles[k] = getPseudoAngle(vertices[vertex].position - innerPoint);
+
+    // Not convex, or not in order around the inner point
+    if(k > 0 && !(sortedAngles[k] > sortedAngles[k - 1]))
+    {
+      sortedAngles.clear();
+      sortedVertices.clear();
+
+      return;
+    }
+  }
+
+  // Every corner has to turn the same way as the hull winds
+  for(unsigned int i = 0; i < numVertices; i++)
+  {
+    Vec2f edge(vertices[Wrap(i + 1, numVertices)].position - vertices[i].position);
+    Vec2f nextEdge(vertices[Wrap(i + 2, numVertices)].position - vertices[Wrap(i + 1, numVertices)].position);
+
+    if(edge.cross(nextEdge) * doubleArea < 0.0f)
+    {
+      sortedAngles.clear();
+      sortedVertices.clear();
+
+      return;
+    }
+  }
+
+  silhouetteSearch = true;
+}
+
+unsigned int ConvexHull::getNumEdgeMaskWords() const
+{
+  return (vertices.size() + EdgeBatchSize - 1) / EdgeBatchSize;
+}
+
+void ConvexHull::classifyEdges(const Vec2f &lightCenter, float lightSize, unsigned int* pBackFacing) const
+{
+  const unsigned int numVertices = vertices.size();
+
+  assert(worldVerticesValid);
+
+  for(unsigned int first = 0; first < numVertices; first += EdgeBatchSize)
+  {
+    unsigned int count = numVertices - first < EdgeBatchSize ? numVertices - first : EdgeBatchSize;
+
+    pBackFacing[first / EdgeBatchSize] = classifyEdgeBatch(&vertexX[first], &vertexY[first], &normalX[first], &normalY[first],
+                                                           count, worldCenter, lightCenter, lightSize);
+  }
+}
+
+bool ConvexHull::isEdgeBackFacing(unsigned int edge, const Vec2f &lightCenter, float lightSize) const
+{
+  return edgeBackFacing(vertexX[edge], vertexY[edge], vertexX[edge + 1], vertexY[edge + 1], normalX[edge], normalY[edge],
+                        worldCenter, lightCenter, lightSize);
+}
+
+unsigned int ConvexHull::getEdgeInDirection(float angle) const
+{
+  const unsigned int numVertices = sortedAngles.size();
+
+  // The wedge from the last sorted vertex wraps around to the first
+  unsigned int lower = std::upper_bound(sortedAngles.begin(), sortedAngles.end(), angle) - sortedAngles.begin();
+  lower = lower == 0 ? numVertices - 1 : lower - 1;
+
+  unsigned int upper = lower + 1 == numVertices ? 0 : lower + 1;
+
+  // Counter-clockwise hulls list the wedge from its lower vertex, clockwise ones from its upper vertex
+  return counterClockwise ? sortedVertices[lower] : sortedVertices[upper];
+}
+
+void ConvexHull::findSilhouette(const Vec2f &lightCenter, float lightSize, std::vector<unsigned int> &edgeMaskScratch,
+                                int &firstBoundryIndex, int &secondBoundryIndex) const
+{
+  const unsigned int numVertices = vertices.size();
+
+  assert(numVertices > 0);
+
+  if(silhouetteSearch && numVertices >= MinSilhouetteSearchVertices)
+  {
+    assert(worldVerticesValid);
+
+    Vec2f toLight;
+
+    if(rotation == 0.0f && scale == 1.0f)
+      toLight = lightCenter - (innerPoint + worldCenter);
+    else
+    {
+      // The vertices were sorted in local space, so turn the direction back. The scale does not change angles.
+      Vec2f worldInnerPoint((innerPoint.x * rotationCos - innerPoint.y * rotationSin) * scale + worldCenter.x,
+                            (innerPoint.x * rotationSin + innerPoint.y * rotationCos) * scale + worldCenter.y);
+
+      Vec2f worldToLight(lightCenter - worldInnerPoint);
+
+      toLight = Vec2f(worldToLight.x * rotationCos + worldToLight.y * rotationSin, worldToLight.y * rotationCos - worldToLight.x * rotationSin);
+    }
+
+    // A ray from the inner point leaves the hull through an edge that sees the point light, the opposite ray through one that does not
+    unsigned int towardsEdge = getEdgeInDirection(getPseudoAngle(toLight));
+    unsigned int awayEdge = getEdgeInDirection(getPseudoAngle(-toLight));
+
+    // The normals point to the left, which is outwards only for clockwise hulls
+    unsigned int frontEdge = counterClockwise ? awayEdge : towardsEdge;
+    unsigned int backEdge = counterClockwise ? towardsEdge : awayEdge;
+
+    // The size of the light can change the classification of either, then they no longer bracket the boundaries
+    if(!isEdgeBackFacing(frontEdge, lightCenter, lightSize) && isEdgeBackFacing(backEdge, lightCenter, lightSize))
+    {
+      // Each way around from one to the other the classification changes exactly once, so it can be binary searched
+      unsigned int lower = 1;
+      unsigned int upper = (frontEdge + numVertices - backEdge) % numVertices;
+
+      while(lower < upper)
+      {
+        unsigned int middle = (lower + upper) / 2;
+
+        if(isEdgeBackFacing((backEdge + middle) % numVertices, lightCenter, lightSize))
+          lower = middle + 1;
+        else
+          upper = middle;
+      }
+
+      firstBoundryIndex = (backEdge + lower) % numVertices;
+
+      lower = 1;
+      upper = (backEdge + numVertices - frontEdge) % numVertices;
+
+      while(lower < upper)
+      {
+        unsigned int middle = (lower + upper) / 2;
+
+        if(isEdgeBackFacing((frontEdge + middle) % numVertices, lightCenter, lightSize))
+          upper = middle;
+        else
+          lower = middle + 1;
+      }
+
+      secondBoundryIndex = (frontEdge + lower) % numVertices;
+
+      return;
+    }
+  }
+
+  // Light inside the hull, or a hull that cannot be searched
+  const unsigned int numWords = getNumEdgeMaskWords();
+
+  unsigned int localMask[8];
+
+  unsigned int* pBackFacing = localMask;
+
+  if(numWords > 8)
+  {
+    if(edgeMaskScratch.size() < numWords)
+      edgeMaskScratch.resize(numWords);
+
+    pBackFacing = &edgeMaskScratch[0];
+  }
+
+  classifyEdges(lightCenter, lightSize, pBackFacing);
+
+  findBoundries(pBackFacing, numVertices, firstBoundryIndex, secondBoundryIndex);
 }
 
 void ConvexHull::renderHull(float depth)
@@ -118,27 +637,29 @@ void ConvexHull::generateAABB()
 {
   assert(vertices.size() > 0);
 
-  aabb.lowerBound = vertices[0].position;
+  aabb.lowerBound = getWorldVertex(0);
   aabb.upperBound = aabb.lowerBound;
 
   for(unsigned int i = 0; i < vertices.size(); i++)
   {
-    Vec2f* pPos = &vertices[i].position;
+    Vec2f pos(getWorldVertex(i));
 
-    if(pPos->x > aabb.upperBound.x)
-      aabb.upperBound.x = pPos->x;
+    if(pos.x > aabb.upperBound.x)
+      aabb.upperBound.x = pos.x;
 
-    if(pPos->y > aabb.upperBound.y)
-      aabb.upperBound.y = pPos->y;
+    if(pos.y > aabb.upperBound.y)
+      aabb.upperBound.y = pos.y;
 
-    if(pPos->x < aabb.lowerBound.x)
-      aabb.lowerBound.x = pPos->x;
+    if(pos.x < aabb.lowerBound.x)
+      aabb.lowerBound.x = pos.x;
 
-    if(pPos->y < aabb.lowerBound.y)
-      aabb.lowerBound.y = pPos->y;
+    if(pos.y < aabb.lowerBound.y)
+      aabb.lowerBound.y = pos.y;
   }
 
   aabbGenerated = true;
+
+  notifyLightSystem();
 }
 
 bool ConvexHull::hasGeneratedAABB()
@@ -148,9 +669,12 @@ bool ConvexHull::hasGeneratedAABB()
 
 void ConvexHull::setWorldCenter(const Vec2f &newCenter)
 {
+  // The vertex average need not be the center of the AABB, so move the AABB along instead of centering it
+  aabb.incCenter(newCenter - worldCenter);
+
   worldCenter = newCenter;
 
-  aabb.setCenter(worldCenter);
+  invalidateTransform();
 
   updateTreeStatus();
 }
@@ -161,6 +685,8 @@ void ConvexHull::incWorldCenter(const Vec2f &increment)
 
   aabb.incCenter(increment);
 
+  invalidateTransform();
+
   updateTreeStatus();
 }
 
@@ -169,6 +695,52 @@ Vec2f ConvexHull::getWorldCenter() const
   return worldCenter;
 }
 
+void ConvexHull::setRotation(float angle)
+{
+  rotation = angle;
+  rotationCos = cosf(angle);
+  rotationSin = sinf(angle);
+
+  invalidateTransform();
+
+  // Turning changes the extents, unlike moving
+  if(aabbGenerated)
+  {
+    generateAABB();
+    updateTreeStatus();
+  }
+}
+
+float ConvexHull::getRotation() const
+{
+  return rotation;
+}
+
+void ConvexHull::setScale(float newScale)
+{
+  assert(newScale > 0.0f);
+
+  scale = newScale;
+
+  invalidateTransform();
+
+  if(aabbGenerated)
+  {
+    generateAABB();
+    updateTreeStatus();
+  }
+}
+
+float ConvexHull::getScale() const
+{
+  return scale;
+}
+
+unsigned int ConvexHull::getTransformVersion() const
+{
+  return transformVersion;
+}
+
 bool ConvexHull::pointInsideHull(const Vec2f &point)
 {
   const unsigned int numVertices = vertices.size();
@@ -194,6 +766,66 @@ bool ConvexHull::pointInsideHull(const Vec2f &point)
   return true;
 }
 
+bool ConvexHull::intersectSegment(const Vec2f &from, const Vec2f &to, float &fraction, Vec2f &normal) const
+{
+  const unsigned int numVertices = vertices.size();
+
+  assert(normals.size() == numVertices);
+
+  // The normals point to the left of each edge, which is inwards for counter-clockwise hulls
+  float outwards = counterClockwise ? -1.0f : 1.0f;
+
+  Vec2f delta(to - from);
+
+  float enterFraction = 0.0f;
+  float exitFraction = 1.0f;
+  int enterEdge = -1;
+
+  for(unsigned int i = 0; i < numVertices; i++)
+  {
+    Vec2f edgeNormal(getWorldNormal(i) * outwards);
+
+    // How far outside of the edge the start lies, and how fast that changes along the segment
+    float distance = edgeNormal.dot(from - getWorldVertex(i));
+    float rate = edgeNormal.dot(delta);
+
+    if(rate == 0.0f)
+    {
+      // Parallel to the edge
+      if(distance > 0.0f)
+        return false;
+
+      continue;
+    }
+
+    float edgeFraction = -distance / rate;
+
+    if(rate < 0.0f)
+    {
+      // Entering
+      if(edgeFraction > enterFraction)
+      {
+        enterFraction = edgeFraction;
+        enterEdge = i;
+      }
+    }
+    else if(edgeFraction < exitFraction)
+      exitFraction = edgeFraction;
+
+    if(enterFraction > exitFraction)
+      return false;
+  }
+
+  fraction = enterFraction;
+
+  if(enterEdge == -1)
+    normal = Vec2f(0.0f, 0.0f);
+  else
+    normal = (getWorldNormal(enterEdge) * outwards).normalize();
+
+  return true;
+}
+
 float ltbl::getFloatVal(std::string strConvert)
 {
   return static_cast<float>(atof(strConvert.c_str()));
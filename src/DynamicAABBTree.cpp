@@ -0,0 +1,514 @@
+#include "LTBL/DynamicAABBTree.h"
+
+#include "LTBL/SFML_OpenGL.h"
+
+#include <assert.h>
+#include <algorithm>
+
+using namespace qdt;
+
+namespace
+{
+AABB combine(const AABB &first, const AABB &second)
+{
+  return AABB(Vec2f(std::min(first.lowerBound.x, second.lowerBound.x), std::min(first.lowerBound.y, second.lowerBound.y)),
+              Vec2f(std::max(first.upperBound.x, second.upperBound.x), std::max(first.upperBound.y, second.upperBound.y)));
+}
+
+// Surface area heuristic in 2D
+float perimeter(const AABB &aabb)
+{
+  Vec2f dims = aabb.getDims();
+
+  return 2.0f * (dims.x + dims.y);
+}
+}
+
+DynamicAABBTree::DynamicAABBTree(float fatMargin)
+: root(-1), freeList(-1), numOccupants(0), margin(fatMargin)
+{
+}
+
+DynamicAABBTree::~DynamicAABBTree()
+{
+}
+
+int DynamicAABBTree::allocateNode()
+{
+  if(freeList == -1)
+  {
+    // Grow the node array and thread the new nodes onto the free list
+    unsigned int oldCapacity = nodes.size();
+    unsigned int newCapacity = oldCapacity == 0 ? AABBTreeInitialCapacity : oldCapacity * 2;
+
+    nodes.resize(newCapacity);
+
+    for(unsigned int i = oldCapacity; i < newCapacity; i++)
+    {
+      nodes[i].parent = i + 1 < newCapacity ? static_cast<int>(i + 1) : -1;
+      nodes[i].height = -1;
+    }
+
+    freeList = oldCapacity;
+  }
+
+  int index = freeList;
+
+  DynamicAABBTreeNode &node = nodes[index];
+
+  freeList = node.parent;
+
+  node.pOccupant = NULL;
+  node.parent = -1;
+  node.child1 = -1;
+  node.child2 = -1;
+  node.height = 0;
+
+  return index;
+}
+
+void DynamicAABBTree::freeNode(int index)
+{
+  assert(nodes[index].height != -1);
+
+  nodes[index].parent = freeList;
+  nodes[index].height = -1;
+
+  freeList = index;
+}
+
+void DynamicAABBTree::addOccupant(QuadTreeOccupant* pOc)
+{
+  int leaf = allocateNode();
+
+  DynamicAABBTreeNode &node = nodes[leaf];
+
+  node.pOccupant = pOc;
+  node.occupantAABB = pOc->aabb;
+  node.aabb = AABB(pOc->aabb.lowerBound - Vec2f(margin, margin), pOc->aabb.upperBound + Vec2f(margin, margin));
+
+  pOc->pSpatialIndex = this;
+  pOc->pQuadTreeNode = NULL;
+  pOc->proxyId = leaf;
+
+  insertLeaf(leaf);
+
+  numOccupants++;
+}
+
+void DynamicAABBTree::applyUpdate(QuadTreeOccupant* pOc)
+{
+  int leaf = pOc->proxyId;
+
+  assert(leaf != -1 && nodes[leaf].pOccupant == pOc);
+
+  Vec2f displacement = pOc->aabb.getCenter() - nodes[leaf].occupantAABB.getCenter();
+
+  nodes[leaf].occupantAABB = pOc->aabb;
+
+  // Still inside the fattened AABB, so the tree does not change
+  if(nodes[leaf].aabb.contains(pOc->aabb))
+    return;
+
+  removeLeaf(leaf);
+
+  // Fatten by the margin and predict further movement in the same direction
+  AABB fatAABB(pOc->aabb.lowerBound - Vec2f(margin, margin), pOc->aabb.upperBound + Vec2f(margin, margin));
+
+  Vec2f prediction = displacement * AABBTreeDisplacementMultiplier;
+
+  if(prediction.x < 0.0f)
+    fatAABB.lowerBound.x += prediction.x;
+  else
+    fatAABB.upperBound.x += prediction.x;
+
+  if(prediction.y < 0.0f)
+    fatAABB.lowerBound.y += prediction.y;
+  else
+    fatAABB.upperBound.y += prediction.y;
+
+  nodes[leaf].aabb = fatAABB;
+
+  insertLeaf(leaf);
+}
+
+void DynamicAABBTree::removeOccupant(QuadTreeOccupant* pOc)
+{
+  int leaf = pOc->proxyId;
+
+  assert(leaf != -1 && nodes[leaf].pOccupant == pOc);
+
+  removeLeaf(leaf);
+  freeNode(leaf);
+
+  pOc->proxyId = -1;
+
+  numOccupants--;
+}
+
+void DynamicAABBTree::insertLeaf(int leaf)
+{
+  if(root == -1)
+  {
+    root = leaf;
+    nodes[root].parent = -1;
+
+    return;
+  }
+
+  // Find the best sibling by descending towards the cheapest child
+  AABB leafAABB = nodes[leaf].aabb;
+
+  int index = root;
+
+  while(!nodes[index].isLeaf())
+  {
+    int child1 = nodes[index].child1;
+    int child2 = nodes[index].child2;
+
+    float area = perimeter(nodes[index].aabb);
+    float combinedArea = perimeter(combine(nodes[index].aabb, leafAABB));
+
+    // Cost of creating a new parent for this node and the new leaf
+    float cost = 2.0f * combinedArea;
+
+    // Minimum cost of pushing the leaf further down the tree
+    float inheritanceCost = 2.0f * (combinedArea - area);
+
+    float cost1 = perimeter(combine(leafAABB, nodes[child1].aabb)) + inheritanceCost;
+
+    if(!nodes[child1].isLeaf())
+      cost1 -= perimeter(nodes[child1].aabb);
+
+    float cost2 = perimeter(combine(leafAABB, nodes[child2].aabb)) + inheritanceCost;
+
+    if(!nodes[child2].isLeaf())
+      cost2 -= perimeter(nodes[child2].aabb);
+
+    if(cost < cost1 && cost < cost2)
+      break;
+
+    index = cost1 < cost2 ? child1 : child2;
+  }
+
+  int sibling = index;
+
+  // Create a new parent for the sibling and the leaf. May reallocate the node array.
+  int oldParent = nodes[sibling].parent;
+  int newParent = allocateNode();
+
+  nodes[newParent].parent = oldParent;
+  nodes[newParent].aabb = combine(leafAABB, nodes[sibling].aabb);
+  nodes[newParent].height = nodes[sibling].height + 1;
+  nodes[newParent].child1 = sibling;
+  nodes[newParent].child2 = leaf;
+
+  if(oldParent != -1)
+  {
+    if(nodes[oldParent].child1 == sibling)
+      nodes[oldParent].child1 = newParent;
+    else
+      nodes[oldParent].child2 = newParent;
+  }
+  else
+    root = newParent;
+
+  nodes[sibling].parent = newParent;
+  nodes[leaf].parent = newParent;
+
+  refit(newParent);
+}
+
+void DynamicAABBTree::removeLeaf(int leaf)
+{
+  if(leaf == root)
+  {
+    root = -1;
+
+    return;
+  }
+
+  int parent = nodes[leaf].parent;
+  int grandParent = nodes[parent].parent;
+  int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+  // The sibling takes the place of the parent
+  if(grandParent != -1)
+  {
+    if(nodes[grandParent].child1 == parent)
+      nodes[grandParent].child1 = sibling;
+    else
+      nodes[grandParent].child2 = sibling;
+
+    nodes[sibling].parent = grandParent;
+
+    freeNode(parent);
+
+    refit(grandParent);
+  }
+  else
+  {
+    root = sibling;
+    nodes[sibling].parent = -1;
+
+    freeNode(parent);
+  }
+
+  nodes[leaf].parent = -1;
+}
+
+void DynamicAABBTree::refit(int index)
+{
+  while(index != -1)
+  {
+    index = balance(index);
+
+    DynamicAABBTreeNode &node = nodes[index];
+
+    node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+    node.aabb = combine(nodes[node.child1].aabb, nodes[node.child2].aabb);
+
+    index = node.parent;
+  }
+}
+
+int DynamicAABBTree::balance(int iA)
+{
+  DynamicAABBTreeNode* A = &nodes[iA];
+
+  if(A->isLeaf() || A->height < 2)
+    return iA;
+
+  int iB = A->child1;
+  int iC = A->child2;
+
+  DynamicAABBTreeNode* B = &nodes[iB];
+  DynamicAABBTreeNode* C = &nodes[iC];
+
+  int heightDifference = C->height - B->height;
+
+  // Rotate C up
+  if(heightDifference > 1)
+  {
+    int iF = C->child1;
+    int iG = C->child2;
+
+    DynamicAABBTreeNode* F = &nodes[iF];
+    DynamicAABBTreeNode* G = &nodes[iG];
+
+    // Swap A and C
+    C->child1 = iA;
+    C->parent = A->parent;
+    A->parent = iC;
+
+    if(C->parent != -1)
+    {
+      if(nodes[C->parent].child1 == iA)
+        nodes[C->parent].child1 = iC;
+      else
+        nodes[C->parent].child2 = iC;
+    }
+    else
+      root = iC;
+
+    // The taller grandchild stays with C
+    if(F->height > G->height)
+    {
+      C->child2 = iF;
+      A->child2 = iG;
+      G->parent = iA;
+
+      A->aabb = combine(B->aabb, G->aabb);
+      C->aabb = combine(A->aabb, F->aabb);
+
+      A->height = 1 + std::max(B->height, G->height);
+      C->height = 1 + std::max(A->height, F->height);
+    }
+    else
+    {
+      C->child2 = iG;
+      A->child2 = iF;
+      F->parent = iA;
+
+      A->aabb = combine(B->aabb, F->aabb);
+      C->aabb = combine(A->aabb, G->aabb);
+
+      A->height = 1 + std::max(B->height, F->height);
+      C->height = 1 + std::max(A->height, G->height);
+    }
+
+    return iC;
+  }
+
+  // Rotate B up
+  if(heightDifference < -1)
+  {
+    int iD = B->child1;
+    int iE = B->child2;
+
+    DynamicAABBTreeNode* D = &nodes[iD];
+    DynamicAABBTreeNode* E = &nodes[iE];
+
+    // Swap A and B
+    B->child1 = iA;
+    B->parent = A->parent;
+    A->parent = iB;
+
+    if(B->parent != -1)
+    {
+      if(nodes[B->parent].child1 == iA)
+        nodes[B->parent].child1 = iB;
+      else
+        nodes[B->parent].child2 = iB;
+    }
+    else
+      root = iB;
+
+    // The taller grandchild stays with B
+    if(D->height > E->height)
+    {
+      B->child2 = iD;
+      A->child1 = iE;
+      E->parent = iA;
+
+      A->aabb = combine(C->aabb, E->aabb);
+      B->aabb = combine(A->aabb, D->aabb);
+
+      A->height = 1 + std::max(C->height, E->height);
+      B->height = 1 + std::max(A->height, D->height);
+    }
+    else
+    {
+      B->child2 = iE;
+      A->child1 = iD;
+      D->parent = iA;
+
+      A->aabb = combine(C->aabb, D->aabb);
+      B->aabb = combine(A->aabb, E->aabb);
+
+      A->height = 1 + std::max(C->height, D->height);
+      B->height = 1 + std::max(A->height, E->height);
+    }
+
+    return iB;
+  }
+
+  return iA;
+}
+
+void DynamicAABBTree::clearTree(const AABB &/*newStartRegion*/)
+{
+  nodes.clear();
+
+  root = -1;
+  freeList = -1;
+  numOccupants = 0;
+
+  // Pending updates refer to the old tree
+  clearDirtyOccupants();
+}
+
+void DynamicAABBTree::query(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult) const
+{
+  query(queryRegion, QueryResultAppender(queryResult));
+}
+
+bool DynamicAABBTree::visit(const AABB &queryRegion, QueryVisitor &visitor) const
+{
+  return query(queryRegion, QueryVisitorAdapter(visitor));
+}
+
+void DynamicAABBTree::querySector(const Sector &sector, std::vector<QuadTreeOccupant*> &queryResult) const
+{
+  QueryResultAppender appender(queryResult);
+
+  LTBL_COUNT_QUERY(queryCounters.add(1, 0, 0, 0));
+
+  if(root != -1)
+    queryShape(root, sector, appender);
+}
+
+void DynamicAABBTree::queryPolygon(const ConvexPolygon &polygon, std::vector<QuadTreeOccupant*> &queryResult) const
+{
+  QueryResultAppender appender(queryResult);
+
+  LTBL_COUNT_QUERY(queryCounters.add(1, 0, 0, 0));
+
+  if(root != -1)
+    queryShape(root, polygon, appender);
+}
+
+bool DynamicAABBTree::visitSegment(const Segment &segment, QueryVisitor &visitor) const
+{
+  QueryVisitorAdapter adapter(visitor);
+
+  LTBL_COUNT_QUERY(queryCounters.add(1, 0, 0, 0));
+
+  return root == -1 || queryShape(root, segment, adapter);
+}
+
+unsigned int DynamicAABBTree::getNumOccupants() const
+{
+  return numOccupants;
+}
+
+void DynamicAABBTree::collectStats(SpatialIndexStats &stats) const
+{
+  if(root != -1)
+    collectStats(root, 0, stats);
+}
+
+void DynamicAABBTree::collectStats(int index, unsigned int depth, SpatialIndexStats &stats) const
+{
+  const DynamicAABBTreeNode &node = nodes[index];
+
+  stats.numNodes++;
+
+  if(depth > stats.maxDepth)
+    stats.maxDepth = depth;
+
+  if(node.isLeaf())
+  {
+    if(stats.occupantsPerDepth.size() <= depth)
+      stats.occupantsPerDepth.resize(depth + 1, 0);
+
+    stats.occupantsPerDepth[depth]++;
+
+    return;
+  }
+
+  collectStats(node.child1, depth + 1, stats);
+  collectStats(node.child2, depth + 1, stats);
+}
+
+int DynamicAABBTree::getHeight() const
+{
+  if(root == -1)
+    return -1;
+
+  return nodes[root].height;
+}
+
+void DynamicAABBTree::debugRender()
+{
+  for(unsigned int i = 0; i < nodes.size(); i++)
+  {
+    if(nodes[i].height == -1)
+      continue;
+
+    if(nodes[i].isLeaf())
+    {
+      glColor4f(0.3f, 0.5f, 0.5f, 1.0f);
+
+      nodes[i].occupantAABB.debugRender();
+    }
+    else
+    {
+      glColor4f(0.7f, 0.1f, 0.5f, 1.0f);
+
+      nodes[i].aabb.debugRender();
+    }
+  }
+
+  glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+}
@@ -0,0 +1,165 @@
+#include "LTBL/JobPool.h"
+
+#include <assert.h>
+
+using namespace ltbl;
+
+JobPool::JobPool(unsigned int numThreads)
+: pJob(NULL), batch(0), numBusyWorkers(0), quit(false)
+{
+  if(numThreads == 0)
+    numThreads = 1;
+
+  for(unsigned int i = 0; i < numThreads; i++)
+  {
+    queues.push_back(std::unique_ptr<JobQueue>(new JobQueue()));
+    queues.back()->first = 0;
+  }
+
+  for(unsigned int i = 1; i < numThreads; i++)
+    workers.push_back(std::thread(&JobPool::workerLoop, this, i));
+}
+
+JobPool::~JobPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(poolMutex);
+
+    quit = true;
+  }
+
+  startCondition.notify_all();
+
+  for(unsigned int i = 0; i < workers.size(); i++)
+    workers[i].join();
+}
+
+unsigned int JobPool::getNumThreads() const
+{
+  return queues.size();
+}
+
+bool JobPool::takeJob(unsigned int threadIndex, unsigned int &job)
+{
+  // Own queue first, from the back
+  {
+    JobQueue &queue = *queues[threadIndex];
+
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if(queue.jobs.size() > queue.first)
+    {
+      job = queue.jobs.back();
+      queue.jobs.pop_back();
+
+      return true;
+    }
+  }
+
+  // Then steal from the front of the others, starting with the next thread over
+  for(unsigned int offset = 1; offset < queues.size(); offset++)
+  {
+    JobQueue &queue = *queues[(threadIndex + offset) % queues.size()];
+
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if(queue.jobs.size() > queue.first)
+    {
+      job = queue.jobs[queue.first++];
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void JobPool::runJobs(unsigned int threadIndex)
+{
+  // No jobs are added during a batch, so once every queue is empty this thread is done
+  unsigned int job;
+
+  while(takeJob(threadIndex, job))
+    (*pJob)(job, threadIndex);
+}
+
+void JobPool::workerLoop(unsigned int threadIndex)
+{
+  unsigned int lastBatch = 0;
+
+  for(;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(poolMutex);
+
+      startCondition.wait(lock, [&]() { return quit || batch != lastBatch; });
+
+      if(quit)
+        return;
+
+      lastBatch = batch;
+    }
+
+    runJobs(threadIndex);
+
+    {
+      std::lock_guard<std::mutex> lock(poolMutex);
+
+      numBusyWorkers--;
+    }
+
+    doneCondition.notify_one();
+  }
+}
+
+void JobPool::run(unsigned int numJobs, const std::function<void(unsigned int, unsigned int)> &job)
+{
+  if(numJobs == 0)
+    return;
+
+  // Too few jobs to be worth waking anyone
+  if(workers.empty() || numJobs == 1)
+  {
+    for(unsigned int i = 0; i < numJobs; i++)
+      job(i, 0);
+
+    return;
+  }
+
+  pJob = &job;
+
+  // Contiguous shares, so that neighbouring jobs tend to run on the same thread
+  const unsigned int numThreads = queues.size();
+
+  for(unsigned int t = 0; t < numThreads; t++)
+  {
+    JobQueue &queue = *queues[t];
+
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    queue.jobs.clear();
+    queue.first = 0;
+
+    for(unsigned int i = numJobs * t / numThreads; i < numJobs * (t + 1) / numThreads; i++)
+      queue.jobs.push_back(i);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(poolMutex);
+
+    assert(numBusyWorkers == 0);
+
+    numBusyWorkers = workers.size();
+    batch++;
+  }
+
+  startCondition.notify_all();
+
+  runJobs(0);
+
+  std::unique_lock<std::mutex> lock(poolMutex);
+
+  doneCondition.wait(lock, [&]() { return numBusyWorkers == 0; });
+
+  pJob = NULL;
+}
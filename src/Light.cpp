@@ -1,8 +1,10 @@
 #include "LTBL/Light.h"
 
+#include "LTBL/LightSystem.h"
 #include "LTBL/ShadowFin.h"
 
 #include <assert.h>
+#include <math.h>
 
 using namespace ltbl;
 using namespace qdt;
@@ -14,8 +16,14 @@ Light::Light()
     color(1.0f, 1.0f, 1.0f),
     size(40.0f),
     directionAngle(0.0f), spreadAngle(2.0f * static_cast<float>(PI)), softSpreadAngle(static_cast<float>(PI) / 24.0f),
-    updateRequired(true), alwaysUpdate_(true), pStaticTexture(NULL) // For static light
+    updateRequired(true), alwaysUpdate_(true), pStaticTexture(NULL), // For static light
+    transformVersion(1), pLightSystem(NULL), pairsDirty(false), pairsFound(false), pairDirectionAngle(0.0f), pairSpreadAngle(0.0f), pairVersion(0), pairUpdate(0)
 {
+  // The public members are initialized after the private ones
+  versionCenter = center;
+  versionRadius = radius;
+  versionSize = size;
+
   aabb.setCenter(center);
   aabb.setDims(Vec2f(radius, radius));
 }
@@ -86,65 +94,96 @@ void Light::renderLightSoftPortion(float depth)
 
 void Light::calculateAABB()
 {
-  if(spreadAngle == 2 * PI)
-  {
-    Vec2f diff(radius, radius);
-    aabb.lowerBound = center - diff;
-    aabb.upperBound = center + diff;
-  }
-  else // Not a true frustum test, but puts the frustum in an aabb, better than nothing
-  {
-    aabb.lowerBound = center;
-    aabb.upperBound = center;
+  // The sector bounds follow the arc, so they cover directional lights of any spread. Sector also tells full circles apart
+  // in float, the default spreadAngle never equals 2 * PI as a double.
+  aabb = Sector(center, radius, directionAngle, spreadAngle).getAABB();
+}
+
+AABB* Light::getAABB()
+{
+  return &aabb;
+}
+
+bool Light::isDirectional() const
+{
+  return spreadAngle < 2.0f * static_cast<float>(PI);
+}
 
-    float halfSpread = spreadAngle / 2.0f;
-    float angle1 = directionAngle + halfSpread;
-    float angle2 = directionAngle - halfSpread;
+void Light::queryHulls(const SpatialIndex &hullIndex, std::vector<QuadTreeOccupant*> &hulls) const
+{
+  if(!isDirectional())
+    hullIndex.query(aabb, hulls);
+  else
+    hullIndex.querySector(Sector(center, radius, directionAngle, spreadAngle, size), hulls);
+}
 
-    Vec2f frustVec1 = Vec2f(cosf(angle1) * radius, sinf(angle1) * radius);
-    Vec2f frustVec2 = Vec2f(cosf(angle2) * radius, sinf(angle2) * radius);
+bool Light::affectsHull(const AABB &hullBounds) const
+{
+  if(!isDirectional())
+    return aabb.intersects(hullBounds);
 
-    float dist = (frustVec1 + (frustVec2 - frustVec1) / 2).magnitude();
+  return Sector(center, radius, directionAngle, spreadAngle, size).intersects(hullBounds);
+}
 
-    float lengthMultiplier = radius / dist;
+AABB Light::getHullQueryBounds() const
+{
+  if(!isDirectional())
+    return aabb;
 
-    frustVec1 *= lengthMultiplier;
-    frustVec2 *= lengthMultiplier;
+  return Sector(center, radius, directionAngle, spreadAngle, size).getAABB();
+}
 
-    Vec2f frustumPos1 = center + frustVec1;
-    Vec2f frustumPos2 = center + frustVec2;
+float Light::getIntensityAt(const Vec2f &point) const
+{
+  Vec2f offset = point - center;
 
-    // Expand lower bound
-    if(frustumPos1.x < aabb.lowerBound.x)
-      aabb.lowerBound.x = frustumPos1.x;
+  float distance = offset.magnitude();
 
-    if(frustumPos1.y < aabb.lowerBound.y)
-      aabb.lowerBound.y = frustumPos1.y;
+  if(distance >= radius)
+    return 0.0f;
 
-    if(frustumPos2.x < aabb.lowerBound.x)
-      aabb.lowerBound.x = frustumPos2.x;
+  if(isDirectional() && distance > 0.0f)
+  {
+    // Angle between the offset and the direction, wrapped to [-pi, pi]
+    float angle = fmodf(atan2f(offset.y, offset.x) - directionAngle, 2.0f * static_cast<float>(PI));
 
-    if(frustumPos2.y < aabb.lowerBound.y)
-      aabb.lowerBound.y = frustumPos2.y;
+    if(angle > static_cast<float>(PI))
+      angle -= 2.0f * static_cast<float>(PI);
+    else if(angle < -static_cast<float>(PI))
+      angle += 2.0f * static_cast<float>(PI);
 
-    // Expand upper bound
-    if(frustumPos1.x > aabb.upperBound.x)
-      aabb.upperBound.x = frustumPos1.x;
+    if(fabsf(angle) > spreadAngle / 2.0f)
+      return 0.0f;
+  }
 
-    if(frustumPos1.y > aabb.upperBound.y)
-      aabb.upperBound.y = frustumPos1.y;
+  return intensity * (1.0f - distance / radius);
+}
 
-    if(frustumPos2.x > aabb.upperBound.x)
-      aabb.upperBound.x = frustumPos2.x;
+unsigned int Light::updateTransformVersion()
+{
+  if(!(center == versionCenter) || radius != versionRadius || size != versionSize)
+  {
+    transformVersion++;
 
-    if(frustumPos2.y > aabb.upperBound.y)
-      aabb.upperBound.y = frustumPos2.y;
+    versionCenter = center;
+    versionRadius = radius;
+    versionSize = size;
   }
+
+  return transformVersion;
 }
 
-AABB* Light::getAABB()
+unsigned int Light::getTransformVersion() const
 {
-  return &aabb;
+  return transformVersion;
+}
+
+void Light::updateTreeStatus()
+{
+  QuadTreeOccupant::updateTreeStatus();
+
+  if(pLightSystem != NULL)
+    pLightSystem->lightChanged(this);
 }
 
 bool Light::alwaysUpdate()
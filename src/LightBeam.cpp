@@ -126,3 +126,51 @@ void LightBeam::calculateAABB()
   if(aabb.upperBound.y < outerPoint2.y)
     aabb.upperBound.y = outerPoint2.y;
 }
+
+bool LightBeam::isDirectional() const
+{
+  return true;
+}
+
+float LightBeam::getIntensityAt(const Vec2f &point) const
+{
+  Vec2f quad[4] = { innerPoint1, innerPoint2, outerPoint1, outerPoint2 };
+
+  if(!ConvexPolygon(quad, 4).intersects(AABB(point, point)))
+    return 0.0f;
+
+  // Distance from the inner edge, where the quad is brightest, to the point and to the outer edge
+  Vec2f direction(cosf(directionAngle), sinf(directionAngle));
+  Vec2f innerCenter((innerPoint1 + innerPoint2) / 2.0f);
+
+  float distance = (point - innerCenter).dot(direction);
+  float length = ((outerPoint1 + outerPoint2) / 2.0f - innerCenter).dot(direction);
+
+  if(length <= 0.0f || distance >= length)
+    return 0.0f;
+
+  if(distance <= 0.0f)
+    return intensity;
+
+  return intensity * (1.0f - distance / length);
+}
+
+void LightBeam::queryHulls(const SpatialIndex &hullIndex, std::vector<QuadTreeOccupant*> &hulls) const
+{
+  // Same order as the quad in renderLightSolidPortion
+  Vec2f quad[4] = { innerPoint1, innerPoint2, outerPoint1, outerPoint2 };
+
+  hullIndex.queryPolygon(ConvexPolygon(quad, 4), hulls);
+}
+
+bool LightBeam::affectsHull(const AABB &hullBounds) const
+{
+  Vec2f quad[4] = { innerPoint1, innerPoint2, outerPoint1, outerPoint2 };
+
+  return ConvexPolygon(quad, 4).intersects(hullBounds);
+}
+
+AABB LightBeam::getHullQueryBounds() const
+{
+  return aabb;
+}
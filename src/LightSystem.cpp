@@ -3,12 +3,114 @@
 #include "LTBL/ShadowFin.h"
 
 #include <assert.h>
+#include <algorithm>
 
 using namespace ltbl;
 using namespace qdt;
 
 const sf::Color clearColor(0, 0, 0, 0);
 
+namespace
+{
+// Keeps the nearest hull hit by a segment
+class RaycastVisitor : public QueryVisitor {
+ private:
+  Vec2f from;
+  Vec2f to;
+
+ public:
+  RaycastHit hit;
+
+  RaycastVisitor(const Vec2f &segmentFrom, const Vec2f &segmentTo)
+  : from(segmentFrom), to(segmentTo)
+  {
+  }
+
+  bool visit(QuadTreeOccupant* pOc)
+  {
+    ConvexHull* pHull = static_cast<ConvexHull*>(pOc);
+
+    float fraction;
+    Vec2f normal;
+
+    if(pHull->intersectSegment(from, to, fraction, normal) && (hit.pHull == NULL || fraction < hit.fraction))
+    {
+      hit.pHull = pHull;
+      hit.fraction = fraction;
+      hit.normal = normal;
+    }
+
+    // Nothing can be hit before the start
+    return hit.pHull == NULL || hit.fraction > 0.0f;
+  }
+};
+
+bool brighterThan(const LightContribution &first, const LightContribution &second)
+{
+  return first.intensity > second.intensity;
+}
+
+// Order does not matter in the pair lists, so the last element takes the place of the removed one
+template<class T> void removePaired(std::vector<T*> &paired, T* pValue)
+{
+  typename std::vector<T*>::iterator it = std::find(paired.begin(), paired.end(), pValue);
+
+  assert(it != paired.end());
+
+  *it = paired.back();
+  paired.pop_back();
+}
+
+// Keeps the k brightest lights at a point in a min heap, the dimmest of them at the root
+class LightRankingVisitor : public QueryVisitor {
+ private:
+  Vec2f point;
+  unsigned int k;
+
+  LightContribution* pResults;
+
+ public:
+  unsigned int numResults;
+
+  LightRankingVisitor(const Vec2f &rankingPoint, unsigned int numWanted, LightContribution* pRankedLights)
+  : point(rankingPoint), k(numWanted), pResults(pRankedLights), numResults(0)
+  {
+  }
+
+  bool visit(QuadTreeOccupant* pOc)
+  {
+    Light* pLight = static_cast<Light*>(pOc);
+
+    float intensity = pLight->getIntensityAt(point);
+
+    if(intensity <= 0.0f)
+      return true;
+
+    if(numResults == k)
+    {
+      if(intensity <= pResults[0].intensity)
+        return true;
+
+      std::pop_heap(pResults, pResults + numResults, brighterThan);
+      numResults--;
+    }
+
+    pResults[numResults].pLight = pLight;
+    pResults[numResults].intensity = intensity;
+    numResults++;
+
+    std::push_heap(pResults, pResults + numResults, brighterThan);
+
+    return true;
+  }
+};
+}
+
+RaycastHit::RaycastHit()
+: pHull(NULL), fraction(1.0f)
+{
+}
+
 EmissiveLight::EmissiveLight() : scale(1.0f, 1.0f)
 {
 }
@@ -80,8 +182,8 @@ void EmissiveLight::update()
 }
 
 LightSystem::LightSystem(const AABB &region, sf::RenderWindow* pRenderWindow)
-: ambientColor(0, 0, 0), checkForHullIntersect(true),
-    prebuildTimer(0), pWin(pRenderWindow)
+: pWin(pRenderWindow), shadowCacheHullCheck(true), lightQueryMargin(0.0f), pairUpdateCount(0), prebuildTimer(0),
+    ambientColor(0, 0, 0), checkForHullIntersect(true)
 {
   view.setCenter(sf::Vector2f(0.0f, 0.0f));
   view.setSize(sf::Vector2f(static_cast<float>(pRenderWindow->getSize().x), static_cast<float>(pRenderWindow->getSize().y)));
@@ -107,198 +209,39 @@ void LightSystem::cameraSetup()
   glTranslatef(-viewCenter.x, -viewCenter.y, 0.0f);
 }
 
-void LightSystem::maskShadow(Light* light, ConvexHull* convexHull, float depth)
+void LightSystem::submitShadowVertices(const std::vector<ShadowVertex> &vertices, bool textured)
 {
-  // ----------------------------- Determine the Shadow Boundaries -----------------------------
-
-  Vec2f lCenter = light->center;
-  float lRadius = light->radius;
-
-  Vec2f hCenter = convexHull->getWorldCenter();
+  if(vertices.empty())
+    return;
 
-  const int numVertices = convexHull->vertices.size();
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, sizeof(ShadowVertex), &vertices[0].x);
 
-  std::vector<bool> backFacing(numVertices);
-
-  for(int i = 0; i < numVertices; i++)
+  if(textured)
   {
-    Vec2f firstVertex(convexHull->getWorldVertex(i));
-    int secondIndex = (i + 1) % numVertices;
-    Vec2f secondVertex(convexHull->getWorldVertex(secondIndex));
-    Vec2f middle = (firstVertex + secondVertex) / 2.0f;
-
-    // Use normal to take light width into account, this eliminates popping
-    Vec2f lightNormal(-(lCenter.y - middle.y), lCenter.x - middle.x);
-
-    Vec2f centerToBoundry = middle - hCenter;
-
-    if(centerToBoundry.dot(lightNormal) < 0)
-      lightNormal *= -1;
-
-    lightNormal = lightNormal.normalize() * light->size;
-
-    Vec2f L = (lCenter - lightNormal) - middle;
-
-    if (convexHull->normals[i].dot(L) > 0)
-      backFacing[i] = false;
-    else
-      backFacing[i] = true;
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glTexCoordPointer(2, GL_FLOAT, sizeof(ShadowVertex), &vertices[0].u);
   }
 
-  int firstBoundryIndex = 0;
-  int secondBoundryIndex = 0;
-
-  for(int currentEdge = 0; currentEdge < numVertices; currentEdge++)
-  {
-    int nextEdge = (currentEdge + 1) % numVertices;
-
-    if (backFacing[currentEdge] && !backFacing[nextEdge])
-      firstBoundryIndex = nextEdge;
-
-    if (!backFacing[currentEdge] && backFacing[nextEdge])
-      secondBoundryIndex = nextEdge;
-  }
-
-  // -------------------------------- Shadow Fins --------------------------------
-
-  Vec2f firstBoundryPoint = convexHull->getWorldVertex(firstBoundryIndex);
-
-  Vec2f lightNormal(-(lCenter.y - firstBoundryPoint.y), lCenter.x - firstBoundryPoint.x);
-
-  Vec2f centerToBoundry = firstBoundryPoint - hCenter;
-
-  if(centerToBoundry.dot(lightNormal) < 0)
-    lightNormal *= -1;
-
-  lightNormal = lightNormal.normalize() * light->size;
-
-  ShadowFin firstFin;
-
-  firstFin.rootPos = firstBoundryPoint;
-  firstFin.umbra = firstBoundryPoint - (lCenter + lightNormal);
-  firstFin.umbra = firstFin.umbra.normalize() * lRadius;
-
-  firstFin.penumbra = firstBoundryPoint - (lCenter - lightNormal);
-  firstFin.penumbra = firstFin.penumbra.normalize() * lRadius;
-
-  ShadowFin secondFin;
-
-  Vec2f secondBoundryPoint = convexHull->getWorldVertex(secondBoundryIndex);
-
-  lightNormal = Vec2f(-(lCenter.y - secondBoundryPoint.y), lCenter.x - secondBoundryPoint.x);
-  centerToBoundry = secondBoundryPoint - hCenter;
-
-  if(centerToBoundry.dot(lightNormal) < 0)
-    lightNormal *= -1;
-
-  lightNormal = lightNormal.normalize() * light->size;
-
-  secondFin.rootPos = secondBoundryPoint;
-  secondFin.umbra = secondBoundryPoint - (lCenter + lightNormal);
-  secondFin.umbra = secondFin.umbra.normalize() * lRadius;
-
-  secondFin.penumbra = secondBoundryPoint - (lCenter - lightNormal);
-  secondFin.penumbra = secondFin.penumbra.normalize() * lRadius;
-
-  // Store generated fins to render later
-  finsToRender.push_back(firstFin);
-  finsToRender.push_back(secondFin);
-
-  Vec2f mainUmbraRoot1 = firstFin.rootPos;
-  Vec2f mainUmbraRoot2 = secondFin.rootPos;
-  Vec2f mainUmbraVec1 = firstFin.umbra;
-  Vec2f mainUmbraVec2 = secondFin.umbra;
-
-  addExtraFins(*convexHull, &firstFin, *light, mainUmbraVec1, mainUmbraRoot1, firstBoundryIndex, false);
-  addExtraFins(*convexHull, &secondFin, *light, mainUmbraVec2, mainUmbraRoot2, secondBoundryIndex, true);
-
-  // ----------------------------- Drawing the umbra -----------------------------
-
-  Vec2f vertex1 = convexHull->getWorldVertex(firstBoundryIndex);
-  Vec2f vertex2 = convexHull->getWorldVertex(secondBoundryIndex);
-
-  Vec2f throughCenter = (hCenter - lCenter).normalize() * lRadius;
-
-  // 3 rays is enough in most cases
-  glBegin(GL_TRIANGLE_STRIP);
-
-  glVertex3f(mainUmbraRoot1.x, mainUmbraRoot1.y, depth);
-  glVertex3f(mainUmbraRoot1.x + mainUmbraVec1.x, mainUmbraRoot1.y + mainUmbraVec1.y, depth);
-  glVertex3f(hCenter.x, hCenter.y, depth);
-  glVertex3f(hCenter.x + throughCenter.x, hCenter.y + throughCenter.y, depth);
-  glVertex3f(mainUmbraRoot2.x, mainUmbraRoot2.y, depth);
-  glVertex3f(mainUmbraRoot2.x + mainUmbraVec2.x, mainUmbraRoot2.y + mainUmbraVec2.y, depth);
-
-  glEnd();
-}
-
-void LightSystem::addExtraFins(const ConvexHull &hull, ShadowFin* fin, const Light &light, Vec2f &mainUmbra, Vec2f &mainUmbraRoot, int boundryIndex, bool wrapCW)
-{
-  Vec2f hCenter = hull.getWorldCenter();
-
-  int secondEdgeIndex;
-  int numVertices = static_cast<signed>(hull.vertices.size());
-
-  for(int i = 0; i < maxFins; i++)
-  {
-    if(wrapCW)
-      secondEdgeIndex = Wrap(boundryIndex - 1, numVertices);
-    else
-      secondEdgeIndex = Wrap(boundryIndex + 1, numVertices);
-
-    Vec2f edgeVec = Vec2f(hull.vertices[secondEdgeIndex].position - hull.vertices[boundryIndex].position).normalize();
-
-    Vec2f penNorm(fin->penumbra.normalize());
-
-    float angle1 = acosf(penNorm.dot(edgeVec) / (fin->penumbra.magnitude() * edgeVec.magnitude()));
-    float angle2 = acosf(penNorm.dot(fin->umbra) / (fin->penumbra.magnitude() * fin->umbra.magnitude()));
-
-    if(angle1 >= angle2)
-      break; // No intersection, break
-
-    // Change existing fin to attatch to side of hull
-    fin->umbra = edgeVec * light.radius;
-
-    // Add the extra fin
-    Vec2f secondBoundryPoint = hull.getWorldVertex(secondEdgeIndex);
-
-    Vec2f lightNormal(-(light.center.y - secondBoundryPoint.y), light.center.x - secondBoundryPoint.x);
-
-    Vec2f centerToBoundry = secondBoundryPoint - hCenter;
-
-    if(centerToBoundry.dot(lightNormal) < 0)
-      lightNormal *= -1;
-
-    lightNormal = lightNormal.normalize() * light.size;
-
-    ShadowFin newFin;
+  glDrawArrays(GL_TRIANGLES, 0, vertices.size());
 
-    newFin.rootPos = secondBoundryPoint;
-    newFin.umbra = secondBoundryPoint - (light.center + lightNormal);
-    newFin.umbra = newFin.umbra.normalize() * light.radius;
-    newFin.penumbra = edgeVec.normalize() * light.radius;
+  if(textured)
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
 
-    finsToRender.push_back(newFin);
-
-    fin = &finsToRender.back();
-
-    boundryIndex = secondEdgeIndex;
-
-    break;
-  }
-
-  // Change the main umbra to correspond to the last fin
-  mainUmbraRoot = fin->rootPos;
-  mainUmbra = fin->umbra;
+  glDisableClientState(GL_VERTEX_ARRAY);
 }
 
 void LightSystem::setUp(const AABB &region)
 {
+  treeRegion = region;
+
   // Create the quad trees
   lightTree.reset(new QuadTree(region));
   hullTree.reset(new QuadTree(region));
   emissiveTree.reset(new QuadTree(region));
 
+  setShadowThreadCount(1);
+
   sf::Vector2f viewSize(view.getSize());
   sf::Vector2u viewSizeui(static_cast<unsigned int>(viewSize.x), static_cast<unsigned int>(viewSize.y));
 
@@ -369,12 +312,14 @@ void LightSystem::addLight(Light* newLight)
 {
   newLight->pWin = pWin;
   lights.insert(newLight);
+  trackLight(newLight);
   lightTree->addOccupant(newLight);
 }
 
 void LightSystem::addConvexHull(ConvexHull* newConvexHull)
 {
   convexHulls.insert(newConvexHull);
+  trackHull(newConvexHull);
   hullTree->addOccupant(newConvexHull);
 }
 
@@ -392,6 +337,10 @@ void LightSystem::removeLight(Light* pLight)
 
   (*it)->removeFromTree();
 
+  detachLight(pLight);
+
+  shadowCache.removeLight(pLight);
+
   lights.erase(it);
 }
 
@@ -403,6 +352,10 @@ void LightSystem::removeConvexHull(ConvexHull* pHull)
 
   (*it)->removeFromTree();
 
+  detachHull(pHull);
+
+  shadowCache.removeHull(pHull);
+
   convexHulls.erase(it);
 }
 
@@ -425,8 +378,19 @@ void LightSystem::clearLights()
 
   lights.clear();
 
+  {
+    std::lock_guard<std::mutex> lock(movedLightMutex);
+
+    movedLights.clear();
+  }
+
+  for(std::unordered_set<ConvexHull*>::iterator it = convexHulls.begin(); it != convexHulls.end(); it++)
+    (*it)->pairedLights.clear();
+
+  shadowCache.clear();
+
   if(lightTree.get() != NULL)
-    lightTree->clearTree(AABB(Vec2f(-50.0f, -50.0f), Vec2f(-50.0f, -50.0f)));
+    lightTree->clearTree(treeRegion);
 }
 
 void LightSystem::clearConvexHulls()
@@ -437,8 +401,22 @@ void LightSystem::clearConvexHulls()
 
   convexHulls.clear();
 
+  {
+    std::lock_guard<std::mutex> lock(movedHullMutex);
+
+    movedHulls.clear();
+  }
+
+  for(std::unordered_set<Light*>::iterator it = lights.begin(); it != lights.end(); it++)
+  {
+    (*it)->pairedHulls.clear();
+    (*it)->updateRequired = true;
+  }
+
+  shadowCache.clear();
+
   if(hullTree.get() != NULL)
-    hullTree->clearTree(AABB(Vec2f(-50.0f, -50.0f), Vec2f(-50.0f, -50.0f)));
+    hullTree->clearTree(treeRegion);
 }
 
 void LightSystem::clearEmissiveLights()
@@ -450,11 +428,451 @@ void LightSystem::clearEmissiveLights()
   emissiveLights.clear();
 
   if(emissiveTree.get() != NULL)
-    emissiveTree->clearTree(AABB(Vec2f(-50.0f, -50.0f), Vec2f(-50.0f, -50.0f)));
+    emissiveTree->clearTree(treeRegion);
+}
+
+const SpatialIndex* LightSystem::getLightIndex() const
+{
+  return lightTree.get();
+}
+
+const SpatialIndex* LightSystem::getHullIndex() const
+{
+  return hullTree.get();
+}
+
+const SpatialIndex* LightSystem::getEmissiveIndex() const
+{
+  return emissiveTree.get();
+}
+
+RaycastHit LightSystem::raycast(const Vec2f &from, const Vec2f &to) const
+{
+  RaycastVisitor visitor(from, to);
+
+  hullTree->visitSegment(Segment(from, to), visitor);
+
+  visitor.hit.point = from + (to - from) * visitor.hit.fraction;
+
+  return visitor.hit;
+}
+
+void LightSystem::raycastMany(const RaycastSegment* pSegments, unsigned int numSegments, RaycastHit* pHits) const
+{
+  for(unsigned int i = 0; i < numSegments; i++)
+    pHits[i] = raycast(pSegments[i].from, pSegments[i].to);
+}
+
+unsigned int LightSystem::lightsAffecting(const Vec2f &point, unsigned int k, LightContribution* pResults) const
+{
+  if(k == 0)
+    return 0;
+
+  // Lights are found through their AABBs, the same bounds that cull them for rendering
+  LightRankingVisitor visitor(point, k, pResults);
+
+  lightTree->visit(AABB(point, point), visitor);
+
+  std::sort_heap(pResults, pResults + visitor.numResults, brighterThan);
+
+  return visitor.numResults;
+}
+
+SpatialIndexStats LightSystem::getLightIndexStats() const
+{
+  return lightTree->getStats();
+}
+
+SpatialIndexStats LightSystem::getHullIndexStats() const
+{
+  return hullTree->getStats();
+}
+
+SpatialIndexStats LightSystem::getEmissiveIndexStats() const
+{
+  return emissiveTree->getStats();
+}
+
+void LightSystem::resetIndexQueryCounters()
+{
+  lightTree->resetQueryCounters();
+  hullTree->resetQueryCounters();
+  emissiveTree->resetQueryCounters();
+}
+
+void LightSystem::setDeferredTreeUpdates(bool defer)
+{
+  lightTree->setDeferredUpdates(defer);
+  hullTree->setDeferredUpdates(defer);
+  emissiveTree->setDeferredUpdates(defer);
+}
+
+namespace
+{
+// Moves the given objects over to pNewIndex and makes it the current index
+template<class Occupant> void replaceIndex(std::unique_ptr<SpatialIndex> &pIndex, SpatialIndex* pNewIndex,
+                                           const std::unordered_set<Occupant*> &occupants)
+{
+  assert(pNewIndex != NULL);
+
+  bool defer = pIndex->getDeferredUpdates();
+
+  // Removing also drops pending updates, the new index sees the current AABBs anyway
+  for(typename std::unordered_set<Occupant*>::const_iterator it = occupants.begin(); it != occupants.end(); it++)
+    (*it)->removeFromTree();
+
+  pNewIndex->bulkLoad(occupants.begin(), occupants.end());
+  pNewIndex->setDeferredUpdates(defer);
+
+  pIndex.reset(pNewIndex);
+}
+}
+
+void LightSystem::setLightIndexType(SpatialIndexType type)
+{
+  setLightIndex(createSpatialIndex(type, treeRegion));
+}
+
+void LightSystem::setHullIndexType(SpatialIndexType type)
+{
+  setHullIndex(createSpatialIndex(type, treeRegion));
+}
+
+void LightSystem::setEmissiveIndexType(SpatialIndexType type)
+{
+  setEmissiveIndex(createSpatialIndex(type, treeRegion));
+}
+
+void LightSystem::setLightIndex(SpatialIndex* pIndex)
+{
+  replaceIndex(lightTree, pIndex, lights);
+}
+
+void LightSystem::setHullIndex(SpatialIndex* pIndex)
+{
+  replaceIndex(hullTree, pIndex, convexHulls);
+}
+
+void LightSystem::setEmissiveIndex(SpatialIndex* pIndex)
+{
+  replaceIndex(emissiveTree, pIndex, emissiveLights);
+}
+
+void LightSystem::setShadowThreadCount(unsigned int numThreads)
+{
+  if(numThreads == 0)
+    numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+  shadowJobPool.reset(new JobPool(numThreads));
+  shadowGeometryBuilders.resize(numThreads);
+}
+
+unsigned int LightSystem::getShadowThreadCount() const
+{
+  return shadowJobPool->getNumThreads();
+}
+
+void LightSystem::setShadowCacheBudget(unsigned int bytes)
+{
+  shadowCache.setBudget(bytes);
+
+  if(bytes == 0)
+    shadowCache.clear();
+}
+
+unsigned int LightSystem::getShadowCacheBudget() const
+{
+  return shadowCache.getBudget();
+}
+
+unsigned int LightSystem::getShadowCacheMemoryUsage() const
+{
+  return shadowCache.getMemoryUsage();
+}
+
+const std::vector<LightHullPairEvent> &LightSystem::getPairEvents() const
+{
+  return pairEvents;
+}
+
+void LightSystem::lightChanged(Light* pLight)
+{
+  std::lock_guard<std::mutex> lock(movedLightMutex);
+
+  if(!pLight->pairsDirty)
+  {
+    pLight->pairsDirty = true;
+    movedLights.push_back(pLight);
+  }
+}
+
+void LightSystem::trackLight(Light* pLight)
+{
+  pLight->pLightSystem = this;
+  pLight->pairsFound = false;
+
+  lightChanged(pLight);
+}
+
+void LightSystem::hullChanged(ConvexHull* pHull)
+{
+  std::lock_guard<std::mutex> lock(movedHullMutex);
+
+  if(!pHull->pairsDirty)
+  {
+    pHull->pairsDirty = true;
+    movedHulls.push_back(pHull);
+  }
+}
+
+void LightSystem::trackHull(ConvexHull* pHull)
+{
+  pHull->pLightSystem = this;
+
+  hullChanged(pHull);
+}
+
+void LightSystem::raisePairEvent(LightHullPairEvent::Type type, Light* pLight, ConvexHull* pHull)
+{
+  LightHullPairEvent event;
+
+  event.type = type;
+  event.pLight = pLight;
+  event.pHull = pHull;
+
+  pairEvents.push_back(event);
+
+  // Static lights only draw their shadows again when asked to
+  pLight->updateRequired = true;
+}
+
+void LightSystem::detachLight(Light* pLight)
+{
+  for(unsigned int i = 0; i < pLight->pairedHulls.size(); i++)
+    removePaired(pLight->pairedHulls[i]->pairedLights, pLight);
+
+  pLight->pairedHulls.clear();
+  pLight->pairsFound = false;
+
+  {
+    std::lock_guard<std::mutex> lock(movedLightMutex);
+
+    if(pLight->pairsDirty)
+    {
+      movedLights.erase(std::find(movedLights.begin(), movedLights.end(), pLight));
+      pLight->pairsDirty = false;
+    }
+
+    pLight->pLightSystem = NULL;
+  }
+}
+
+void LightSystem::detachHull(ConvexHull* pHull)
+{
+  for(unsigned int i = 0; i < pHull->pairedLights.size(); i++)
+  {
+    Light* pLight = pHull->pairedLights[i];
+
+    removePaired(pLight->pairedHulls, pHull);
+
+    // The shadow of the hull has to go
+    pLight->updateRequired = true;
+  }
+
+  pHull->pairedLights.clear();
+
+  {
+    std::lock_guard<std::mutex> lock(movedHullMutex);
+
+    if(pHull->pairsDirty)
+    {
+      movedHulls.erase(std::find(movedHulls.begin(), movedHulls.end(), pHull));
+      pHull->pairsDirty = false;
+    }
+
+    pHull->pLightSystem = NULL;
+  }
+}
+
+void LightSystem::updateLightPairs(Light* pLight)
+{
+  pairQueryResult.clear();
+  pLight->queryHulls(*hullTree, pairQueryResult);
+
+  // Both sets sorted, so that a single merge finds what changed
+  oldPairedHulls.assign(pLight->pairedHulls.begin(), pLight->pairedHulls.end());
+  std::sort(oldPairedHulls.begin(), oldPairedHulls.end());
+
+  pLight->pairedHulls.clear();
+
+  for(unsigned int i = 0; i < pairQueryResult.size(); i++)
+    pLight->pairedHulls.push_back(static_cast<ConvexHull*>(pairQueryResult[i]));
+
+  std::sort(pLight->pairedHulls.begin(), pLight->pairedHulls.end());
+
+  const std::vector<ConvexHull*> &newPairedHulls = pLight->pairedHulls;
+
+  unsigned int o = 0;
+  unsigned int n = 0;
+
+  while(o < oldPairedHulls.size() || n < newPairedHulls.size())
+  {
+    if(n == newPairedHulls.size() || (o < oldPairedHulls.size() && oldPairedHulls[o] < newPairedHulls[n]))
+    {
+      removePaired(oldPairedHulls[o]->pairedLights, pLight);
+      raisePairEvent(LightHullPairEvent::Removed, pLight, oldPairedHulls[o]);
+      o++;
+    }
+    else if(o == oldPairedHulls.size() || newPairedHulls[n] < oldPairedHulls[o])
+    {
+      newPairedHulls[n]->pairedLights.push_back(pLight);
+      raisePairEvent(LightHullPairEvent::Added, pLight, newPairedHulls[n]);
+      n++;
+    }
+    else
+    {
+      raisePairEvent(LightHullPairEvent::Moved, pLight, newPairedHulls[n]);
+      o++;
+      n++;
+    }
+  }
+
+  pLight->pairsFound = true;
+  pLight->pairAABB = pLight->aabb;
+  pLight->pairDirectionAngle = pLight->directionAngle;
+  pLight->pairSpreadAngle = pLight->spreadAngle;
+  pLight->pairVersion = pLight->getTransformVersion();
+  pLight->pairUpdate = pairUpdateCount;
+
+  // Keep the margin of the hull queries in updateHullPairs large enough for this light
+  AABB queryBounds(pLight->getHullQueryBounds());
+
+  lightQueryMargin = std::max(lightQueryMargin, std::max(pLight->aabb.lowerBound.x - queryBounds.lowerBound.x, pLight->aabb.lowerBound.y - queryBounds.lowerBound.y));
+  lightQueryMargin = std::max(lightQueryMargin, std::max(queryBounds.upperBound.x - pLight->aabb.upperBound.x, queryBounds.upperBound.y - pLight->aabb.upperBound.y));
+
+  // The light itself moved, even if it reaches no hulls
+  pLight->updateRequired = true;
+}
+
+void LightSystem::updateHullPairs(ConvexHull* pHull)
+{
+  // The bounds of directional lights do not cover their soft edges, so the query is grown by the most any light reaches past them
+  Vec2f margin(lightQueryMargin, lightQueryMargin);
+
+  pairQueryResult.clear();
+  lightTree->query(AABB(pHull->aabb.lowerBound - margin, pHull->aabb.upperBound + margin), pairQueryResult);
+
+  // Lights found again in this update already brought their pairs with the hull up to date
+  foundLights.clear();
+
+  for(unsigned int i = 0; i < pairQueryResult.size(); i++)
+  {
+    Light* pLight = static_cast<Light*>(pairQueryResult[i]);
+
+    if(pLight->pairUpdate != pairUpdateCount && pLight->affectsHull(pHull->aabb))
+      foundLights.push_back(pLight);
+  }
+
+  std::sort(foundLights.begin(), foundLights.end());
+
+  oldPairedLights.clear();
+
+  unsigned int numKept = 0;
+
+  for(unsigned int i = 0; i < pHull->pairedLights.size(); i++)
+  {
+    Light* pLight = pHull->pairedLights[i];
+
+    if(pLight->pairUpdate == pairUpdateCount)
+      pHull->pairedLights[numKept++] = pLight;
+    else
+      oldPairedLights.push_back(pLight);
+  }
+
+  pHull->pairedLights.resize(numKept);
+
+  std::sort(oldPairedLights.begin(), oldPairedLights.end());
+
+  unsigned int o = 0;
+  unsigned int n = 0;
+
+  while(o < oldPairedLights.size() || n < foundLights.size())
+  {
+    if(n == foundLights.size() || (o < oldPairedLights.size() && oldPairedLights[o] < foundLights[n]))
+    {
+      removePaired(oldPairedLights[o]->pairedHulls, pHull);
+      raisePairEvent(LightHullPairEvent::Removed, oldPairedLights[o], pHull);
+      o++;
+    }
+    else if(o == oldPairedLights.size() || foundLights[n] < oldPairedLights[o])
+    {
+      foundLights[n]->pairedHulls.push_back(pHull);
+      pHull->pairedLights.push_back(foundLights[n]);
+      raisePairEvent(LightHullPairEvent::Added, foundLights[n], pHull);
+      n++;
+    }
+    else
+    {
+      pHull->pairedLights.push_back(foundLights[n]);
+      raisePairEvent(LightHullPairEvent::Moved, foundLights[n], pHull);
+      o++;
+      n++;
+    }
+  }
+}
+
+void LightSystem::updatePairs()
+{
+  pairEvents.clear();
+
+  pairUpdateCount++;
+
+  {
+    std::lock_guard<std::mutex> lock(movedLightMutex);
+
+    lightPairsToUpdate.swap(movedLights);
+    movedLights.clear();
+
+    for(unsigned int i = 0; i < lightPairsToUpdate.size(); i++)
+      lightPairsToUpdate[i]->pairsDirty = false;
+  }
+
+  // Lights have public members and may report without changing, so they are compared with how they were
+  for(unsigned int i = 0; i < lightPairsToUpdate.size(); i++)
+  {
+    Light* pLight = lightPairsToUpdate[i];
+
+    const unsigned int version = pLight->updateTransformVersion();
+
+    if(!pLight->pairsFound || version != pLight->pairVersion ||
+       !(pLight->aabb.lowerBound == pLight->pairAABB.lowerBound) || !(pLight->aabb.upperBound == pLight->pairAABB.upperBound) ||
+       pLight->directionAngle != pLight->pairDirectionAngle || pLight->spreadAngle != pLight->pairSpreadAngle)
+      updateLightPairs(pLight);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(movedHullMutex);
+
+    hullsToUpdate.swap(movedHulls);
+    movedHulls.clear();
+
+    for(unsigned int i = 0; i < hullsToUpdate.size(); i++)
+      hullsToUpdate[i]->pairsDirty = false;
+  }
+
+  for(unsigned int i = 0; i < hullsToUpdate.size(); i++)
+    updateHullPairs(hullsToUpdate[i]);
 }
 
 void LightSystem::renderLights()
 {
+  // Apply any deferred tree updates before culling
+  lightTree->commitUpdates();
+  hullTree->commitUpdates();
+  emissiveTree->commitUpdates();
+
+  updatePairs();
+
   lightTemp.setActive();
   glLoadIdentity();
   cameraSetup();
@@ -476,7 +894,7 @@ void LightSystem::renderLights()
   AABB view(Vec2f(viewCenter.x, viewCenter.y),
             Vec2f(viewSize.x + viewCenter.x, viewSize.y + viewCenter.y));
 
-  std::vector<QuadTreeOccupant*> visibleLights;
+  visibleLights.clear();
   lightTree->query(view, visibleLights);
 
   // Add lights from pre build list if there are any
@@ -500,38 +918,147 @@ void LightSystem::renderLights()
 
   const unsigned int numVisibleLights = visibleLights.size();
 
+  // Find the hulls of every light and which lights need to be drawn again
+  lightHulls.clear();
+  lightHullOffsets.clear();
+  lightUpdates.clear();
+  lightsToUpdate.clear();
+
   for(unsigned int l = 0; l < numVisibleLights; l++)
   {
     Light* pLight = static_cast<Light*>(visibleLights[l]);
 
-    bool updateRequired = false;
-
-    if(pLight->alwaysUpdate())
-      updateRequired = true;
-    else if(pLight->updateRequired)
-      updateRequired = true;
+    // Static lights are flagged by updatePairs whenever one of their pairs changed
+    bool updateRequired = pLight->alwaysUpdate() || pLight->updateRequired;
 
     // Get hulls that the light affects
-    std::vector<QuadTreeOccupant*> regionHulls;
-    hullTree->query(*pLight->getAABB(), regionHulls);
+    lightHullOffsets.push_back(lightHulls.size());
 
-    const unsigned int numHulls = regionHulls.size();
+    lightHulls.insert(lightHulls.end(), pLight->pairedHulls.begin(), pLight->pairedHulls.end());
 
-    if(!updateRequired)
+    // Or by hulls that still set the deprecated ConvexHull::updateRequired
+    if(!pLight->alwaysUpdate())
     {
-      // See of any of the hulls need updating
-      for(unsigned int h = 0; h < numHulls; h++)
-      {
-        ConvexHull* pHull = static_cast<ConvexHull*>(regionHulls[h]);
-
-        if(pHull->updateRequired)
+      for(unsigned int h = 0; h < pLight->pairedHulls.size(); h++)
+        if(pLight->pairedHulls[h]->updateRequired)
         {
-          pHull->updateRequired = false;
+          flaggedHulls.push_back(pLight->pairedHulls[h]);
+
           updateRequired = true;
-          break;
         }
+    }
+
+    lightUpdates.push_back(updateRequired);
+
+    if(updateRequired)
+      lightsToUpdate.push_back(l);
+  }
+
+  lightHullOffsets.push_back(lightHulls.size());
+
+  for(unsigned int h = 0; h < flaggedHulls.size(); h++)
+    flaggedHulls[h]->updateRequired = false;
+
+  flaggedHulls.clear();
+
+  // Look up the cached shadows of the lights that need updating, which has to happen on this thread
+  if(checkForHullIntersect != shadowCacheHullCheck)
+  {
+    shadowCache.clear();
+    shadowCacheHullCheck = checkForHullIntersect;
+  }
+
+  const bool useShadowCache = shadowCache.getBudget() != 0;
+
+  lightHullEntries.assign(lightHulls.size(), NULL);
+
+  if(useShadowCache)
+  {
+    shadowCache.beginFrame();
+
+    for(unsigned int i = 0; i < lightsToUpdate.size(); i++)
+    {
+      const unsigned int l = lightsToUpdate[i];
+
+      Light* pLight = static_cast<Light*>(visibleLights[l]);
+
+      const unsigned int lightVersion = pLight->updateTransformVersion();
+
+      for(unsigned int h = lightHullOffsets[l]; h < lightHullOffsets[l + 1]; h++)
+      {
+        ConvexHull* pHull = static_cast<ConvexHull*>(lightHulls[h]);
+
+        lightHullEntries[h] = shadowCache.acquire(pLight, lightVersion, pHull, pHull->getTransformVersion());
       }
     }
+  }
+
+  // Build the shadows that are not cached, which only reads the lights and hulls
+  if(lightShadowGeometry.size() < numVisibleLights)
+    lightShadowGeometry.resize(numVisibleLights);
+
+  shadowJobPool->run(lightsToUpdate.size(), [this](unsigned int job, unsigned int threadIndex)
+  {
+    const unsigned int l = lightsToUpdate[job];
+
+    const Light &light = *static_cast<Light*>(visibleLights[l]);
+
+    ShadowGeometry &geometry = lightShadowGeometry[l];
+    ShadowGeometryBuilder &builder = shadowGeometryBuilders[threadIndex];
+
+    geometry.clear();
+
+    for(unsigned int h = lightHullOffsets[l]; h < lightHullOffsets[l + 1]; h++)
+    {
+      ConvexHull* pHull = static_cast<ConvexHull*>(lightHulls[h]);
+
+      // Each entry belongs to one pair, so no other thread touches it
+      ShadowGeometryCache::Entry* pEntry = lightHullEntries[h];
+
+      if(pEntry != NULL && pEntry->upToDate)
+      {
+        geometry.append(pEntry->geometry);
+
+        continue;
+      }
+
+      ShadowGeometry &hullGeometry = pEntry != NULL ? pEntry->geometry : geometry;
+
+      if(pEntry != NULL)
+      {
+        hullGeometry.clear();
+        pEntry->upToDate = true;
+      }
+
+      if(checkForHullIntersect)
+      {
+        Vec2f hullToLight(light.center - pHull->getWorldCenter());
+        hullToLight = hullToLight.normalize() * light.size;
+
+        if(pHull->pointInsideHull(light.center - hullToLight))
+          continue;
+      }
+
+      builder.addHullShadow(light, *pHull, 2.0f, 1.0f, hullGeometry);
+
+      if(pEntry != NULL)
+        geometry.append(hullGeometry);
+    }
+  });
+
+  // The entries were copied into lightShadowGeometry, so they may be evicted now
+  if(useShadowCache)
+    shadowCache.trim();
+
+  // Draw on this thread, the only one with the GL context
+  for(unsigned int l = 0; l < numVisibleLights; l++)
+  {
+    Light* pLight = static_cast<Light*>(visibleLights[l]);
+
+    const bool updateRequired = lightUpdates[l];
+
+    const unsigned int firstHull = lightHullOffsets[l];
+    const unsigned int lastHull = lightHullOffsets[l + 1];
 
     if(updateRequired)
     {
@@ -558,25 +1085,12 @@ void LightSystem::renderLights()
       // Disable color and alpha buffer writes temporarily for masking
       glColorMask(false, false, false, false);
 
-      if(checkForHullIntersect)
-        for(unsigned int h = 0; h < numHulls; h++)
-        {
-          ConvexHull* pHull = static_cast<ConvexHull*>(regionHulls[h]);
-
-          Vec2f hullToLight(pLight->center - pHull->getWorldCenter());
-          hullToLight = hullToLight.normalize() * pLight->size;
-
-          if(!pHull->pointInsideHull(pLight->center - hullToLight))
-            maskShadow(pLight, pHull, 2.0f);
-        }
-      else
-        for(unsigned int h = 0; h < numHulls; h++)
-          maskShadow(pLight, static_cast<ConvexHull*>(regionHulls[h]), 2.0f);
+      submitShadowVertices(lightShadowGeometry[l].umbraVertices, false);
 
       // Render the hulls only for the hulls that had
       // there shadows rendered earlier (not out of bounds)
-      for(unsigned int h = 0; h < numHulls; h++)
-        static_cast<ConvexHull*>(regionHulls[h])->renderHull(2.0f);
+      for(unsigned int h = firstHull; h < lastHull; h++)
+        static_cast<ConvexHull*>(lightHulls[h])->renderHull(2.0f);
 
       glBlendFunc(GL_ONE, GL_ONE);
 
@@ -594,10 +1108,7 @@ void LightSystem::renderLights()
 
       glBlendFunc(GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
 
-      const unsigned int numFins = finsToRender.size();
-
-      for(unsigned int f = 0; f < numFins; f++)
-        finsToRender[f].render(1.0f);
+      submitShadowVertices(lightShadowGeometry[l].finVertices, true);
 
       // Soft light angle fins
       pLight->renderLightSoftPortion(1.0f);
@@ -674,15 +1185,12 @@ void LightSystem::renderLights()
       glEnd();
     }
 
-    regionHulls.clear();
-    finsToRender.clear();
   }
 
   // Emissive lights
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-  std::vector<QuadTreeOccupant*> visibleEmissiveLights;
-
+  visibleEmissiveLights.clear();
   emissiveTree->query(view, visibleEmissiveLights);
 
   const unsigned int numEmissiveLights = visibleEmissiveLights.size();
@@ -0,0 +1,390 @@
+#include "LTBL/LinearQuadTree.h"
+
+#include "LTBL/Morton.h"
+
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+
+using namespace qdt;
+
+namespace
+{
+const char fileMagic[4] = { 'L', 'T', 'Q', 'T' };
+const unsigned int fileVersion = 1;
+
+struct FileHeader {
+  char magic[4];
+  unsigned int version;
+
+  float rootLowerX;
+  float rootLowerY;
+  float rootUpperX;
+  float rootUpperY;
+
+  unsigned int numNodes;
+  unsigned int numItems;
+};
+}
+
+LinearQuadTree::LinearQuadTree()
+{
+}
+
+AABB LinearQuadTree::getChildRegion(const AABB &region, unsigned int childIndex)
+{
+  Vec2f halfDims = region.getDims() / 2.0f;
+
+  Vec2f lowerBound(region.lowerBound.x + (childIndex & 1) * halfDims.x, region.lowerBound.y + (childIndex >> 1) * halfDims.y);
+
+  return AABB(lowerBound, lowerBound + halfDims);
+}
+
+float LinearQuadTree::getQuantizationScale(float lower, float upper)
+{
+  // A flat node quantizes everything to 0, which keeps the test conservative
+  return upper > lower ? 65535.0f / (upper - lower) : 0.0f;
+}
+
+unsigned short LinearQuadTree::quantizeLower(float value, float lower, float scale)
+{
+  float quantized = (value - lower) * scale;
+
+  if(quantized <= 0.0f)
+    return 0;
+
+  if(quantized >= 65535.0f)
+    return 65535;
+
+  return static_cast<unsigned short>(floorf(quantized));
+}
+
+unsigned short LinearQuadTree::quantizeUpper(float value, float lower, float scale)
+{
+  float quantized = (value - lower) * scale;
+
+  if(quantized <= 0.0f)
+    return 0;
+
+  if(quantized >= 65535.0f)
+    return 65535;
+
+  return static_cast<unsigned short>(ceilf(quantized));
+}
+
+void LinearQuadTree::build(const AABB* pBounds, unsigned int numBounds)
+{
+  clear();
+
+  if(numBounds == 0)
+    return;
+
+  rootRegion = pBounds[0];
+
+  for(unsigned int i = 1; i < numBounds; i++)
+  {
+    rootRegion.lowerBound.x = std::min(rootRegion.lowerBound.x, pBounds[i].lowerBound.x);
+    rootRegion.lowerBound.y = std::min(rootRegion.lowerBound.y, pBounds[i].lowerBound.y);
+    rootRegion.upperBound.x = std::max(rootRegion.upperBound.x, pBounds[i].upperBound.x);
+    rootRegion.upperBound.y = std::max(rootRegion.upperBound.y, pBounds[i].upperBound.y);
+  }
+
+  // Morton order of the centers, so that the items of every node end up in spatial order
+  std::vector<std::pair<unsigned int, unsigned int> > sortedIds(numBounds);
+
+  for(unsigned int i = 0; i < numBounds; i++)
+    sortedIds[i] = std::make_pair(mortonCode(pBounds[i].getCenter(), rootRegion), i);
+
+  std::sort(sortedIds.begin(), sortedIds.end());
+
+  std::vector<unsigned int> ids(numBounds);
+  std::vector<unsigned int> scratch(numBounds);
+
+  for(unsigned int i = 0; i < numBounds; i++)
+    ids[i] = sortedIds[i].second;
+
+  std::vector<AABB> nodeRegions(1, rootRegion);
+  std::vector<std::pair<unsigned int, unsigned int> > nodeItemRanges(1);
+
+  nodes.resize(1);
+
+  buildNode(0, rootRegion, 0, pBounds, ids, 0, numBounds, scratch, nodeRegions, nodeItemRanges);
+
+  // Pack the items in node order, relative to the region of their node
+  items.reserve(numBounds);
+
+  for(unsigned int nodeIndex = 0; nodeIndex < nodes.size(); nodeIndex++)
+  {
+    const AABB &region = nodeRegions[nodeIndex];
+
+    float scaleX = getQuantizationScale(region.lowerBound.x, region.upperBound.x);
+    float scaleY = getQuantizationScale(region.lowerBound.y, region.upperBound.y);
+
+    nodes[nodeIndex].firstItem = items.size();
+
+    unsigned int first = nodeItemRanges[nodeIndex].first;
+    unsigned int last = first + nodeItemRanges[nodeIndex].second;
+
+    for(unsigned int i = first; i < last; i++)
+    {
+      const AABB &bounds = pBounds[ids[i]];
+
+      LinearQuadTreeItem item;
+
+      item.lowerX = quantizeLower(bounds.lowerBound.x, region.lowerBound.x, scaleX);
+      item.lowerY = quantizeLower(bounds.lowerBound.y, region.lowerBound.y, scaleY);
+      item.upperX = quantizeUpper(bounds.upperBound.x, region.lowerBound.x, scaleX);
+      item.upperY = quantizeUpper(bounds.upperBound.y, region.lowerBound.y, scaleY);
+      item.id = ids[i];
+
+      items.push_back(item);
+    }
+  }
+
+  LinearQuadTreeNode end;
+
+  end.children = 0;
+  end.firstItem = items.size();
+
+  nodes.push_back(end);
+}
+
+void LinearQuadTree::buildNode(unsigned int nodeIndex, const AABB &region, unsigned int level, const AABB* pBounds,
+                               std::vector<unsigned int> &ids, unsigned int first, unsigned int last, std::vector<unsigned int> &scratch,
+                               std::vector<AABB> &nodeRegions, std::vector<std::pair<unsigned int, unsigned int> > &nodeItemRanges)
+{
+  nodes[nodeIndex].children = 0;
+
+  unsigned int numStaying = last - first;
+
+  if(numStaying > LinearMaximumOccupants && level < LinearMaxLevels)
+  {
+    AABB childRegions[4];
+
+    for(unsigned int childIndex = 0; childIndex < 4; childIndex++)
+      childRegions[childIndex] = getChildRegion(region, childIndex);
+
+    auto getGroup = [&](unsigned int id) -> unsigned int
+    {
+      unsigned int group = 0;
+
+      while(group < 4 && !childRegions[group].contains(pBounds[id]))
+        group++;
+
+      return group;
+    };
+
+    // Counting sort through the scratch space by the child that contains the bounds, the ones that fit none last.
+    // Each group stays in Morton order.
+    unsigned int groupSizes[5] = { 0, 0, 0, 0, 0 };
+
+    for(unsigned int i = first; i < last; i++)
+      groupSizes[getGroup(ids[i])]++;
+
+    unsigned int groupStarts[5];
+    unsigned int offset = first;
+
+    for(unsigned int group = 0; group < 5; group++)
+    {
+      groupStarts[group] = offset;
+      offset += groupSizes[group];
+    }
+
+    for(unsigned int i = first; i < last; i++)
+      scratch[groupStarts[getGroup(ids[i])]++] = ids[i];
+
+    std::copy(scratch.begin() + first, scratch.begin() + last, ids.begin() + first);
+
+    unsigned int childMask = 0;
+
+    for(unsigned int group = 0; group < 4; group++)
+      if(groupSizes[group] > 0)
+        childMask |= 1 << group;
+
+    if(childMask != 0)
+    {
+      unsigned int firstChild = nodes.size();
+
+      nodes[nodeIndex].children = firstChild << 4 | childMask;
+
+      nodes.resize(firstChild + bitCount(childMask));
+      nodeRegions.resize(nodes.size());
+      nodeItemRanges.resize(nodes.size());
+
+      unsigned int childIndex = firstChild;
+      unsigned int childFirst = first;
+
+      for(unsigned int group = 0; group < 4; group++)
+        if(groupSizes[group] > 0)
+        {
+          nodeRegions[childIndex] = childRegions[group];
+
+          buildNode(childIndex, childRegions[group], level + 1, pBounds, ids, childFirst, childFirst + groupSizes[group], scratch, nodeRegions, nodeItemRanges);
+
+          childIndex++;
+          childFirst += groupSizes[group];
+        }
+    }
+
+    numStaying = groupSizes[4];
+  }
+
+  // Whatever is left straddles the children and stays here
+  nodeItemRanges[nodeIndex] = std::make_pair(last - numStaying, numStaying);
+}
+
+void LinearQuadTree::clear()
+{
+  rootRegion = AABB();
+
+  nodes.clear();
+  items.clear();
+}
+
+bool LinearQuadTree::saveToFile(const std::string &fileName) const
+{
+  std::ofstream file(fileName.c_str(), std::ios::binary);
+
+  if(!file)
+    return false;
+
+  FileHeader header;
+
+  std::copy(fileMagic, fileMagic + 4, header.magic);
+  header.version = fileVersion;
+  header.rootLowerX = rootRegion.lowerBound.x;
+  header.rootLowerY = rootRegion.lowerBound.y;
+  header.rootUpperX = rootRegion.upperBound.x;
+  header.rootUpperY = rootRegion.upperBound.y;
+  header.numNodes = nodes.size();
+  header.numItems = items.size();
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  if(!nodes.empty())
+    file.write(reinterpret_cast<const char*>(&nodes[0]), nodes.size() * sizeof(LinearQuadTreeNode));
+
+  if(!items.empty())
+    file.write(reinterpret_cast<const char*>(&items[0]), items.size() * sizeof(LinearQuadTreeItem));
+
+  return file.good();
+}
+
+bool LinearQuadTree::loadFromFile(const std::string &fileName)
+{
+  clear();
+
+  std::ifstream file(fileName.c_str(), std::ios::binary);
+
+  if(!file)
+    return false;
+
+  FileHeader header;
+
+  if(!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+     !std::equal(fileMagic, fileMagic + 4, header.magic) || header.version != fileVersion)
+    return false;
+
+  // The counts must match the rest of the file before anything is allocated for them
+  std::streamoff dataStart = file.tellg();
+
+  file.seekg(0, std::ios::end);
+
+  std::streamoff dataSize = file.tellg() - dataStart;
+
+  file.seekg(dataStart);
+
+  if(!file || static_cast<unsigned long long>(dataSize) !=
+     header.numNodes * static_cast<unsigned long long>(sizeof(LinearQuadTreeNode)) + header.numItems * static_cast<unsigned long long>(sizeof(LinearQuadTreeItem)))
+    return false;
+
+  nodes.resize(header.numNodes);
+  items.resize(header.numItems);
+
+  if(!nodes.empty())
+    file.read(reinterpret_cast<char*>(&nodes[0]), nodes.size() * sizeof(LinearQuadTreeNode));
+
+  if(!items.empty())
+    file.read(reinterpret_cast<char*>(&items[0]), items.size() * sizeof(LinearQuadTreeItem));
+
+  if(!file || !isStructureValid())
+  {
+    clear();
+
+    return false;
+  }
+
+  rootRegion = AABB(Vec2f(header.rootLowerX, header.rootLowerY), Vec2f(header.rootUpperX, header.rootUpperY));
+
+  return true;
+}
+
+bool LinearQuadTree::isStructureValid() const
+{
+  if(nodes.empty())
+    return items.empty();
+
+  // A tree has the root and the end marker, whose item offset is the item count
+  if(nodes.size() == 1 || nodes.front().firstItem != 0 || nodes.back().firstItem != items.size())
+    return false;
+
+  unsigned int numRealNodes = nodes.size() - 1;
+
+  // Depth of every node, parents come before their children so it is known when a node is reached
+  std::vector<unsigned int> depths(numRealNodes, 0);
+
+  for(unsigned int i = 0; i < numRealNodes; i++)
+  {
+    // Item ranges must not run backwards
+    if(nodes[i].firstItem > nodes[i + 1].firstItem)
+      return false;
+
+    unsigned int childMask = nodes[i].children & 0xf;
+
+    if(childMask == 0)
+      continue;
+
+    unsigned int firstChild = nodes[i].children >> 4;
+    unsigned int numChildren = bitCount(childMask);
+
+    // Children after their parent keeps queries from looping, and they must not reach the end marker
+    if(firstChild <= i || firstChild + numChildren > numRealNodes)
+      return false;
+
+    // Queries recurse per level, so the depth is bounded like in build
+    if(depths[i] >= LinearMaxLevels)
+      return false;
+
+    for(unsigned int c = 0; c < numChildren; c++)
+      depths[firstChild + c] = std::max(depths[firstChild + c], depths[i] + 1);
+  }
+
+  return true;
+}
+
+void LinearQuadTree::query(const AABB &queryRegion, std::vector<unsigned int> &queryResult) const
+{
+  query(queryRegion, [&](unsigned int id) { queryResult.push_back(id); return true; });
+}
+
+AABB LinearQuadTree::getRootAABB() const
+{
+  return rootRegion;
+}
+
+unsigned int LinearQuadTree::getNumNodes() const
+{
+  // Not counting the end marker
+  return nodes.empty() ? 0 : nodes.size() - 1;
+}
+
+unsigned int LinearQuadTree::getNumItems() const
+{
+  return items.size();
+}
+
+unsigned int LinearQuadTree::getMemoryUsage() const
+{
+  return nodes.size() * sizeof(LinearQuadTreeNode) + items.size() * sizeof(LinearQuadTreeItem);
+}
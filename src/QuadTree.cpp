@@ -1,12 +1,25 @@
 #include "LTBL/QuadTree.h"
 
+#include "LTBL/Morton.h"
+
 #include "LTBL/SFML_OpenGL.h"
 
+#include <assert.h>
+#include <algorithm>
+
 using namespace qdt;
 
-QuadTree::QuadTree(const AABB &startRegion)
+QuadTree::QuadTree(const AABB &startRegion, bool loose)
+: looseTree(loose), rootGrowth(true)
 {
-  rootNode = new QuadTreeNode(startRegion, 1, NULL, this);
+  rootCell = startRegion;
+
+  AABB rootRegion(startRegion);
+
+  if(looseTree)
+    rootRegion.setDims(rootRegion.getDims() * LooseMultiplier);
+
+  rootNode = new QuadTreeNode(rootRegion, 1, NULL, this);
 }
 
 QuadTree::~QuadTree()
@@ -15,69 +28,734 @@ QuadTree::~QuadTree()
 }
 
 void QuadTree::addOccupant(QuadTreeOccupant* pOc)
+{
+  insertOccupant(pOc);
+
+  growRootIfNeeded();
+}
+
+void QuadTree::insertOccupant(QuadTreeOccupant* pOc)
 {
   if(rootNode->region.contains(pOc->aabb)) // If it fits inside the root node
     rootNode->addOccupant(pOc);
-  else // Otherwise, add it to the outside root set
+  else // Otherwise, add it to the outside root list
   {
-    outsideRoot.insert(pOc);
+    outsideRoot.add(pOc, pOc->aabb);
 
     // Set the pointers properly
     pOc->pQuadTreeNode = NULL; // Not required unless removing a node and then adding it again
-    pOc->pQuadTree = this;
+    pOc->pSpatialIndex = this;
   }
 }
 
 void QuadTree::clearTree(const AABB &newStartRegion)
 {
   delete rootNode;
-  rootNode = new QuadTreeNode(newStartRegion, 1, NULL, this);
+
+  rootCell = newStartRegion;
+
+  AABB rootRegion(newStartRegion);
+
+  if(looseTree)
+    rootRegion.setDims(rootRegion.getDims() * LooseMultiplier);
+
+  rootNode = new QuadTreeNode(rootRegion, 1, NULL, this);
 
   // Clear ouside root
   outsideRoot.clear();
+
+  // Pending updates refer to the old tree
+  clearDirtyOccupants();
+}
+
+void QuadTree::applyUpdate(QuadTreeOccupant* pOc)
+{
+  if(pOc->pQuadTreeNode == NULL)
+  {
+    // In the outside root list, so see if it fits in the root partition now that the AABB has been changed.
+    if(rootNode->region.contains(pOc->aabb))
+    {
+      // Fits, remove it from the outside root list and add it to the root
+      outsideRoot.remove(pOc->nodeIndex);
+
+      rootNode->addOccupant(pOc);
+    }
+    else
+    {
+      outsideRoot.setBounds(pOc->nodeIndex, pOc->aabb);
+
+      growRootIfNeeded();
+    }
+  }
+  else
+  {
+    assert(pOc->pQuadTreeNode->numOccupants >= 1);
+
+    // Most moves in a loose tree keep the occupant in its node, which then only needs the new bounds
+    if(looseTree && pOc->pQuadTreeNode->keepsLooseOccupant(pOc))
+    {
+      pOc->pQuadTreeNode->occupants.setBounds(pOc->nodeIndex, pOc->aabb);
+
+      return;
+    }
+
+    // First remove the occupant from the set (may be re-added later, this is not highly
+    // optimized, but we use this method for simplicity's sake)
+    pOc->pQuadTreeNode->occupants.remove(pOc->nodeIndex);
+
+    // See of the occupant still fits
+    if(pOc->pQuadTreeNode->region.contains(pOc->aabb))
+    {
+      // Re-add to possibly settle into a new position lower in the tree
+
+      // AddOccupant will raise this number to indicate more occupants than there actually are
+      pOc->pQuadTreeNode->numOccupants--;
+
+      pOc->pQuadTreeNode->addOccupant(pOc);
+    }
+    else
+    {
+      // Doesn't fit in this node anymore, so we will continue going
+      // up levels in the tree until it fits. If it doesn't fit anywhere,
+      // add ot to the quad tree outside of root set.
+
+      // Check to see if this partition should be destroyed.
+      // Then, go through the parents until enough occupants are present and
+      // merge everything into that parent
+      if(pOc->pQuadTreeNode->numOccupants - 1 < MinimumOccupants)
+      {
+        // Move up pNode until we have a partition above the minimum count
+        while(pOc->pQuadTreeNode->pParentNode != NULL)
+        {
+          if(pOc->pQuadTreeNode->numOccupants - 1 >= MinimumOccupants)
+            break;
+
+          pOc->pQuadTreeNode = pOc->pQuadTreeNode->pParentNode;
+        }
+
+        pOc->pQuadTreeNode->merge();
+      }
+
+      // Now, go up and decrement the occupant counts and search for a new place for the modified occupant
+      while(pOc->pQuadTreeNode != NULL)
+      {
+        pOc->pQuadTreeNode->numOccupants--;
+
+        // See if this node contains the occupant. If so, add it to that occupant.
+        if(pOc->pQuadTreeNode->region.contains(pOc->aabb))
+        {
+          // Add the occupant to this node and break
+          pOc->pQuadTreeNode->addOccupant(pOc);
+
+          return;
+        }
+
+        pOc->pQuadTreeNode = pOc->pQuadTreeNode->pParentNode;
+      }
+
+      // If we did not break out of the previous loop, this means that we
+      // cannot fit the occupantinto the root node. We must therefore add
+      // it to the outside root list.
+      outsideRoot.add(pOc, pOc->aabb);
+
+      // Occupant's parent is already NULL, or else it would not have made it here
+      assert(pOc->pQuadTreeNode == NULL);
+
+      growRootIfNeeded();
+    }
+  }
+}
+
+void QuadTree::removeOccupant(QuadTreeOccupant* pOc)
+{
+  if(pOc->pQuadTreeNode != NULL) // If part of a quad tree
+  {
+    pOc->pQuadTreeNode->occupants.remove(pOc->nodeIndex);
+
+    // Doesn't fit in this node anymore, so we will continue going
+    // up levels in the tree until it fits. If it doesn't fit anywhere,
+    // add ot to the quad tree outside of root set.
+
+    // Check to see if this partition should be destroyed.
+    // Then, go through the parents until enough occupants are present and
+    // merge everything into that parent
+    if(pOc->pQuadTreeNode->numOccupants - 1 < MinimumOccupants)
+    {
+      // Move up pNode until we have a partition above the minimum count
+      while(pOc->pQuadTreeNode->pParentNode != NULL)
+      {
+        if(pOc->pQuadTreeNode->numOccupants - 1 >= MinimumOccupants)
+          break;
+
+        pOc->pQuadTreeNode = pOc->pQuadTreeNode->pParentNode;
+      }
+
+      pOc->pQuadTreeNode->merge();
+    }
+
+    // Decrement the remaining occupant counts
+    while(pOc->pQuadTreeNode != NULL)
+    {
+      pOc->pQuadTreeNode->numOccupants--;
+      pOc->pQuadTreeNode = pOc->pQuadTreeNode->pParentNode;
+    }
+  }
+  else // Not in a node, so it must be in the outside root list
+    outsideRoot.remove(pOc->nodeIndex);
+}
+
+void QuadTree::detachOccupant(QuadTreeOccupant* pOc)
+{
+  QuadTreeNode* pNode = pOc->pQuadTreeNode;
+
+  if(pNode == NULL)
+  {
+    outsideRoot.remove(pOc->nodeIndex);
+
+    return;
+  }
+
+  pNode->occupants.remove(pOc->nodeIndex);
+
+  // Decrement the counts up to the root, flagging the path so that the merge pass
+  // only visits subtrees that lost occupants
+  while(pNode != NULL)
+  {
+    assert(pNode->numOccupants >= 1);
+
+    pNode->numOccupants--;
+    pNode->mergeCheckRequired = true;
+
+    pNode = pNode->pParentNode;
+  }
+
+  pOc->pQuadTreeNode = NULL;
+}
+
+void QuadTree::commitUpdates()
+{
+  if(dirtyOccupants.empty())
+    return;
+
+  // Take all dirty occupants out of the tree without merging anything yet
+  for(unsigned int i = 0; i < dirtyOccupants.size(); i++)
+    detachOccupant(dirtyOccupants[i]);
+
+  // Collapse the affected subtrees, each at most once
+  rootNode->mergeEmptied();
+
+  // Reinsert in Morton order so that consecutive insertions walk the same paths
+  sortedOccupants.clear();
+
+  for(unsigned int i = 0; i < dirtyOccupants.size(); i++)
+  {
+    QuadTreeOccupant* pOc = dirtyOccupants[i];
+
+    pOc->dirty = false;
+
+    sortedOccupants.push_back(std::make_pair(mortonCode(pOc->aabb.getCenter(), rootNode->region), pOc));
+  }
+
+  dirtyOccupants.clear();
+
+  sortOccupantsByMortonCode();
+
+  for(unsigned int i = 0; i < sortedOccupants.size(); i++)
+    insertOccupant(sortedOccupants[i].second);
+
+  growRootIfNeeded();
+}
+
+void QuadTree::setRootGrowth(bool grow)
+{
+  rootGrowth = grow;
+
+  growRootIfNeeded();
+}
+
+bool QuadTree::getRootGrowth() const
+{
+  return rootGrowth;
+}
+
+void QuadTree::growRootIfNeeded()
+{
+  for(unsigned int step = 0; rootGrowth && step < MaxRootGrowthSteps; step++)
+  {
+    unsigned int numOutside = outsideRoot.size();
+
+    if(numOutside <= RootGrowthMinOutside || numOutside * RootGrowthOutsideRatio <= rootNode->numOccupants + numOutside)
+      return;
+
+    Vec2f rootDims = rootCell.getDims();
+
+    // A root without area can't be doubled, so start over around everything instead
+    if(!(rootDims.x > 0.0f && rootDims.y > 0.0f))
+    {
+      AABB bounds(rootNode->region);
+
+      for(unsigned int i = 0; i < numOutside; i++)
+      {
+        AABB outsideBounds(outsideRoot.getBounds(i));
+
+        bounds.lowerBound.x = std::min(bounds.lowerBound.x, outsideBounds.lowerBound.x);
+        bounds.lowerBound.y = std::min(bounds.lowerBound.y, outsideBounds.lowerBound.y);
+        bounds.upperBound.x = std::max(bounds.upperBound.x, outsideBounds.upperBound.x);
+        bounds.upperBound.y = std::max(bounds.upperBound.y, outsideBounds.upperBound.y);
+      }
+
+      // Square, so that the cells don't degenerate either
+      Vec2f dims = bounds.getDims();
+      Vec2f halfDims = Vec2f(1.0f, 1.0f) * (std::max(std::max(dims.x, dims.y), 1.0f) / 2.0f);
+
+      rebuild(AABB(bounds.getCenter() - halfDims, bounds.getCenter() + halfDims));
+
+      continue;
+    }
+
+    // Grow towards the side most of the outliers are on. Counting them rather than averaging their centers
+    // keeps a few far away ones from pulling the root away from all the others.
+    Vec2f rootCenter = rootCell.getCenter();
+
+    unsigned int numNegativeX = 0;
+    unsigned int numNegativeY = 0;
+
+    for(unsigned int i = 0; i < numOutside; i++)
+    {
+      Vec2f center = outsideRoot.getBounds(i).getCenter();
+
+      if(center.x < rootCenter.x)
+        numNegativeX++;
+
+      if(center.y < rootCenter.y)
+        numNegativeY++;
+    }
+
+    growRoot(numNegativeX * 2 > numOutside, numNegativeY * 2 > numOutside);
+  }
+}
+
+AABB QuadTree::getGrownCell(const AABB &cell, bool towardsNegativeX, bool towardsNegativeY)
+{
+  Vec2f dims = cell.getDims();
+
+  Vec2f lowerBound(cell.lowerBound.x - (towardsNegativeX ? dims.x : 0.0f),
+                   cell.lowerBound.y - (towardsNegativeY ? dims.y : 0.0f));
+
+  return AABB(lowerBound, lowerBound + dims * 2.0f);
+}
+
+AABB QuadTree::getBulkRootCell() const
+{
+  const unsigned int numOccupants = rootNode->numOccupants + outsideRoot.size() + bulkOccupants.size();
+
+  // Everything in the tree so far is inside the root cell or in the outside root list, which stays so as it grows
+  std::vector<AABB> outliers;
+
+  for(unsigned int i = 0; i < outsideRoot.size(); i++)
+    outliers.push_back(outsideRoot.getBounds(i));
+
+  for(unsigned int i = 0; i < bulkOccupants.size(); i++)
+    outliers.push_back(bulkOccupants[i]->aabb);
+
+  AABB cell(rootCell);
+
+  // Same steps as growRootIfNeeded would take after the build
+  for(unsigned int step = 0; rootGrowth && step < MaxRootGrowthSteps; step++)
+  {
+    AABB region(cell);
+
+    if(looseTree)
+      region.setDims(region.getDims() * LooseMultiplier);
+
+    // Drop the outliers that fit now
+    unsigned int numOutside = 0;
+
+    for(unsigned int i = 0; i < outliers.size(); i++)
+      if(!region.contains(outliers[i]))
+        outliers[numOutside++] = outliers[i];
+
+    outliers.resize(numOutside);
+
+    if(numOutside <= RootGrowthMinOutside || numOutside * RootGrowthOutsideRatio <= numOccupants)
+      break;
+
+    // Starting over around everything is left to growRootIfNeeded
+    Vec2f dims = cell.getDims();
+
+    if(!(dims.x > 0.0f && dims.y > 0.0f))
+      break;
+
+    Vec2f center = cell.getCenter();
+
+    unsigned int numNegativeX = 0;
+    unsigned int numNegativeY = 0;
+
+    for(unsigned int i = 0; i < numOutside; i++)
+    {
+      Vec2f outlierCenter = outliers[i].getCenter();
+
+      if(outlierCenter.x < center.x)
+        numNegativeX++;
+
+      if(outlierCenter.y < center.y)
+        numNegativeY++;
+    }
+
+    cell = getGrownCell(cell, numNegativeX * 2 > numOutside, numNegativeY * 2 > numOutside);
+  }
+
+  return cell;
+}
+
+void QuadTree::growRoot(bool towardsNegativeX, bool towardsNegativeY)
+{
+  const AABB oldRootCell(rootCell);
+
+  rootCell = getGrownCell(rootCell, towardsNegativeX, towardsNegativeY);
+
+  AABB rootRegion(rootCell);
+
+  if(looseTree)
+    rootRegion.setDims(rootRegion.getDims() * LooseMultiplier);
+
+  QuadTreeNode* pOldRoot = rootNode;
+
+  rootNode = new QuadTreeNode(rootRegion, 1, NULL, this);
+
+  // The child in the old root's quadrant covers at least the old root region,
+  // exactly so for loose trees, so everything below it stays valid
+  rootNode->partition();
+
+  QuadTreeNode* pOldRootChild = rootNode->children[towardsNegativeX ? 1 : 0][towardsNegativeY ? 1 : 0];
+
+  pOldRootChild->adopt(pOldRoot);
+  rootNode->numOccupants = pOldRoot->numOccupants;
+
+  delete pOldRoot;
+
+  // A loose root also keeps the occupants centered outside of its cell. Those have a cell of their own now,
+  // left where they are they would straddle the whole subtree of the old root.
+  if(looseTree)
+  {
+    std::vector<QuadTreeOccupant*> misplaced;
+
+    for(unsigned int i = 0; i < pOldRootChild->occupants.size();)
+    {
+      QuadTreeOccupant* pOc = pOldRootChild->occupants.getOccupant(i);
+      Vec2f occupantCenter = pOc->aabb.getCenter();
+
+      if(occupantCenter.x < oldRootCell.lowerBound.x || occupantCenter.x > oldRootCell.upperBound.x ||
+         occupantCenter.y < oldRootCell.lowerBound.y || occupantCenter.y > oldRootCell.upperBound.y)
+      {
+        pOldRootChild->occupants.remove(i);
+        pOldRootChild->numOccupants--;
+        rootNode->numOccupants--;
+
+        misplaced.push_back(pOc);
+      }
+      else
+        i++;
+    }
+
+    for(unsigned int i = 0; i < misplaced.size(); i++)
+      rootNode->addOccupant(misplaced[i]);
+  }
+
+  // Take in the outliers that fit now, removal moves the last one to index i
+  for(unsigned int i = 0; i < outsideRoot.size();)
+  {
+    QuadTreeOccupant* pOc = outsideRoot.getOccupant(i);
+
+    if(rootNode->region.contains(pOc->aabb))
+    {
+      outsideRoot.remove(i);
+
+      rootNode->addOccupant(pOc);
+    }
+    else
+      i++;
+  }
+}
+
+
+void QuadTree::sortOccupantsByMortonCode()
+{
+  // Radix sort on the 32 bit codes, 8 bits per pass. Stable, so equal codes keep their order.
+  const unsigned int numOccupants = sortedOccupants.size();
+
+  sortScratch.resize(numOccupants);
+
+  for(unsigned int shift = 0; shift < 32; shift += 8)
+  {
+    unsigned int offsets[256] = { 0 };
+
+    for(unsigned int i = 0; i < numOccupants; i++)
+      offsets[(sortedOccupants[i].first >> shift) & 0xff]++;
+
+    unsigned int total = 0;
+
+    for(unsigned int digit = 0; digit < 256; digit++)
+    {
+      unsigned int count = offsets[digit];
+      offsets[digit] = total;
+      total += count;
+    }
+
+    for(unsigned int i = 0; i < numOccupants; i++)
+      sortScratch[offsets[(sortedOccupants[i].first >> shift) & 0xff]++] = sortedOccupants[i];
+
+    sortedOccupants.swap(sortScratch);
+  }
+}
+
+void QuadTree::buildFromBulkOccupants()
+{
+  commitUpdates();
+
+  // Growing the root once the tree is built would add the outliers one by one, so size it for them up front
+  rebuild(getBulkRootCell());
+
+  growRootIfNeeded();
+}
+
+void QuadTree::rebuild(const AABB &newRootCell)
+{
+  rootCell = newRootCell;
+
+  AABB rootRegion(newRootCell);
+
+  if(looseTree)
+    rootRegion.setDims(rootRegion.getDims() * LooseMultiplier);
+
+  rootNode->region = rootRegion;
+  rootNode->center = rootRegion.getCenter();
+
+  // Start over with everything that is already in the tree
+  rootNode->getOccupants(bulkOccupants);
+
+  for(unsigned int i = 0; i < outsideRoot.size(); i++)
+    bulkOccupants.push_back(outsideRoot.getOccupant(i));
+
+  if(rootNode->hasChildren)
+    rootNode->destroyChildren();
+
+  rootNode->occupants.clear();
+  rootNode->numOccupants = 0;
+
+  outsideRoot.clear();
+
+  sortedOccupants.clear();
+  sortedOccupants.reserve(bulkOccupants.size());
+
+  for(unsigned int i = 0; i < bulkOccupants.size(); i++)
+  {
+    QuadTreeOccupant* pOc = bulkOccupants[i];
+
+    if(rootNode->region.contains(pOc->aabb))
+      sortedOccupants.push_back(std::make_pair(mortonCode(pOc->aabb.getCenter(), rootNode->region), pOc));
+    else
+    {
+      outsideRoot.add(pOc, pOc->aabb);
+
+      pOc->pQuadTreeNode = NULL;
+      pOc->pSpatialIndex = this;
+    }
+  }
+
+  sortOccupantsByMortonCode();
+
+  const unsigned int numInside = sortedOccupants.size();
+
+  // The second half of the array is scratch space for the build
+  bulkBuildOccupants.resize(numInside * 2);
+
+  for(unsigned int i = 0; i < numInside; i++)
+  {
+    bulkBuildOccupants[i].bounds = sortedOccupants[i].second->aabb;
+    bulkBuildOccupants[i].pOccupant = sortedOccupants[i].second;
+  }
+
+  if(numInside > 0)
+    rootNode->bulkLoad(&bulkBuildOccupants[0], &bulkBuildOccupants[numInside], &bulkBuildOccupants[numInside]);
+
+  bulkOccupants.clear();
 }
 
-void QuadTree::query(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult)
+void QuadTree::query(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult) const
 {
+  LTBL_COUNT_QUERY(queryCounters.add(1, 0, outsideRoot.size(), 0));
+
   // First parse the occupants outside of the root and
   // add them to the array if the fit in the query region
-  for(std::unordered_set<QuadTreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++)
-    if((*it)->aabb.intersects(queryRegion))
-      queryResult.push_back(*it);
+  for(unsigned int i = 0; i < outsideRoot.size(); i++)
+    if(outsideRoot.boundsIntersect(i, queryRegion))
+    {
+      LTBL_COUNT_QUERY(queryCounters.add(0, 0, 0, 1));
+
+      queryResult.push_back(outsideRoot.getOccupant(i));
+    }
 
   // Then query the tree itself
   rootNode->query(queryRegion, queryResult);
 }
 
-void QuadTree::queryToDepth(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult, int depth)
+bool QuadTree::visit(const AABB &queryRegion, QueryVisitor &visitor) const
+{
+  return query(queryRegion, QueryVisitorAdapter(visitor));
+}
+
+void QuadTree::querySector(const Sector &sector, std::vector<QuadTreeOccupant*> &queryResult) const
+{
+  QueryResultAppender appender(queryResult);
+
+  queryShape(sector, appender);
+}
+
+void QuadTree::queryPolygon(const ConvexPolygon &polygon, std::vector<QuadTreeOccupant*> &queryResult) const
+{
+  QueryResultAppender appender(queryResult);
+
+  queryShape(polygon, appender);
+}
+
+bool QuadTree::visitSegment(const Segment &segment, QueryVisitor &visitor) const
+{
+  QueryVisitorAdapter adapter(visitor);
+
+  return queryShape(segment, adapter);
+}
+
+void QuadTree::queryToDepth(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult, int depth) const
 {
   // First parse the occupants outside of the root and
   // add them to the array if the fit in the query region
-  for(std::unordered_set<QuadTreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++)
-    if((*it)->aabb.intersects(queryRegion))
-      queryResult.push_back(*it);
+  for(unsigned int i = 0; i < outsideRoot.size(); i++)
+    if(outsideRoot.boundsIntersect(i, queryRegion))
+      queryResult.push_back(outsideRoot.getOccupant(i));
 
   // Then query the tree itself
   rootNode->queryToDepth(queryRegion, queryResult, depth);
 }
 
-unsigned int QuadTree::getNumOccupants()
+unsigned int QuadTree::queryNearest(const Vec2f &point, unsigned int k, NearestOccupant* pResults) const
+{
+  unsigned int numResults = 0;
+
+  if(k == 0)
+    return 0;
+
+  LTBL_COUNT_QUERY(queryCounters.add(1, 0, outsideRoot.size(), 0));
+
+  for(unsigned int i = 0; i < outsideRoot.size(); i++)
+    QuadTreeNode::offerNearest(outsideRoot.getOccupant(i), outsideRoot.getBounds(i).distanceSquared(point), k, pResults, numResults);
+
+  rootNode->queryNearest(point, k, pResults, numResults);
+
+  LTBL_COUNT_QUERY(queryCounters.add(0, 0, 0, numResults));
+
+  // Turn the max heap into a list sorted by distance
+  std::sort_heap(pResults, pResults + numResults);
+
+  return numResults;
+}
+
+unsigned int QuadTree::getNumOccupants() const
 {
   return rootNode->numOccupants;
 }
 
-AABB QuadTree::getRootAABB()
+void QuadTree::collectStats(SpatialIndexStats &stats) const
+{
+  rootNode->collectStats(stats);
+
+  stats.numOutsideRoot = outsideRoot.size();
+}
+
+AABB QuadTree::getRootAABB() const
 {
   return rootNode->region;
 }
 
+bool QuadTree::isLoose() const
+{
+  return looseTree;
+}
+
+Vec2f QuadTree::getCellDims(unsigned int level) const
+{
+  // Cells halve with every level below the root
+  return rootCell.getDims() / static_cast<float>(1u << (level - 1));
+}
+
+void QuadTree::getLooseCell(const AABB &aabb, unsigned int &targetLevel, Point2i &cell) const
+{
+  Vec2f rootDims = rootCell.getDims();
+  Vec2f dims = aabb.getDims();
+  Vec2f occupantCenter = aabb.getCenter();
+
+  // Only occupants centered in the root cell can go below the root
+  if(occupantCenter.x < rootCell.lowerBound.x || occupantCenter.x > rootCell.upperBound.x ||
+     occupantCenter.y < rootCell.lowerBound.y || occupantCenter.y > rootCell.upperBound.y)
+  {
+    targetLevel = 1;
+    cell = Point2i(0, 0);
+
+    return;
+  }
+
+  // The deepest level whose cells are at least as large as the occupant. Since the ratio is
+  // mantissa * 2^exponent with mantissa in [0.5, 1), the exponent is floor(log2(ratio)) + 1.
+  int exponentX = MaxLevels;
+  int exponentY = MaxLevels;
+
+  if(dims.x > 0.0f)
+    frexpf(rootDims.x / dims.x, &exponentX);
+
+  if(dims.y > 0.0f)
+    frexpf(rootDims.y / dims.y, &exponentY);
+
+  int level = exponentX < exponentY ? exponentX : exponentY;
+
+  if(level < 1)
+    level = 1;
+  else if(level > static_cast<int>(MaxLevels))
+    level = MaxLevels;
+
+  targetLevel = level;
+
+  // Cell of the center at that level
+  const int numCells = 1 << (level - 1);
+
+  Vec2f cellDims = getCellDims(targetLevel);
+
+  cell.x = static_cast<int>((occupantCenter.x - rootCell.lowerBound.x) / cellDims.x);
+  cell.y = static_cast<int>((occupantCenter.y - rootCell.lowerBound.y) / cellDims.y);
+
+  if(cell.x >= numCells)
+    cell.x = numCells - 1;
+
+  if(cell.y >= numCells)
+    cell.y = numCells - 1;
+}
+
+unsigned int QuadTree::getNumLiveNodeBlocks() const
+{
+  return nodePool.getNumLiveBlocks();
+}
+
+unsigned int QuadTree::getNumPooledNodeBlocks() const
+{
+  return nodePool.getNumPooledBlocks();
+}
+
 void QuadTree::debugRender()
 {
   glColor4f(0.1f, 0.6f, 0.4f, 1.0f);
 
   // Parse all AABB's in the tree and render them
-  for(std::unordered_set<QuadTreeOccupant*>::iterator it = outsideRoot.begin(); it != outsideRoot.end(); it++)
-    (*it)->aabb.debugRender();
+  for(unsigned int i = 0; i < outsideRoot.size(); i++)
+    outsideRoot.getBounds(i).debugRender();
 
   // Render the tree itself
   rootNode->debugRender();
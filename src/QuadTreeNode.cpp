@@ -1,14 +1,21 @@
 #include "LTBL/QuadTreeNode.h"
 #include "LTBL/QuadTree.h"
 #include <assert.h>
+#include <algorithm>
 
 #include "LTBL/SFML_OpenGL.h"
 
 using namespace qdt;
 
+QuadTreeNode::QuadTreeNode()
+: pParentNode(NULL), pQuadTree(NULL), hasChildren(false), numOccupants(0),
+    level(0), mergeCheckRequired(false)
+{
+}
+
 QuadTreeNode::QuadTreeNode(const AABB &newRegion, unsigned int numLevels, QuadTreeNode* pParent, QuadTree* pContainer)
-: region(newRegion), hasChildren(false), numOccupants(0),
-    pParentNode(pParent), pQuadTree(pContainer), level(numLevels)
+: region(newRegion), pParentNode(pParent), pQuadTree(pContainer), hasChildren(false),
+    numOccupants(0), level(numLevels), mergeCheckRequired(false)
 {
   center = region.getCenter();
 }
@@ -19,6 +26,51 @@ QuadTreeNode::~QuadTreeNode()
     destroyChildren();
 }
 
+void QuadTreeNode::adopt(QuadTreeNode* pOther)
+{
+  assert(!hasChildren && occupants.empty());
+
+  // Move the occupants along with their bound copies
+  for(unsigned int i = 0; i < pOther->occupants.size(); i++)
+  {
+    QuadTreeOccupant* pOc = pOther->occupants.getOccupant(i);
+
+    occupants.add(pOc, pOther->occupants.getBounds(i));
+
+    pOc->pQuadTreeNode = this;
+  }
+
+  pOther->occupants.clear();
+
+  numOccupants = pOther->numOccupants;
+  mergeCheckRequired = pOther->mergeCheckRequired;
+
+  if(pOther->hasChildren)
+  {
+    for(unsigned int x = 0; x < 2; x++)
+      for(unsigned int y = 0; y < 2; y++)
+      {
+        children[x][y] = pOther->children[x][y];
+        children[x][y]->pParentNode = this;
+        children[x][y]->incrementLevels();
+      }
+
+    hasChildren = true;
+
+    pOther->hasChildren = false;
+  }
+}
+
+void QuadTreeNode::incrementLevels()
+{
+  level++;
+
+  if(hasChildren)
+    for(unsigned int x = 0; x < 2; x++)
+      for(unsigned int y = 0; y < 2; y++)
+        children[x][y]->incrementLevels();
+}
+
 void QuadTreeNode::merge()
 {
   // Merge all children into this node
@@ -29,17 +81,36 @@ void QuadTreeNode::merge()
         children[x][y]->getOccupants(occupants, this);
 
     destroyChildren();
-    hasChildren = false;
   }
 }
 
-void QuadTreeNode::getOccupants(std::unordered_set<QuadTreeOccupant*> &upperOccupants, QuadTreeNode* newNode)
+void QuadTreeNode::mergeEmptied()
+{
+  if(!mergeCheckRequired)
+    return;
+
+  mergeCheckRequired = false;
+
+  if(!hasChildren)
+    return;
+
+  // Collapse the whole subtree if what is left of it fits into this node,
+  // otherwise continue with the children that lost occupants
+  if(numOccupants <= MaximumOccupants)
+    merge();
+  else
+    for(unsigned int x = 0; x < 2; x++)
+      for(unsigned int y = 0; y < 2; y++)
+        children[x][y]->mergeEmptied();
+}
+
+void QuadTreeNode::getOccupants(QuadTreeOccupantList &upperOccupants, QuadTreeNode* newNode)
 {
   // Assign the new node pointers while adding the occupants to the upper node
-  for(std::unordered_set<QuadTreeOccupant*>::iterator it = occupants.begin(); it != occupants.end(); it++)
+  for(unsigned int i = 0; i < occupants.size(); i++)
   {
-    (*it)->pQuadTreeNode = newNode;
-    upperOccupants.insert(*it);
+    occupants.getOccupant(i)->pQuadTreeNode = newNode;
+    upperOccupants.add(occupants.getOccupant(i), occupants.getBounds(i));
   }
 
   // Recusively go through children if there are any
@@ -49,11 +120,11 @@ void QuadTreeNode::getOccupants(std::unordered_set<QuadTreeOccupant*> &upperOccu
         children[x][y]->getOccupants(upperOccupants, newNode);
 }
 
-void QuadTreeNode::getOccupants(std::vector<QuadTreeOccupant*> &queryResult)
+void QuadTreeNode::getOccupants(std::vector<QuadTreeOccupant*> &queryResult) const
 {
-  // Assign the new node pointers while adding the occupants to the upper node
-  for(std::unordered_set<QuadTreeOccupant*>::iterator it = occupants.begin(); it != occupants.end(); it++)
-    queryResult.push_back(*it);
+  // Add all occupants of this node and everything below it
+  for(unsigned int i = 0; i < occupants.size(); i++)
+    queryResult.push_back(occupants.getOccupant(i));
 
   // Recusively go through children if there are any
   if(hasChildren)
@@ -62,6 +133,36 @@ void QuadTreeNode::getOccupants(std::vector<QuadTreeOccupant*> &queryResult)
         children[x][y]->getOccupants(queryResult);
 }
 
+void QuadTreeNode::collectStats(SpatialIndexStats &stats) const
+{
+  unsigned int depth = level - 1;
+
+  stats.numNodes++;
+
+  if(depth > stats.maxDepth)
+    stats.maxDepth = depth;
+
+  if(stats.occupantsPerDepth.size() <= depth)
+    stats.occupantsPerDepth.resize(depth + 1, 0);
+
+  stats.occupantsPerDepth[depth] += occupants.size();
+
+  if(hasChildren)
+  {
+    // Anything kept above the leaves either did not fit into a single child or was added before the split
+    stats.numStraddling += occupants.size();
+
+    for(unsigned int x = 0; x < 2; x++)
+      for(unsigned int y = 0; y < 2; y++)
+        children[x][y]->collectStats(stats);
+  }
+}
+
+void QuadTreeNode::countQuery(unsigned int numNodes, unsigned int numBoundsTests, unsigned int numHits) const
+{
+  pQuadTree->queryCounters.add(0, numNodes, numBoundsTests, numHits);
+}
+
 void QuadTreeNode::partition()
 {
   // Create the children nodes with the appropriate bounds set
@@ -69,14 +170,54 @@ void QuadTreeNode::partition()
 
   const unsigned int nextLevel = level + 1;
 
+  // The children come from the tree's pool as one contiguous block
+  QuadTreeNode* pBlock = pQuadTree->nodePool.allocateBlock();
+
+  if(pQuadTree->looseTree)
+  {
+    // Children of loose trees are centered on the quarters of this node's cell,
+    // and LooseMultiplier times as large as their own cell
+    Vec2f childCellDims = pQuadTree->getCellDims(nextLevel);
+    Vec2f childHalfDims = childCellDims * (LooseMultiplier / 2.0f);
+
+    for(unsigned int x = 0; x < 2; x++)
+      for(unsigned int y = 0; y < 2; y++)
+      {
+        Vec2f childCenter(center.x + (x == 0 ? -0.5f : 0.5f) * childCellDims.x,
+                          center.y + (y == 0 ? -0.5f : 0.5f) * childCellDims.y);
+
+        children[x][y] = &pBlock[x * 2 + y];
+        children[x][y]->reset(AABB(childCenter - childHalfDims, childCenter + childHalfDims), nextLevel, this, pQuadTree);
+      }
+
+    hasChildren = true;
+
+    return;
+  }
+
   for(unsigned int x = 0; x < 2; x++)
     for(unsigned int y = 0; y < 2; y++)
     {
-      children[x][y] = new QuadTreeNode(AABB(Vec2f(region.lowerBound.x + x * halfWidth.x, region.lowerBound.y + y * halfWidth.y),
-                                             Vec2f(center.x + x * halfWidth.x, center.y + y * halfWidth.y)), nextLevel, this, pQuadTree);
+      children[x][y] = &pBlock[x * 2 + y];
+      children[x][y]->reset(AABB(Vec2f(region.lowerBound.x + x * halfWidth.x, region.lowerBound.y + y * halfWidth.y),
+                                 Vec2f(center.x + x * halfWidth.x, center.y + y * halfWidth.y)), nextLevel, this, pQuadTree);
+
+      // Oversize, but stay inside this node so that a merge never pulls occupants into a node that does not contain them
+      AABB &childRegion = children[x][y]->region;
+
+      childRegion.setDims(childRegion.getDims() * OversizedMultiplier);
+
+      if(childRegion.lowerBound.x < region.lowerBound.x)
+        childRegion.lowerBound.x = region.lowerBound.x;
+
+      if(childRegion.lowerBound.y < region.lowerBound.y)
+        childRegion.lowerBound.y = region.lowerBound.y;
 
-      // Oversize
-      children[x][y]->region.setDims(children[x][y]->region.getDims() * OversizedMultiplier);
+      if(childRegion.upperBound.x > region.upperBound.x)
+        childRegion.upperBound.x = region.upperBound.x;
+
+      if(childRegion.upperBound.y > region.upperBound.y)
+        childRegion.upperBound.y = region.upperBound.y;
     }
 
   hasChildren = true;
@@ -84,9 +225,32 @@ void QuadTreeNode::partition()
 
 void QuadTreeNode::destroyChildren()
 {
+  // Recycle the whole subtree, the children's own occupant references were already moved up or dropped
   for(unsigned int x = 0; x < 2; x++)
     for(unsigned int y = 0; y < 2; y++)
-      delete children[x][y];
+    {
+      if(children[x][y]->hasChildren)
+        children[x][y]->destroyChildren();
+
+      children[x][y]->occupants.clear();
+    }
+
+  pQuadTree->nodePool.releaseBlock(children[0][0]);
+
+  hasChildren = false;
+}
+
+void QuadTreeNode::reset(const AABB &newRegion, unsigned int numLevels, QuadTreeNode* pParent, QuadTree* pContainer)
+{
+  assert(!hasChildren && occupants.empty());
+
+  region = newRegion;
+  center = region.getCenter();
+  pParentNode = pParent;
+  pQuadTree = pContainer;
+  level = numLevels;
+  numOccupants = 0;
+  mergeCheckRequired = false;
 }
 
 Point2i QuadTreeNode::getPossibleOccupantPos(QuadTreeOccupant* pOc)
@@ -110,8 +274,90 @@ Point2i QuadTreeNode::getPossibleOccupantPos(QuadTreeOccupant* pOc)
   return pos;
 }
 
+void QuadTreeNode::getLooseTarget(QuadTreeOccupant* pOc, unsigned int &targetLevel, Point2i &cell) const
+{
+  pQuadTree->getLooseCell(pOc->aabb, targetLevel, cell);
+
+  // The occupant can only go further down if its target cell lies below this node
+  if(targetLevel > level)
+  {
+    Vec2f cellDims = pQuadTree->getCellDims(level);
+
+    int shift = targetLevel - level;
+
+    if((cell.x >> shift) != static_cast<int>((center.x - pQuadTree->rootCell.lowerBound.x) / cellDims.x) ||
+       (cell.y >> shift) != static_cast<int>((center.y - pQuadTree->rootCell.lowerBound.y) / cellDims.y))
+      targetLevel = level;
+  }
+}
+
+bool QuadTreeNode::keepsLooseOccupant(QuadTreeOccupant* pOc) const
+{
+  if(!region.contains(pOc->aabb))
+    return false;
+
+  unsigned int targetLevel;
+  Point2i cell;
+
+  getLooseTarget(pOc, targetLevel, cell);
+
+  // Same as addOccupantLoose would decide with the occupant still counted in this node
+  return targetLevel <= level || (!hasChildren && occupants.size() <= MaximumOccupants);
+}
+
+void QuadTreeNode::addOccupantLoose(QuadTreeOccupant* pOc)
+{
+  unsigned int targetLevel;
+  Point2i cell;
+
+  getLooseTarget(pOc, targetLevel, cell);
+
+  QuadTreeNode* pNode = this;
+
+  // Walk straight down the path given by the bits of the cell coordinates
+  while(true)
+  {
+    pNode->numOccupants++;
+
+    if(pNode->level >= targetLevel)
+      break;
+
+    if(!pNode->hasChildren)
+    {
+      // Only go deeper once this node is full
+      if(pNode->occupants.size() + 1 <= MaximumOccupants)
+        break;
+
+      pNode->partition();
+    }
+
+    unsigned int shift = targetLevel - pNode->level - 1;
+
+    QuadTreeNode* pChild = pNode->children[(cell.x >> shift) & 1][(cell.y >> shift) & 1];
+
+    // Guards against rounding at the very edge of a cell
+    if(!pChild->region.contains(pOc->aabb))
+      break;
+
+    pNode = pChild;
+  }
+
+  pNode->occupants.add(pOc, pOc->aabb);
+
+  // Set the occupant's quad tree pointer to the node it ended up in
+  pOc->pQuadTreeNode = pNode;
+  pOc->pSpatialIndex = pQuadTree;
+}
+
 void QuadTreeNode::addOccupant(QuadTreeOccupant* pOc)
 {
+  if(pQuadTree->looseTree)
+  {
+    addOccupantLoose(pOc);
+
+    return;
+  }
+
   numOccupants++;
 
   // See if the new occupant fits into any of
@@ -136,11 +382,13 @@ void QuadTreeNode::addOccupant(QuadTreeOccupant* pOc)
     if(occupants.size() + 1 <= MaximumOccupants || level > MaxLevels)
     {
       // Add to this node's set
-      occupants.insert(pOc);
+      occupants.add(pOc, pOc->aabb);
 
       // Set the occupant's quad tree pointer to this node
       pOc->pQuadTreeNode = this;
-      pOc->pQuadTree = pQuadTree;
+      pOc->pSpatialIndex = pQuadTree;
+
+      return;
     }
     else
     {
@@ -162,22 +410,113 @@ void QuadTreeNode::addOccupant(QuadTreeOccupant* pOc)
   }
 
   // Previous tests failed, so add the occupant this node (even if it goes over the normal maximum occupant count)
-  occupants.insert(pOc);
+  occupants.add(pOc, pOc->aabb);
 
   // Set the occupant's quad tree pointer to this node
   pOc->pQuadTreeNode = this;
-  pOc->pQuadTree = pQuadTree;
+  pOc->pSpatialIndex = pQuadTree;
 }
 
-void QuadTreeNode::query(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult)
+void QuadTreeNode::bulkLoad(BulkOccupant* pFirst, BulkOccupant* pLast, BulkOccupant* pScratch)
+{
+  assert(!hasChildren && occupants.empty());
+
+  numOccupants = pLast - pFirst;
+
+  if(numOccupants > MaximumOccupants && level <= MaxLevels)
+  {
+    partition();
+
+    // Group the occupants by the child that fits them, the ones that fit none last.
+    // This is a counting sort through the scratch range, so each group stays in Morton order.
+    unsigned int groupSizes[5] = { 0, 0, 0, 0, 0 };
+
+    for(BulkOccupant* pOc = pFirst; pOc != pLast; pOc++)
+    {
+      // Same choice of child as addOccupant makes
+      Vec2f corner = pQuadTree->looseTree ? pOc->bounds.getCenter() : pOc->bounds.lowerBound;
+
+      unsigned int x = corner.x > center.x ? 1 : 0;
+      unsigned int y = corner.y > center.y ? 1 : 0;
+
+      pOc->group = children[x][y]->region.contains(pOc->bounds) ? x * 2 + y : 4;
+      groupSizes[pOc->group]++;
+    }
+
+    // Like addOccupant, which leaves the occupants a node had before it split where they are, keep the first
+    // ones here until the node is full. Only the rest go down, which takes far fewer nodes than splitting
+    // until every leaf is within MaximumOccupants.
+    unsigned int numKept = groupSizes[4];
+
+    for(BulkOccupant* pOc = pFirst; pOc != pLast && numKept < MaximumOccupants; pOc++)
+      if(pOc->group != 4)
+      {
+        groupSizes[pOc->group]--;
+        groupSizes[4]++;
+
+        pOc->group = 4;
+        numKept++;
+      }
+
+    unsigned int groupStarts[5];
+    unsigned int offset = 0;
+
+    for(unsigned int group = 0; group < 5; group++)
+    {
+      groupStarts[group] = offset;
+      offset += groupSizes[group];
+    }
+
+    for(BulkOccupant* pOc = pFirst; pOc != pLast; pOc++)
+      pScratch[groupStarts[pOc->group]++] = *pOc;
+
+    // The grouped occupants stay in the scratch range, the children use this one as their scratch
+    BulkOccupant* pGroup = pScratch;
+
+    for(unsigned int group = 0; group < 4; group++)
+      if(groupSizes[group] > 0)
+      {
+        children[group / 2][group % 2]->bulkLoad(pGroup, pGroup + groupSizes[group], pFirst + (pGroup - pScratch));
+
+        pGroup += groupSizes[group];
+      }
+
+    // Nothing went down, so the partition isn't needed
+    if(groupSizes[4] == numOccupants)
+      destroyChildren();
+
+    pFirst = pGroup;
+    pLast = pScratch + numOccupants;
+  }
+
+  // Whatever is left straddles the children or was kept, and stays here
+  for(; pFirst != pLast; pFirst++)
+  {
+    occupants.add(pFirst->pOccupant, pFirst->bounds);
+
+    pFirst->pOccupant->pQuadTreeNode = this;
+    pFirst->pOccupant->pSpatialIndex = pQuadTree;
+  }
+}
+
+void QuadTreeNode::query(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult) const
 {
   // See if this region is visible
   if(region.intersects(queryRegion))
   {
-    // Add the occupants of this node to the array and then parse the children
-    for(std::unordered_set<QuadTreeOccupant*>::iterator it = occupants.begin(); it != occupants.end(); it++)
-      if((*it)->aabb.intersects(queryRegion))
-        queryResult.push_back(*it);
+    LTBL_COUNT_QUERY(countQuery(1, 1 + occupants.size(), 0));
+
+    // Add the occupants of this node to the array and then parse the children.
+    // Only the bound copies kept in the node are touched, not the occupants.
+    for(unsigned int first = 0; first < occupants.size(); first += BoundsBatchSize)
+    {
+      unsigned int mask = occupants.boundsIntersectMask(first, queryRegion);
+
+      LTBL_COUNT_QUERY(countQuery(0, 0, bitCount(mask)));
+
+      for(; mask != 0; mask &= mask - 1)
+        queryResult.push_back(occupants.getOccupant(first + lowestBitIndex(mask)));
+    }
 
     if(hasChildren)
     {
@@ -186,9 +525,75 @@ void QuadTreeNode::query(const AABB &queryRegion, std::vector<QuadTreeOccupant*>
           children[x][y]->query(queryRegion, queryResult);
     }
   }
+  else
+  {
+    LTBL_COUNT_QUERY(countQuery(1, 1, 0));
+  }
+}
+
+void QuadTreeNode::offerNearest(QuadTreeOccupant* pOc, float distanceSquared, unsigned int k, NearestOccupant* pResults, unsigned int &numResults)
+{
+  if(numResults == k)
+  {
+    // The root of the heap is the furthest of the k
+    if(distanceSquared >= pResults[0].distanceSquared)
+      return;
+
+    std::pop_heap(pResults, pResults + numResults);
+    numResults--;
+  }
+
+  pResults[numResults].pOccupant = pOc;
+  pResults[numResults].distanceSquared = distanceSquared;
+  numResults++;
+
+  std::push_heap(pResults, pResults + numResults);
+}
+
+void QuadTreeNode::queryNearest(const Vec2f &point, unsigned int k, NearestOccupant* pResults, unsigned int &numResults) const
+{
+  // Nothing in this subtree can beat the k found so far
+  if(numResults == k && region.distanceSquared(point) >= pResults[0].distanceSquared)
+  {
+    LTBL_COUNT_QUERY(countQuery(1, 1, 0));
+
+    return;
+  }
+
+  LTBL_COUNT_QUERY(countQuery(1, 1 + occupants.size(), 0));
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+    offerNearest(occupants.getOccupant(i), occupants.getBounds(i).distanceSquared(point), k, pResults, numResults);
+
+  if(!hasChildren)
+    return;
+
+  // Visit the children nearest first, so that the bound tightens as early as possible
+  const QuadTreeNode* sortedChildren[4];
+  float childDistances[4];
+
+  for(unsigned int i = 0; i < 4; i++)
+  {
+    const QuadTreeNode* pChild = children[i / 2][i % 2];
+    float distanceSquared = pChild->region.distanceSquared(point);
+
+    unsigned int j = i;
+
+    for(; j > 0 && childDistances[j - 1] > distanceSquared; j--)
+    {
+      sortedChildren[j] = sortedChildren[j - 1];
+      childDistances[j] = childDistances[j - 1];
+    }
+
+    sortedChildren[j] = pChild;
+    childDistances[j] = distanceSquared;
+  }
+
+  for(unsigned int i = 0; i < 4; i++)
+    sortedChildren[i]->queryNearest(point, k, pResults, numResults);
 }
 
-void QuadTreeNode::queryToDepth(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult, int depth)
+void QuadTreeNode::queryToDepth(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult, int depth) const
 {
   if(depth == 0)
   {
@@ -200,10 +605,11 @@ void QuadTreeNode::queryToDepth(const AABB &queryRegion, std::vector<QuadTreeOcc
   // See if this region is visible
   if(region.intersects(queryRegion))
   {
-    // Add the occupants of this node to the array and then parse the children
-    for(std::unordered_set<QuadTreeOccupant*>::iterator it = occupants.begin(); it != occupants.end(); it++)
-      if((*it)->aabb.intersects(queryRegion))
-        queryResult.push_back(*it);
+    // Add the occupants of this node to the array and then parse the children.
+    // Only the bound copies kept in the node are touched, not the occupants.
+    for(unsigned int first = 0; first < occupants.size(); first += BoundsBatchSize)
+      for(unsigned int mask = occupants.boundsIntersectMask(first, queryRegion); mask != 0; mask &= mask - 1)
+        queryResult.push_back(occupants.getOccupant(first + lowestBitIndex(mask)));
 
     if(hasChildren)
     {
@@ -224,8 +630,8 @@ void QuadTreeNode::debugRender()
   glColor4f(0.3f, 0.5f, 0.5f, 1.0f);
 
   // Render the AABB's of the occupants in this node
-  for(std::unordered_set<QuadTreeOccupant*>::iterator it = occupants.begin(); it != occupants.end(); it++)
-    (*it)->aabb.debugRender();
+  for(unsigned int i = 0; i < occupants.size(); i++)
+    occupants.getBounds(i).debugRender();
 
   if(hasChildren)
   {
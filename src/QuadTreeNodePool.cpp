@@ -0,0 +1,55 @@
+#include "LTBL/QuadTreeNodePool.h"
+
+#include <assert.h>
+
+using namespace qdt;
+
+QuadTreeNodePool::QuadTreeNodePool()
+: numLiveBlocks(0)
+{
+}
+
+void QuadTreeNodePool::allocateChunk()
+{
+  QuadTreeNode* pChunk = new QuadTreeNode[NodeBlocksPerChunk * 4];
+
+  chunks.push_back(std::unique_ptr<QuadTreeNode[]>(pChunk));
+
+  // Reserve room for every block up front so that releasing never reallocates
+  freeBlocks.reserve(chunks.size() * NodeBlocksPerChunk);
+
+  for(unsigned int i = 0; i < NodeBlocksPerChunk; i++)
+    freeBlocks.push_back(&pChunk[i * 4]);
+}
+
+QuadTreeNode* QuadTreeNodePool::allocateBlock()
+{
+  if(freeBlocks.empty())
+    allocateChunk();
+
+  QuadTreeNode* pBlock = freeBlocks.back();
+  freeBlocks.pop_back();
+
+  numLiveBlocks++;
+
+  return pBlock;
+}
+
+void QuadTreeNodePool::releaseBlock(QuadTreeNode* pBlock)
+{
+  assert(numLiveBlocks > 0);
+
+  numLiveBlocks--;
+
+  freeBlocks.push_back(pBlock);
+}
+
+unsigned int QuadTreeNodePool::getNumLiveBlocks() const
+{
+  return numLiveBlocks;
+}
+
+unsigned int QuadTreeNodePool::getNumPooledBlocks() const
+{
+  return freeBlocks.size();
+}
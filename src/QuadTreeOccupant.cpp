@@ -2,6 +2,7 @@
 
 #include "LTBL/QuadTreeNode.h"
 #include "LTBL/QuadTree.h"
+#include "LTBL/SpatialIndex.h"
 
 #include "LTBL/SFML_OpenGL.h"
 
@@ -94,6 +95,14 @@ bool AABB::contains(const AABB &other) const
   return false;
 }
 
+float AABB::distanceSquared(const Vec2f &point) const
+{
+  float dx = point.x < lowerBound.x ? lowerBound.x - point.x : (point.x > upperBound.x ? point.x - upperBound.x : 0.0f);
+  float dy = point.y < lowerBound.y ? lowerBound.y - point.y : (point.y > upperBound.y ? point.y - upperBound.y : 0.0f);
+
+  return dx * dx + dy * dy;
+}
+
 void AABB::debugRender()
 {
   // Render the AABB with lines
@@ -119,7 +128,7 @@ void AABB::debugRender()
 }
 
 QuadTreeOccupant::QuadTreeOccupant()
-: pQuadTreeNode(NULL), pQuadTree(NULL)
+: pSpatialIndex(NULL), pQuadTreeNode(NULL), nodeIndex(0), proxyId(-1), dirty(false), dirtyIndex(0)
 {
 }
 
@@ -129,126 +138,21 @@ QuadTreeOccupant::~QuadTreeOccupant()
 
 void QuadTreeOccupant::updateTreeStatus()
 {
-  if(pQuadTreeNode == NULL)
-  {
-    // Not in the tree, so see if it fits in the root partition now that the AABB has been changed.
-    if(pQuadTree != NULL) // It must not have been added to a tree if this is NULL as well
-      if(pQuadTree->rootNode->region.contains(aabb))
-      {
-        // Fits, remove it from the outside root set and add it to the root
-        pQuadTree->outsideRoot.erase(this);
-
-        pQuadTree->rootNode->addOccupant(this);
-      }
-  }
-  else
-  {
-    assert(pQuadTreeNode->numOccupants >= 1);
-
-    // First remove the occupant from the set (may be re-added later, this is not highly
-    // optimized, but we use this method for simplicity's sake)
-    pQuadTreeNode->occupants.erase(this);
-
-    // See of the occupant still fits
-    if(pQuadTreeNode->region.contains(aabb))
-    {
-      // Re-add to possibly settle into a new position lower in the tree
-
-      // AddOccupant will raise this number to indicate more occupants than there actually are
-      pQuadTreeNode->numOccupants--;
-
-      pQuadTreeNode->addOccupant(this);
-    }
-    else
-    {
-      // Doesn't fit in this node anymore, so we will continue going
-      // up levels in the tree until it fits. If it doesn't fit anywhere,
-      // add ot to the quad tree outside of root set.
-
-      // Check to see if this partition should be destroyed.
-      // Then, go through the parents until enough occupants are present and
-      // merge everything into that parent
-      if(pQuadTreeNode->numOccupants - 1 < MinimumOccupants)
-      {
-        // Move up pNode until we have a partition above the minimum count
-        while(pQuadTreeNode->pParentNode != NULL)
-        {
-          if(pQuadTreeNode->numOccupants - 1 >= MinimumOccupants)
-            break;
-
-          pQuadTreeNode = pQuadTreeNode->pParentNode;
-        }
-
-        pQuadTreeNode->merge();
-      }
-
-      // Now, go up and decrement the occupant counts and search for a new place for the modified occupant
-      while(pQuadTreeNode != NULL)
-      {
-        pQuadTreeNode->numOccupants--;
-
-        // See if this node contains the occupant. If so, add it to that occupant.
-        if(pQuadTreeNode->region.contains(aabb))
-        {
-          // Add the occupant to this node and break
-          pQuadTreeNode->addOccupant(this);
-
-          return;
-        }
-
-        pQuadTreeNode = pQuadTreeNode->pParentNode;
-      }
-
-      // If we did not break out of the previous loop, this means that we
-      // cannot fit the occupantinto the root node. We must therefore add
-      // it to the outside root set using our pointer to the quad tree container.
-      assert(pQuadTree != NULL);
-
-      pQuadTree->outsideRoot.insert(this);
-
-      // Occupant's parent is already NULL, or else it would not have made it here
-      assert(pQuadTreeNode == NULL);
-    }
-  }
+  if(pSpatialIndex != NULL) // Nothing to do if it was never added to an index
+    pSpatialIndex->updateOccupant(this);
 }
 
 void QuadTreeOccupant::removeFromTree()
 {
-  if(pQuadTreeNode != NULL) // If part of a quad tree
+  if(pSpatialIndex != NULL)
   {
-    pQuadTreeNode->occupants.erase(this);
-
-    // Doesn't fit in this node anymore, so we will continue going
-    // up levels in the tree until it fits. If it doesn't fit anywhere,
-    // add ot to the quad tree outside of root set.
-
-    // Check to see if this partition should be destroyed.
-    // Then, go through the parents until enough occupants are present and
-    // merge everything into that parent
-    if(pQuadTreeNode->numOccupants - 1 < MinimumOccupants)
-    {
-      // Move up pNode until we have a partition above the minimum count
-      while(pQuadTreeNode->pParentNode != NULL)
-      {
-        if(pQuadTreeNode->numOccupants - 1 >= MinimumOccupants)
-          break;
-
-        pQuadTreeNode = pQuadTreeNode->pParentNode;
-      }
-
-      pQuadTreeNode->merge();
-    }
-
-    // Decrement the remaining occupant counts
-    while(pQuadTreeNode != NULL)
-    {
-      pQuadTreeNode->numOccupants--;
-      pQuadTreeNode = pQuadTreeNode->pParentNode;
-    }
+    // Drop any pending deferred update
+    if(dirty)
+      pSpatialIndex->unmarkDirty(this);
+
+    pSpatialIndex->removeOccupant(this);
   }
-  else if(pQuadTree != NULL) // See if still part of a quad tree, indicating that it must be in the outside root set
-    pQuadTree->outsideRoot.erase(this);
 
+  pSpatialIndex = NULL;
   pQuadTreeNode = NULL;
-  pQuadTree = NULL;
 }
@@ -0,0 +1,97 @@
+#include "LTBL/QuadTreeOccupantList.h"
+
+#include <assert.h>
+
+using namespace qdt;
+
+QuadTreeOccupantList::QuadTreeOccupantList()
+: numOccupants(0), capacity(InlineOccupants),
+    occupants(inlineOccupants),
+    lowerX(inlineBounds[0]), lowerY(inlineBounds[1]), upperX(inlineBounds[2]), upperY(inlineBounds[3]),
+    inlineBounds()
+{
+}
+
+void QuadTreeOccupantList::grow()
+{
+  const unsigned int newCapacity = capacity * 2;
+
+  std::vector<QuadTreeOccupant*> newOccupants(newCapacity);
+  std::vector<float> newBounds(newCapacity * 4);
+
+  for(unsigned int i = 0; i < numOccupants; i++)
+  {
+    newOccupants[i] = occupants[i];
+    newBounds[i] = lowerX[i];
+    newBounds[newCapacity + i] = lowerY[i];
+    newBounds[newCapacity * 2 + i] = upperX[i];
+    newBounds[newCapacity * 3 + i] = upperY[i];
+  }
+
+  spillOccupants.swap(newOccupants);
+  spillBounds.swap(newBounds);
+
+  capacity = newCapacity;
+
+  occupants = &spillOccupants[0];
+  lowerX = &spillBounds[0];
+  lowerY = &spillBounds[capacity];
+  upperX = &spillBounds[capacity * 2];
+  upperY = &spillBounds[capacity * 3];
+}
+
+AABB QuadTreeOccupantList::getBounds(unsigned int index) const
+{
+  assert(index < numOccupants);
+
+  return AABB(Vec2f(lowerX[index], lowerY[index]), Vec2f(upperX[index], upperY[index]));
+}
+
+void QuadTreeOccupantList::setBounds(unsigned int index, const AABB &bounds)
+{
+  assert(index < numOccupants);
+
+  lowerX[index] = bounds.lowerBound.x;
+  lowerY[index] = bounds.lowerBound.y;
+  upperX[index] = bounds.upperBound.x;
+  upperY[index] = bounds.upperBound.y;
+}
+
+void QuadTreeOccupantList::add(QuadTreeOccupant* pOc, const AABB &bounds)
+{
+  if(numOccupants == capacity)
+    grow();
+
+  occupants[numOccupants] = pOc;
+  lowerX[numOccupants] = bounds.lowerBound.x;
+  lowerY[numOccupants] = bounds.lowerBound.y;
+  upperX[numOccupants] = bounds.upperBound.x;
+  upperY[numOccupants] = bounds.upperBound.y;
+
+  pOc->nodeIndex = numOccupants;
+
+  numOccupants++;
+}
+
+void QuadTreeOccupantList::remove(unsigned int index)
+{
+  assert(index < numOccupants);
+
+  numOccupants--;
+
+  if(index != numOccupants)
+  {
+    occupants[index] = occupants[numOccupants];
+    lowerX[index] = lowerX[numOccupants];
+    lowerY[index] = lowerY[numOccupants];
+    upperX[index] = upperX[numOccupants];
+    upperY[index] = upperY[numOccupants];
+
+    occupants[index]->nodeIndex = index;
+  }
+}
+
+void QuadTreeOccupantList::clear()
+{
+  numOccupants = 0;
+}
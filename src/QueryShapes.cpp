@@ -0,0 +1,210 @@
+#include "LTBL/QueryShapes.h"
+
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace qdt;
+
+namespace
+{
+const float Pi = 3.14159265359f;
+
+void expand(AABB &aabb, const Vec2f &point)
+{
+  if(point.x < aabb.lowerBound.x)
+    aabb.lowerBound.x = point.x;
+
+  if(point.y < aabb.lowerBound.y)
+    aabb.lowerBound.y = point.y;
+
+  if(point.x > aabb.upperBound.x)
+    aabb.upperBound.x = point.x;
+
+  if(point.y > aabb.upperBound.y)
+    aabb.upperBound.y = point.y;
+}
+
+// Smallest value of normal.dot(p - origin) over all points p of the box
+float minimumProjection(const AABB &aabb, const Vec2f &origin, const Vec2f &normal)
+{
+  Vec2f halfDims = aabb.getDims() / 2.0f;
+
+  return normal.dot(aabb.getCenter() - origin) - fabsf(normal.x) * halfDims.x - fabsf(normal.y) * halfDims.y;
+}
+
+// Narrows [tMin, tMax] to the part of the segment between lower and upper on one axis
+bool clipToSlab(float from, float delta, float lower, float upper, float &tMin, float &tMax)
+{
+  // Parallel to the slab, so either always inside it or never
+  if(delta == 0.0f)
+    return from >= lower && from <= upper;
+
+  float t1 = (lower - from) / delta;
+  float t2 = (upper - from) / delta;
+
+  if(t1 > t2)
+    std::swap(t1, t2);
+
+  if(t1 > tMin)
+    tMin = t1;
+
+  if(t2 < tMax)
+    tMax = t2;
+
+  return tMin <= tMax;
+}
+}
+
+Sector::Sector(const Vec2f &sectorCenter, float sectorRadius, float directionAngle, float spreadAngle, float sectorMargin)
+: center(sectorCenter), radius(sectorRadius), margin(sectorMargin),
+  full(spreadAngle >= 2.0f * Pi), convex(spreadAngle <= Pi)
+{
+  float angle1 = directionAngle - spreadAngle / 2.0f;
+  float angle2 = directionAngle + spreadAngle / 2.0f;
+
+  // The sector lies to the left of the first edge and to the right of the second
+  edgeNormal1 = Vec2f(sinf(angle1), -cosf(angle1));
+  edgeNormal2 = Vec2f(-sinf(angle2), cosf(angle2));
+
+  Vec2f marginDims(margin, margin);
+
+  if(full)
+  {
+    bounds = AABB(center - Vec2f(radius, radius) - marginDims, center + Vec2f(radius, radius) + marginDims);
+
+    return;
+  }
+
+  // The center, both ends of the arc and the points of the arc furthest along each axis
+  bounds = AABB(center, center);
+
+  expand(bounds, center + Vec2f(cosf(angle1), sinf(angle1)) * radius);
+  expand(bounds, center + Vec2f(cosf(angle2), sinf(angle2)) * radius);
+
+  for(unsigned int i = 0; i < 4; i++)
+  {
+    float axisAngle = i * Pi / 2.0f;
+
+    float offset = fmodf(axisAngle - angle1, 2.0f * Pi);
+
+    if(offset < 0.0f)
+      offset += 2.0f * Pi;
+
+    if(offset <= spreadAngle)
+      expand(bounds, center + Vec2f(cosf(axisAngle), sinf(axisAngle)) * radius);
+  }
+
+  bounds.lowerBound -= marginDims;
+  bounds.upperBound += marginDims;
+}
+
+const AABB &Sector::getAABB() const
+{
+  return bounds;
+}
+
+bool Sector::intersects(const AABB &aabb) const
+{
+  if(!bounds.intersects(aabb))
+    return false;
+
+  // Distance from the center to the closest point of the box
+  Vec2f closest(center.x < aabb.lowerBound.x ? aabb.lowerBound.x : (center.x > aabb.upperBound.x ? aabb.upperBound.x : center.x),
+                center.y < aabb.lowerBound.y ? aabb.lowerBound.y : (center.y > aabb.upperBound.y ? aabb.upperBound.y : center.y));
+
+  float outerRadius = radius + margin;
+
+  if((closest - center).magnitudeSquared() > outerRadius * outerRadius)
+    return false;
+
+  if(full)
+    return true;
+
+  // Boxes entirely beyond an edge, after moving the edge out by the margin
+  bool outside1 = minimumProjection(aabb, center, edgeNormal1) > margin;
+  bool outside2 = minimumProjection(aabb, center, edgeNormal2) > margin;
+
+  if(convex)
+    return !outside1 && !outside2;
+
+  return !(outside1 && outside2);
+}
+
+Segment::Segment(const Vec2f &segmentFrom, const Vec2f &segmentTo)
+: from(segmentFrom), delta(segmentTo - segmentFrom), bounds(segmentFrom, segmentFrom)
+{
+  expand(bounds, segmentTo);
+}
+
+const AABB &Segment::getAABB() const
+{
+  return bounds;
+}
+
+bool Segment::intersects(const AABB &aabb) const
+{
+  float tMin = 0.0f;
+  float tMax = 1.0f;
+
+  return clipToSlab(from.x, delta.x, aabb.lowerBound.x, aabb.upperBound.x, tMin, tMax) &&
+         clipToSlab(from.y, delta.y, aabb.lowerBound.y, aabb.upperBound.y, tMin, tMax);
+}
+
+ConvexPolygon::ConvexPolygon(const Vec2f* polygonVertices, unsigned int numPolygonVertices)
+: numVertices(numPolygonVertices)
+{
+  assert(numVertices >= 3 && numVertices <= ConvexPolygonMaxVertices);
+
+  bounds = AABB(polygonVertices[0], polygonVertices[0]);
+
+  float doubleArea = 0.0f;
+
+  for(unsigned int i = 0; i < numVertices; i++)
+  {
+    vertices[i] = polygonVertices[i];
+
+    expand(bounds, vertices[i]);
+
+    doubleArea += polygonVertices[i].cross(polygonVertices[(i + 1) % numVertices]);
+  }
+
+  winding = doubleArea < 0.0f ? -1.0f : 1.0f;
+}
+
+unsigned int ConvexPolygon::getNumVertices() const
+{
+  return numVertices;
+}
+
+const Vec2f &ConvexPolygon::getVertex(unsigned int index) const
+{
+  assert(index < numVertices);
+
+  return vertices[index];
+}
+
+const AABB &ConvexPolygon::getAABB() const
+{
+  return bounds;
+}
+
+bool ConvexPolygon::intersects(const AABB &aabb) const
+{
+  // The box axes
+  if(!bounds.intersects(aabb))
+    return false;
+
+  // The edge normals
+  for(unsigned int i = 0; i < numVertices; i++)
+  {
+    Vec2f edge = vertices[(i + 1) % numVertices] - vertices[i];
+
+    Vec2f outwardNormal(edge.y * winding, -edge.x * winding);
+
+    if(minimumProjection(aabb, vertices[i], outwardNormal) > 0.0f)
+      return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,183 @@
+#include "LTBL/ShadowGeometryBuilder.h"
+
+#include <math.h>
+
+using namespace ltbl;
+
+namespace
+{
+void addVertex(const Vec2f &position, float depth, float u, float v, std::vector<ShadowVertex> &vertices)
+{
+  ShadowVertex vertex;
+
+  vertex.x = position.x;
+  vertex.y = position.y;
+  vertex.z = depth;
+  vertex.u = u;
+  vertex.v = v;
+
+  vertices.push_back(vertex);
+}
+
+// Fin of a boundary vertex, the umbra and penumbra run from the vertex away from the two sides of the light
+ShadowFin getBoundryFin(const Light &light, const Vec2f &hCenter, const Vec2f &boundryPoint)
+{
+  Vec2f lightNormal(-(light.center.y - boundryPoint.y), light.center.x - boundryPoint.x);
+
+  Vec2f centerToBoundry = boundryPoint - hCenter;
+
+  if(centerToBoundry.dot(lightNormal) < 0)
+    lightNormal *= -1;
+
+  lightNormal = lightNormal.normalize() * light.size;
+
+  ShadowFin fin;
+
+  fin.rootPos = boundryPoint;
+  fin.umbra = boundryPoint - (light.center + lightNormal);
+  fin.umbra = fin.umbra.normalize() * light.radius;
+
+  fin.penumbra = boundryPoint - (light.center - lightNormal);
+  fin.penumbra = fin.penumbra.normalize() * light.radius;
+
+  return fin;
+}
+}
+
+void ShadowGeometry::clear()
+{
+  umbraVertices.clear();
+  finVertices.clear();
+}
+
+bool ShadowGeometry::empty() const
+{
+  return umbraVertices.empty() && finVertices.empty();
+}
+
+void ShadowGeometry::append(const ShadowGeometry &other)
+{
+  umbraVertices.insert(umbraVertices.end(), other.umbraVertices.begin(), other.umbraVertices.end());
+  finVertices.insert(finVertices.end(), other.finVertices.begin(), other.finVertices.end());
+}
+
+void ShadowGeometryBuilder::addFin(const ShadowFin &fin, float depth, ShadowGeometry &geometry)
+{
+  // Same texture coordinates as ShadowFin::render
+  addVertex(fin.rootPos, depth, 0.0f, 1.0f, geometry.finVertices);
+  addVertex(fin.rootPos + fin.penumbra, depth, 0.0f, 0.0f, geometry.finVertices);
+  addVertex(fin.rootPos + fin.umbra, depth, 1.0f, 0.0f, geometry.finVertices);
+}
+
+void ShadowGeometryBuilder::addHullShadow(const Light &light, const ConvexHull &hull, float umbraDepth, float finDepth, ShadowGeometry &geometry)
+{
+  // ----------------------------- Determine the Shadow Boundaries -----------------------------
+
+  Vec2f lCenter = light.center;
+  float lRadius = light.radius;
+
+  Vec2f hCenter = hull.getWorldCenter();
+
+  int firstBoundryIndex;
+  int secondBoundryIndex;
+
+  hull.findSilhouette(lCenter, light.size, edgeMaskScratch, firstBoundryIndex, secondBoundryIndex);
+
+  // -------------------------------- Shadow Fins --------------------------------
+
+  ShadowFin firstFin(getBoundryFin(light, hCenter, hull.getWorldVertex(firstBoundryIndex)));
+  ShadowFin secondFin(getBoundryFin(light, hCenter, hull.getWorldVertex(secondBoundryIndex)));
+
+  addFin(firstFin, finDepth, geometry);
+  addFin(secondFin, finDepth, geometry);
+
+  ShadowFin lastFin1(addExtraFins(hull, firstFin, light, firstBoundryIndex, false, finDepth, geometry));
+  ShadowFin lastFin2(addExtraFins(hull, secondFin, light, secondBoundryIndex, true, finDepth, geometry));
+
+  Vec2f mainUmbraRoot1 = lastFin1.rootPos;
+  Vec2f mainUmbraRoot2 = lastFin2.rootPos;
+  Vec2f mainUmbraVec1 = lastFin1.umbra;
+  Vec2f mainUmbraVec2 = lastFin2.umbra;
+
+  // ----------------------------- The umbra -----------------------------
+
+  Vec2f throughCenter = (hCenter - lCenter).normalize() * lRadius;
+
+  // 3 rays is enough in most cases, stored as the triangles of the strip root 1, ray 1, center, center ray, root 2, ray 2
+  Vec2f strip[6] = {
+    mainUmbraRoot1, mainUmbraRoot1 + mainUmbraVec1,
+    hCenter, hCenter + throughCenter,
+    mainUmbraRoot2, mainUmbraRoot2 + mainUmbraVec2
+  };
+
+  for(unsigned int i = 0; i < 4; i++)
+  {
+    // Keep the winding of the strip, which flips every other triangle
+    unsigned int first = i % 2 == 0 ? i : i + 1;
+    unsigned int second = i % 2 == 0 ? i + 1 : i;
+
+    addVertex(strip[first], umbraDepth, 0.0f, 0.0f, geometry.umbraVertices);
+    addVertex(strip[second], umbraDepth, 0.0f, 0.0f, geometry.umbraVertices);
+    addVertex(strip[i + 2], umbraDepth, 0.0f, 0.0f, geometry.umbraVertices);
+  }
+}
+
+ShadowFin ShadowGeometryBuilder::addExtraFins(const ConvexHull &hull, ShadowFin fin, const Light &light, int boundryIndex, bool wrapCW, float finDepth, ShadowGeometry &geometry)
+{
+  Vec2f hCenter = hull.getWorldCenter();
+
+  int secondEdgeIndex;
+  int numVertices = static_cast<signed>(hull.vertices.size());
+
+  for(int i = 0; i < maxFins; i++)
+  {
+    if(wrapCW)
+      secondEdgeIndex = Wrap(boundryIndex - 1, numVertices);
+    else
+      secondEdgeIndex = Wrap(boundryIndex + 1, numVertices);
+
+    // The edge from the boundary to the next vertex, read off the world normal so that it turns with the hull.
+    // The normal of edge i is (-y, x) of the edge from vertex i to i + 1.
+    Vec2f edgeNormal(hull.getWorldNormal(wrapCW ? secondEdgeIndex : boundryIndex));
+
+    Vec2f edgeVec = (wrapCW ? Vec2f(-edgeNormal.y, edgeNormal.x) : Vec2f(edgeNormal.y, -edgeNormal.x)).normalize();
+
+    Vec2f penNorm(fin.penumbra.normalize());
+
+    float angle1 = acosf(penNorm.dot(edgeVec) / (fin.penumbra.magnitude() * edgeVec.magnitude()));
+    float angle2 = acosf(penNorm.dot(fin.umbra) / (fin.penumbra.magnitude() * fin.umbra.magnitude()));
+
+    if(angle1 >= angle2)
+      break; // No intersection, break
+
+    // Add the extra fin
+    Vec2f secondBoundryPoint = hull.getWorldVertex(secondEdgeIndex);
+
+    Vec2f lightNormal(-(light.center.y - secondBoundryPoint.y), light.center.x - secondBoundryPoint.x);
+
+    Vec2f centerToBoundry = secondBoundryPoint - hCenter;
+
+    if(centerToBoundry.dot(lightNormal) < 0)
+      lightNormal *= -1;
+
+    lightNormal = lightNormal.normalize() * light.size;
+
+    ShadowFin newFin;
+
+    newFin.rootPos = secondBoundryPoint;
+    newFin.umbra = secondBoundryPoint - (light.center + lightNormal);
+    newFin.umbra = newFin.umbra.normalize() * light.radius;
+    newFin.penumbra = edgeVec.normalize() * light.radius;
+
+    addFin(newFin, finDepth, geometry);
+
+    fin = newFin;
+
+    boundryIndex = secondEdgeIndex;
+
+    break;
+  }
+
+  // The main umbra corresponds to the last fin
+  return fin;
+}
@@ -0,0 +1,221 @@
+#include "LTBL/ShadowGeometryCache.h"
+
+#include <assert.h>
+#include <functional>
+
+using namespace ltbl;
+
+std::size_t ShadowGeometryCache::KeyHash::operator()(const Key &key) const
+{
+  std::size_t lightHash = std::hash<const void*>()(key.first);
+  std::size_t hullHash = std::hash<const void*>()(key.second);
+
+  return lightHash ^ (hullHash + 0x9e3779b9 + (lightHash << 6) + (lightHash >> 2));
+}
+
+ShadowGeometryCache::ShadowGeometryCache()
+: budget(DefaultShadowCacheBudget), memoryUsage(0), frame(0)
+{
+}
+
+unsigned int ShadowGeometryCache::getEntryBytes(const Entry &entry) const
+{
+  // The list and map nodes are estimated, the vertices are what matters
+  return sizeof(Entry) + 4 * sizeof(void*) + sizeof(Key) +
+         (entry.geometry.umbraVertices.capacity() + entry.geometry.finVertices.capacity()) * sizeof(ShadowVertex);
+}
+
+void ShadowGeometryCache::link(Entry* pEntry)
+{
+  Entry* &pFirstOfLight = lightEntries[pEntry->pLight];
+
+  pEntry->pPreviousOfLight = NULL;
+  pEntry->pNextOfLight = pFirstOfLight;
+
+  if(pFirstOfLight != NULL)
+    pFirstOfLight->pPreviousOfLight = pEntry;
+
+  pFirstOfLight = pEntry;
+
+  Entry* &pFirstOfHull = hullEntries[pEntry->pHull];
+
+  pEntry->pPreviousOfHull = NULL;
+  pEntry->pNextOfHull = pFirstOfHull;
+
+  if(pFirstOfHull != NULL)
+    pFirstOfHull->pPreviousOfHull = pEntry;
+
+  pFirstOfHull = pEntry;
+}
+
+void ShadowGeometryCache::unlink(Entry* pEntry)
+{
+  if(pEntry->pNextOfLight != NULL)
+    pEntry->pNextOfLight->pPreviousOfLight = pEntry->pPreviousOfLight;
+
+  if(pEntry->pPreviousOfLight != NULL)
+    pEntry->pPreviousOfLight->pNextOfLight = pEntry->pNextOfLight;
+  else if(pEntry->pNextOfLight != NULL)
+    lightEntries[pEntry->pLight] = pEntry->pNextOfLight;
+  else
+    lightEntries.erase(pEntry->pLight);
+
+  if(pEntry->pNextOfHull != NULL)
+    pEntry->pNextOfHull->pPreviousOfHull = pEntry->pPreviousOfHull;
+
+  if(pEntry->pPreviousOfHull != NULL)
+    pEntry->pPreviousOfHull->pNextOfHull = pEntry->pNextOfHull;
+  else if(pEntry->pNextOfHull != NULL)
+    hullEntries[pEntry->pHull] = pEntry->pNextOfHull;
+  else
+    hullEntries.erase(pEntry->pHull);
+}
+
+void ShadowGeometryCache::evict(std::list<Entry>::iterator it)
+{
+  assert(memoryUsage >= it->bytes);
+
+  memoryUsage -= it->bytes;
+
+  unlink(&*it);
+
+  entryMap.erase(Key(it->pLight, it->pHull));
+  entries.erase(it);
+}
+
+void ShadowGeometryCache::beginFrame()
+{
+  frame++;
+}
+
+ShadowGeometryCache::Entry* ShadowGeometryCache::acquire(const Light* pLight, unsigned int lightVersion, const ConvexHull* pHull, unsigned int hullVersion)
+{
+  Key key(pLight, pHull);
+
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash>::iterator it = entryMap.find(key);
+
+  Entry* pEntry;
+
+  if(it == entryMap.end())
+  {
+    entries.push_front(Entry());
+
+    pEntry = &entries.front();
+    pEntry->pLight = pLight;
+    pEntry->pHull = pHull;
+    pEntry->upToDate = false;
+    pEntry->bytes = 0;
+
+    entryMap[key] = entries.begin();
+
+    link(pEntry);
+  }
+  else
+  {
+    pEntry = &*it->second;
+
+    if(pEntry->frame == frame)
+      return NULL;
+
+    // Most recently used goes first
+    entries.splice(entries.begin(), entries, it->second);
+
+    if(pEntry->lightVersion != lightVersion || pEntry->hullVersion != hullVersion)
+      pEntry->upToDate = false;
+  }
+
+  pEntry->lightVersion = lightVersion;
+  pEntry->hullVersion = hullVersion;
+  pEntry->frame = frame;
+
+  acquiredEntries.push_back(pEntry);
+
+  return pEntry;
+}
+
+void ShadowGeometryCache::trim()
+{
+  for(unsigned int i = 0; i < acquiredEntries.size(); i++)
+  {
+    Entry &entry = *acquiredEntries[i];
+
+    unsigned int bytes = getEntryBytes(entry);
+
+    memoryUsage = memoryUsage - entry.bytes + bytes;
+    entry.bytes = bytes;
+  }
+
+  acquiredEntries.clear();
+
+  while(memoryUsage > budget && !entries.empty())
+    evict(--entries.end());
+}
+
+void ShadowGeometryCache::removeLight(const Light* pLight)
+{
+  std::unordered_map<const Light*, Entry*>::iterator it = lightEntries.find(pLight);
+
+  if(it == lightEntries.end())
+    return;
+
+  // Evicting unlinks the entry, so the next one is read first
+  for(Entry* pEntry = it->second; pEntry != NULL;)
+  {
+    Entry* pNext = pEntry->pNextOfLight;
+
+    evict(entryMap.find(Key(pEntry->pLight, pEntry->pHull))->second);
+
+    pEntry = pNext;
+  }
+}
+
+void ShadowGeometryCache::removeHull(const ConvexHull* pHull)
+{
+  std::unordered_map<const ConvexHull*, Entry*>::iterator it = hullEntries.find(pHull);
+
+  if(it == hullEntries.end())
+    return;
+
+  for(Entry* pEntry = it->second; pEntry != NULL;)
+  {
+    Entry* pNext = pEntry->pNextOfHull;
+
+    evict(entryMap.find(Key(pEntry->pLight, pEntry->pHull))->second);
+
+    pEntry = pNext;
+  }
+}
+
+void ShadowGeometryCache::clear()
+{
+  entries.clear();
+  entryMap.clear();
+  lightEntries.clear();
+  hullEntries.clear();
+  acquiredEntries.clear();
+
+  memoryUsage = 0;
+}
+
+void ShadowGeometryCache::setBudget(unsigned int bytes)
+{
+  budget = bytes;
+
+  while(memoryUsage > budget && !entries.empty())
+    evict(--entries.end());
+}
+
+unsigned int ShadowGeometryCache::getBudget() const
+{
+  return budget;
+}
+
+unsigned int ShadowGeometryCache::getMemoryUsage() const
+{
+  return memoryUsage;
+}
+
+unsigned int ShadowGeometryCache::getNumEntries() const
+{
+  return entries.size();
+}
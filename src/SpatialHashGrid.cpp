@@ -0,0 +1,301 @@
+#include "LTBL/SpatialHashGrid.h"
+
+#include "LTBL/SFML_OpenGL.h"
+
+#include <assert.h>
+#include <math.h>
+
+using namespace qdt;
+
+SpatialHashGrid::SpatialHashGrid(const AABB &startRegion, float gridCellSize)
+: cellSize(gridCellSize), freeChunk(-1), numOccupants(0)
+{
+  assert(cellSize > 0.0f);
+
+  setRegion(startRegion);
+}
+
+void SpatialHashGrid::setRegion(const AABB &newRegion)
+{
+  region = newRegion;
+
+  Vec2f dims = region.getDims();
+
+  // Counted in floats and capped before converting, so that huge regions or NaN can't overflow the int
+  float cellsX = ceilf(dims.x / cellSize);
+  float cellsY = ceilf(dims.y / cellSize);
+
+  numCellsX = !(cellsX >= 1.0f) ? 1 : (cellsX > MaxGridCellsPerAxis ? MaxGridCellsPerAxis : static_cast<int>(cellsX));
+  numCellsY = !(cellsY >= 1.0f) ? 1 : (cellsY > MaxGridCellsPerAxis ? MaxGridCellsPerAxis : static_cast<int>(cellsY));
+
+  cellHeads.assign(numCellsX * numCellsY, -1);
+
+  chunks.clear();
+  freeChunk = -1;
+}
+
+int SpatialHashGrid::getCell(float offset, int numCells) const
+{
+  float cell = floorf(offset / cellSize);
+
+  // Clamp before converting, anything outside ends up in the border cells. The first test also catches NaN.
+  if(!(cell > 0.0f))
+    return 0;
+
+  if(cell >= numCells - 1)
+    return numCells - 1;
+
+  return static_cast<int>(cell);
+}
+
+void SpatialHashGrid::getCellRange(const AABB &aabb, Point2i &lowerCell, Point2i &upperCell) const
+{
+  lowerCell.x = getCell(aabb.lowerBound.x - region.lowerBound.x, numCellsX);
+  lowerCell.y = getCell(aabb.lowerBound.y - region.lowerBound.y, numCellsY);
+  upperCell.x = getCell(aabb.upperBound.x - region.lowerBound.x, numCellsX);
+  upperCell.y = getCell(aabb.upperBound.y - region.lowerBound.y, numCellsY);
+}
+
+void SpatialHashGrid::addToCell(int cellIndex, int proxyId)
+{
+  int head = cellHeads[cellIndex];
+
+  // Start a new head chunk once the current one is full
+  if(head == -1 || chunks[head].numProxies == static_cast<int>(GridChunkSize))
+  {
+    int chunkIndex;
+
+    if(freeChunk != -1)
+    {
+      chunkIndex = freeChunk;
+      freeChunk = chunks[chunkIndex].next;
+    }
+    else
+    {
+      chunkIndex = chunks.size();
+
+      chunks.push_back(SpatialHashGridChunk());
+    }
+
+    chunks[chunkIndex].numProxies = 0;
+    chunks[chunkIndex].next = head;
+
+    cellHeads[cellIndex] = head = chunkIndex;
+  }
+
+  SpatialHashGridChunk &chunk = chunks[head];
+
+  chunk.proxyIds[chunk.numProxies++] = proxyId;
+}
+
+void SpatialHashGrid::removeFromCell(int cellIndex, int proxyId)
+{
+  SpatialHashGridChunk &head = chunks[cellHeads[cellIndex]];
+
+  // Cells are short, so a linear search followed by a swap with the last id of the head chunk is fine
+  for(int chunkIndex = cellHeads[cellIndex]; chunkIndex != -1; chunkIndex = chunks[chunkIndex].next)
+  {
+    SpatialHashGridChunk &chunk = chunks[chunkIndex];
+
+    for(int i = 0; i < chunk.numProxies; i++)
+      if(chunk.proxyIds[i] == proxyId)
+      {
+        chunk.proxyIds[i] = head.proxyIds[--head.numProxies];
+
+        // An empty head chunk goes back to the free list
+        if(head.numProxies == 0)
+        {
+          int headIndex = cellHeads[cellIndex];
+
+          cellHeads[cellIndex] = head.next;
+
+          head.next = freeChunk;
+          freeChunk = headIndex;
+        }
+
+        return;
+      }
+  }
+
+  assert(false);
+}
+
+void SpatialHashGrid::insertProxy(int proxyId)
+{
+  SpatialHashGridProxy &proxy = proxies[proxyId];
+
+  getCellRange(proxy.aabb, proxy.lowerCell, proxy.upperCell);
+
+  for(int y = proxy.lowerCell.y; y <= proxy.upperCell.y; y++)
+    for(int x = proxy.lowerCell.x; x <= proxy.upperCell.x; x++)
+      addToCell(y * numCellsX + x, proxyId);
+}
+
+void SpatialHashGrid::removeProxy(int proxyId)
+{
+  const SpatialHashGridProxy &proxy = proxies[proxyId];
+
+  for(int y = proxy.lowerCell.y; y <= proxy.upperCell.y; y++)
+    for(int x = proxy.lowerCell.x; x <= proxy.upperCell.x; x++)
+      removeFromCell(y * numCellsX + x, proxyId);
+}
+
+void SpatialHashGrid::addOccupant(QuadTreeOccupant* pOc)
+{
+  int proxyId;
+
+  if(freeProxies.empty())
+  {
+    proxyId = proxies.size();
+
+    proxies.push_back(SpatialHashGridProxy());
+  }
+  else
+  {
+    proxyId = freeProxies.back();
+
+    freeProxies.pop_back();
+  }
+
+  proxies[proxyId].pOccupant = pOc;
+  proxies[proxyId].aabb = pOc->aabb;
+
+  pOc->pSpatialIndex = this;
+  pOc->pQuadTreeNode = NULL;
+  pOc->proxyId = proxyId;
+
+  insertProxy(proxyId);
+
+  numOccupants++;
+}
+
+void SpatialHashGrid::applyUpdate(QuadTreeOccupant* pOc)
+{
+  int proxyId = pOc->proxyId;
+
+  assert(proxyId != -1 && proxies[proxyId].pOccupant == pOc);
+
+  SpatialHashGridProxy &proxy = proxies[proxyId];
+
+  Point2i lowerCell;
+  Point2i upperCell;
+
+  getCellRange(pOc->aabb, lowerCell, upperCell);
+
+  // Only touch the cells if the range changed
+  if(lowerCell == proxy.lowerCell && upperCell == proxy.upperCell)
+  {
+    proxy.aabb = pOc->aabb;
+
+    return;
+  }
+
+  removeProxy(proxyId);
+
+  proxy.aabb = pOc->aabb;
+
+  insertProxy(proxyId);
+}
+
+void SpatialHashGrid::removeOccupant(QuadTreeOccupant* pOc)
+{
+  int proxyId = pOc->proxyId;
+
+  assert(proxyId != -1 && proxies[proxyId].pOccupant == pOc);
+
+  removeProxy(proxyId);
+
+  proxies[proxyId].pOccupant = NULL;
+  freeProxies.push_back(proxyId);
+
+  pOc->proxyId = -1;
+
+  numOccupants--;
+}
+
+void SpatialHashGrid::clearTree(const AABB &newStartRegion)
+{
+  setRegion(newStartRegion);
+
+  proxies.clear();
+  freeProxies.clear();
+
+  numOccupants = 0;
+
+  // Pending updates refer to the old grid
+  clearDirtyOccupants();
+}
+
+void SpatialHashGrid::query(const AABB &queryRegion, std::vector<QuadTreeOccupant*> &queryResult) const
+{
+  query(queryRegion, QueryResultAppender(queryResult));
+}
+
+bool SpatialHashGrid::visit(const AABB &queryRegion, QueryVisitor &visitor) const
+{
+  return query(queryRegion, QueryVisitorAdapter(visitor));
+}
+
+void SpatialHashGrid::querySector(const Sector &sector, std::vector<QuadTreeOccupant*> &queryResult) const
+{
+  QueryResultAppender appender(queryResult);
+
+  queryShape(sector, sector.getAABB(), appender);
+}
+
+void SpatialHashGrid::queryPolygon(const ConvexPolygon &polygon, std::vector<QuadTreeOccupant*> &queryResult) const
+{
+  QueryResultAppender appender(queryResult);
+
+  queryShape(polygon, polygon.getAABB(), appender);
+}
+
+bool SpatialHashGrid::visitSegment(const Segment &segment, QueryVisitor &visitor) const
+{
+  QueryVisitorAdapter adapter(visitor);
+
+  return queryShape(segment, segment.getAABB(), adapter);
+}
+
+unsigned int SpatialHashGrid::getNumOccupants() const
+{
+  return numOccupants;
+}
+
+void SpatialHashGrid::collectStats(SpatialIndexStats &stats) const
+{
+  stats.numNodes = cellHeads.size();
+  stats.occupantsPerDepth.push_back(numOccupants);
+
+  for(unsigned int i = 0; i < proxies.size(); i++)
+    if(proxies[i].pOccupant != NULL && !(proxies[i].lowerCell == proxies[i].upperCell))
+      stats.numStraddling++;
+}
+
+float SpatialHashGrid::getCellSize() const
+{
+  return cellSize;
+}
+
+void SpatialHashGrid::debugRender()
+{
+  // Render the occupied cells
+  glColor4f(0.7f, 0.1f, 0.5f, 1.0f);
+
+  for(int y = 0; y < numCellsY; y++)
+    for(int x = 0; x < numCellsX; x++)
+      if(cellHeads[y * numCellsX + x] != -1)
+      {
+        Vec2f lowerBound(region.lowerBound.x + x * cellSize, region.lowerBound.y + y * cellSize);
+
+        AABB(lowerBound, lowerBound + Vec2f(cellSize, cellSize)).debugRender();
+      }
+
+  glColor4f(0.3f, 0.5f, 0.5f, 1.0f);
+
+  for(unsigned int i = 0; i < proxies.size(); i++)
+    if(proxies[i].pOccupant != NULL)
+      proxies[i].aabb.debugRender();
+
+  glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+}
@@ -0,0 +1,181 @@
+#include "LTBL/SpatialIndex.h"
+
+#include "LTBL/QuadTree.h"
+#include "LTBL/DynamicAABBTree.h"
+#include "LTBL/SpatialHashGrid.h"
+
+#include <assert.h>
+
+using namespace qdt;
+
+SpatialIndexStats::SpatialIndexStats()
+: numNodes(0), maxDepth(0), averageDepth(0.0f), numStraddling(0), numOutsideRoot(0),
+  numQueries(0), nodesVisited(0), boundsTests(0), hits(0)
+{
+}
+
+QueryCounters::QueryCounters()
+: numQueries(0), nodesVisited(0), boundsTests(0), hits(0)
+{
+}
+
+void QueryCounters::add(unsigned int queries, unsigned int nodes, unsigned int tests, unsigned int numHits)
+{
+  // Only the totals matter, so no ordering is needed
+  numQueries.fetch_add(queries, std::memory_order_relaxed);
+  nodesVisited.fetch_add(nodes, std::memory_order_relaxed);
+  boundsTests.fetch_add(tests, std::memory_order_relaxed);
+  hits.fetch_add(numHits, std::memory_order_relaxed);
+}
+
+void QueryCounters::reset()
+{
+  numQueries = 0;
+  nodesVisited = 0;
+  boundsTests = 0;
+  hits = 0;
+}
+
+QueryVisitor::~QueryVisitor()
+{
+}
+
+SpatialIndex::SpatialIndex()
+: deferUpdates(false)
+{
+}
+
+SpatialIndex::~SpatialIndex()
+{
+}
+
+void SpatialIndex::markDirty(QuadTreeOccupant* pOc)
+{
+  std::lock_guard<std::mutex> lock(dirtyMutex);
+
+  if(pOc->dirty)
+    return;
+
+  pOc->dirty = true;
+  pOc->dirtyIndex = dirtyOccupants.size();
+
+  dirtyOccupants.push_back(pOc);
+}
+
+void SpatialIndex::unmarkDirty(QuadTreeOccupant* pOc)
+{
+  std::lock_guard<std::mutex> lock(dirtyMutex);
+
+  assert(pOc->dirty && dirtyOccupants[pOc->dirtyIndex] == pOc);
+
+  // Swap-and-pop
+  dirtyOccupants[pOc->dirtyIndex] = dirtyOccupants.back();
+  dirtyOccupants[pOc->dirtyIndex]->dirtyIndex = pOc->dirtyIndex;
+  dirtyOccupants.pop_back();
+
+  pOc->dirty = false;
+}
+
+void SpatialIndex::clearDirtyOccupants()
+{
+  for(unsigned int i = 0; i < dirtyOccupants.size(); i++)
+    dirtyOccupants[i]->dirty = false;
+
+  dirtyOccupants.clear();
+}
+
+void SpatialIndex::updateOccupant(QuadTreeOccupant* pOc)
+{
+  if(deferUpdates)
+    markDirty(pOc);
+  else
+    applyUpdate(pOc);
+}
+
+void SpatialIndex::buildFromBulkOccupants()
+{
+  for(unsigned int i = 0; i < bulkOccupants.size(); i++)
+    addOccupant(bulkOccupants[i]);
+
+  bulkOccupants.clear();
+}
+
+void SpatialIndex::setDeferredUpdates(bool defer)
+{
+  if(deferUpdates && !defer)
+    commitUpdates();
+
+  deferUpdates = defer;
+}
+
+bool SpatialIndex::getDeferredUpdates() const
+{
+  return deferUpdates;
+}
+
+void SpatialIndex::commitUpdates()
+{
+  for(unsigned int i = 0; i < dirtyOccupants.size(); i++)
+  {
+    dirtyOccupants[i]->dirty = false;
+
+    applyUpdate(dirtyOccupants[i]);
+  }
+
+  dirtyOccupants.clear();
+}
+
+unsigned int SpatialIndex::getNumDirtyOccupants() const
+{
+  std::lock_guard<std::mutex> lock(dirtyMutex);
+
+  return dirtyOccupants.size();
+}
+
+SpatialIndexStats SpatialIndex::getStats() const
+{
+  SpatialIndexStats stats;
+
+  collectStats(stats);
+
+  unsigned int numCounted = 0;
+  float depthSum = 0.0f;
+
+  for(unsigned int depth = 0; depth < stats.occupantsPerDepth.size(); depth++)
+  {
+    numCounted += stats.occupantsPerDepth[depth];
+    depthSum += static_cast<float>(depth) * stats.occupantsPerDepth[depth];
+  }
+
+  if(numCounted > 0)
+    stats.averageDepth = depthSum / numCounted;
+
+  stats.numQueries = queryCounters.numQueries;
+  stats.nodesVisited = queryCounters.nodesVisited;
+  stats.boundsTests = queryCounters.boundsTests;
+  stats.hits = queryCounters.hits;
+
+  return stats;
+}
+
+void SpatialIndex::resetQueryCounters() const
+{
+  queryCounters.reset();
+}
+
+SpatialIndex* qdt::createSpatialIndex(SpatialIndexType type, const AABB &startRegion)
+{
+  switch(type)
+  {
+  case SpatialIndexQuadTree:
+    return new QuadTree(startRegion);
+  case SpatialIndexLooseQuadTree:
+    return new QuadTree(startRegion, true);
+  case SpatialIndexDynamicAABBTree:
+    return new DynamicAABBTree();
+  case SpatialIndexHashGrid:
+    return new SpatialHashGrid(startRegion);
+  }
+
+  return NULL;
+}
@@ -0,0 +1,193 @@
+// Tests of BasicQuadTree: random inserts, updates and removes, with every query checked against a brute force search.
+
+#include "LTBL/BasicQuadTree.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+using namespace qdt;
+
+namespace
+{
+const float WorldSize = 1000.0f;
+
+// Values are indices into a list of boxes
+struct BoxBounds {
+  const std::vector<AABB>* pBoxes;
+
+  BoxBounds(const std::vector<AABB>* pBoxList = NULL)
+  : pBoxes(pBoxList)
+  {
+  }
+
+  AABB operator()(unsigned int value) const
+  {
+    return (*pBoxes)[value];
+  }
+};
+
+// Mostly small boxes in the region, some large ones and some partly or fully outside of it
+AABB createBox(unsigned int &seed)
+{
+  Vec2f lower(test::random(seed, -200.0f, WorldSize + 100.0f), test::random(seed, -200.0f, WorldSize + 100.0f));
+  float size = test::randomIndex(seed, 10) == 0 ? test::random(seed, 400.0f) : test::random(seed, 15.0f);
+
+  return AABB(lower, lower + Vec2f(size, test::random(seed, 15.0f)));
+}
+
+template<class Tree> bool checkQueries(const Tree &tree, const std::vector<AABB> &boxes, const std::vector<int> &handles, unsigned int &seed)
+{
+  unsigned int numLive = 0;
+
+  for(unsigned int i = 0; i < handles.size(); i++)
+    if(handles[i] != -1)
+    {
+      numLive++;
+
+      if(tree.get(handles[i]) != i)
+      {
+        std::cerr << "Handle " << handles[i] << " holds " << tree.get(handles[i]) << " instead of " << i << std::endl;
+
+        return false;
+      }
+    }
+
+  if(tree.getNumOccupants() != numLive)
+  {
+    std::cerr << "The tree counts " << tree.getNumOccupants() << " values, but holds " << numLive << std::endl;
+
+    return false;
+  }
+
+  for(unsigned int q = 0; q < 50; q++)
+  {
+    Vec2f lower(test::random(seed, -300.0f, WorldSize + 100.0f), test::random(seed, -300.0f, WorldSize + 100.0f));
+    AABB region(lower, lower + Vec2f(test::random(seed, 1.0f, 300.0f), test::random(seed, 1.0f, 300.0f)));
+
+    std::vector<unsigned int> result;
+    tree.query(region, result);
+
+    std::vector<unsigned int> expected;
+
+    for(unsigned int i = 0; i < handles.size(); i++)
+      if(handles[i] != -1 && boxes[i].intersects(region))
+        expected.push_back(i);
+
+    std::sort(result.begin(), result.end());
+
+    if(result != expected)
+    {
+      std::cerr << "A query found " << result.size() << " values, the brute force " << expected.size() << std::endl;
+
+      return false;
+    }
+
+    // Stopping at the first value
+    unsigned int numVisited = 0;
+    bool completed = tree.query(region, [&](unsigned int) { numVisited++; return false; });
+
+    if(completed != expected.empty() || numVisited != (expected.empty() ? 0u : 1u))
+    {
+      std::cerr << "A stopped query visited " << numVisited << " values and returned " << completed << std::endl;
+
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Small nodes and few levels split, merge and fill the deepest level far more often than the defaults
+template<unsigned int MaxOccupants, unsigned int MaxLevels> bool testRandomOperations(unsigned int seed)
+{
+  std::vector<AABB> boxes;
+  std::vector<int> handles;
+
+  BasicQuadTree<unsigned int, BoxBounds, MaxOccupants, MaxLevels> tree(AABB(Vec2f(0.0f, 0.0f), Vec2f(WorldSize, WorldSize)), BoxBounds(&boxes));
+
+  for(unsigned int round = 0; round < 40; round++)
+  {
+    // Grows to about 1500 values over the first half, then shrinks again
+    unsigned int numInserts = round < 20 ? 100 : 20;
+    unsigned int numRemoves = round < 20 ? 20 : 90;
+
+    for(unsigned int i = 0; i < numInserts; i++)
+    {
+      boxes.push_back(createBox(seed));
+      handles.push_back(tree.insert(boxes.size() - 1));
+    }
+
+    for(unsigned int i = 0; i < 100; i++)
+    {
+      unsigned int index = test::randomIndex(seed, boxes.size());
+
+      if(handles[index] == -1)
+        continue;
+
+      // Small moves mostly stay in the node, new boxes mostly don't
+      if(i % 2 == 0)
+        boxes[index].incCenter(Vec2f(test::random(seed, -2.0f, 2.0f), test::random(seed, -2.0f, 2.0f)));
+      else
+        boxes[index] = createBox(seed);
+
+      tree.update(handles[index]);
+    }
+
+    for(unsigned int i = 0; i < numRemoves; i++)
+    {
+      unsigned int index = test::randomIndex(seed, boxes.size());
+
+      if(handles[index] == -1)
+        continue;
+
+      tree.remove(handles[index]);
+      handles[index] = -1;
+    }
+
+    if(!checkQueries(tree, boxes, handles, seed))
+    {
+      std::cerr << "Round " << round << " with at most " << MaxOccupants << " values per node and " << MaxLevels << " levels" << std::endl;
+
+      return false;
+    }
+  }
+
+  // Handles of removed values are reused, every box so far got a handle of its own
+  boxes.push_back(createBox(seed));
+  handles.push_back(tree.insert(boxes.size() - 1));
+
+  if(static_cast<unsigned int>(handles.back()) >= boxes.size() - 1)
+  {
+    std::cerr << "A new value got the unused handle " << handles.back() << std::endl;
+
+    return false;
+  }
+
+  tree.clear(AABB(Vec2f(0.0f, 0.0f), Vec2f(WorldSize, WorldSize)));
+
+  handles.assign(boxes.size(), -1);
+
+  return checkQueries(tree, boxes, handles, seed);
+}
+}
+
+int main()
+{
+  bool passed = true;
+
+  if(!testRandomOperations<MaximumOccupants, MaxLevels>(1))
+    passed = false;
+
+  if(!testRandomOperations<1, 3>(2))
+    passed = false;
+
+  if(!testRandomOperations<2, 12>(3))
+    passed = false;
+
+  if(passed)
+    std::cout << "All basic quad tree tests passed" << std::endl;
+
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+// Times intersectBounds against calling AABB::intersects on every box, for full and partial batches.
+// Uses the kernel picked by LIGHT_SIMD. Not run by ctest, run it by hand on a release build.
+
+#include "LTBL/BoundsIntersect.h"
+#include "TestUtils.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace qdt;
+
+namespace
+{
+const unsigned int NumBatches = 4096;
+const unsigned int NumRepeats = 200;
+
+struct Batch {
+  float lowerX[BoundsBatchSize];
+  float lowerY[BoundsBatchSize];
+  float upperX[BoundsBatchSize];
+  float upperY[BoundsBatchSize];
+
+  AABB boxes[BoundsBatchSize];
+};
+
+void benchmark(const std::vector<Batch> &batches, const std::vector<AABB> &regions, unsigned int count)
+{
+  // Summed so that the compiler cannot drop the work
+  unsigned int kernelHits = 0;
+  unsigned int scalarHits = 0;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for(unsigned int r = 0; r < NumRepeats; r++)
+    for(unsigned int b = 0; b < batches.size(); b++)
+    {
+      const Batch &batch = batches[b];
+
+      kernelHits += bitCount(intersectBounds(batch.lowerX, batch.lowerY, batch.upperX, batch.upperY, count, regions[b]));
+    }
+
+  double kernelTime = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+
+  for(unsigned int r = 0; r < NumRepeats; r++)
+    for(unsigned int b = 0; b < batches.size(); b++)
+    {
+      const Batch &batch = batches[b];
+
+      for(unsigned int i = 0; i < count; i++)
+        if(batch.boxes[i].intersects(regions[b]))
+          scalarHits++;
+    }
+
+  double scalarTime = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  const double numCalls = static_cast<double>(NumRepeats) * batches.size();
+
+  std::cout << count << " boxes: intersectBounds " << kernelTime / numCalls << " ns, AABB::intersects " << scalarTime / numCalls
+            << " ns per batch, " << kernelHits / numCalls << " hits" << (kernelHits == scalarHits ? "" : ", hit counts DIFFER") << std::endl;
+}
+}
+
+int main()
+{
+#if defined(LTBL_SIMD_AVX)
+  std::cout << "AVX kernel" << std::endl;
+#elif defined(LTBL_SIMD_SSE2)
+  std::cout << "SSE2 kernel" << std::endl;
+#else
+  std::cout << "Scalar kernel" << std::endl;
+#endif
+
+  unsigned int seed = 1;
+
+  std::vector<Batch> batches(NumBatches);
+  std::vector<AABB> regions(NumBatches);
+
+  for(unsigned int b = 0; b < NumBatches; b++)
+  {
+    for(unsigned int i = 0; i < BoundsBatchSize; i++)
+    {
+      Vec2f lower(test::random(seed, 1000.0f), test::random(seed, 1000.0f));
+      AABB box(lower, lower + Vec2f(test::random(seed, 50.0f), test::random(seed, 50.0f)));
+
+      batches[b].lowerX[i] = box.lowerBound.x;
+      batches[b].lowerY[i] = box.lowerBound.y;
+      batches[b].upperX[i] = box.upperBound.x;
+      batches[b].upperY[i] = box.upperBound.y;
+      batches[b].boxes[i] = box;
+    }
+
+    Vec2f lower(test::random(seed, 1000.0f), test::random(seed, 1000.0f));
+    regions[b] = AABB(lower, lower + Vec2f(300.0f, 300.0f));
+  }
+
+  const unsigned int counts[] = { 4, 7, 13, 16, 29, 32 };
+
+  for(unsigned int i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    benchmark(batches, regions, counts[i]);
+
+  return 0;
+}
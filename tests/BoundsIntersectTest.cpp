@@ -0,0 +1,133 @@
+// Checks intersectBounds against AABB::intersects for every batch size, with NaN, infinite and touching bounds.
+// Built once per instruction set, see CMakeLists.txt, since the kernel is picked at compile time.
+
+#include "LTBL/BoundsIntersect.h"
+#include "TestUtils.h"
+
+#include <iostream>
+#include <limits>
+#include <string.h>
+
+using namespace qdt;
+
+namespace
+{
+const unsigned int NumBatches = 20000;
+
+const char* getKernelName()
+{
+#if defined(LTBL_SIMD_AVX)
+  return "AVX";
+#elif defined(LTBL_SIMD_SSE2)
+  return "SSE2";
+#else
+  return "scalar";
+#endif
+}
+
+// Mostly ordinary coordinates, some exactly on the region bounds and some NaN or infinite
+float randomCoordinate(unsigned int &seed, const AABB &region)
+{
+  switch(test::randomIndex(seed, 16))
+  {
+  case 0:
+    return std::numeric_limits<float>::quiet_NaN();
+  case 1:
+    return test::randomIndex(seed, 2) == 0 ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity();
+  case 2:
+    return region.lowerBound.x;
+  case 3:
+    return region.upperBound.y;
+  default:
+    return test::random(seed, -100.0f, 100.0f);
+  }
+}
+
+bool testBatches()
+{
+  unsigned int seed = 5;
+
+  // Room for the padding that intersectBounds may read past count
+  float lowerX[BoundsBatchSize + 4];
+  float lowerY[BoundsBatchSize + 4];
+  float upperX[BoundsBatchSize + 4];
+  float upperY[BoundsBatchSize + 4];
+
+  for(unsigned int b = 0; b < NumBatches; b++)
+  {
+    Vec2f regionLower(test::random(seed, -80.0f, 60.0f), test::random(seed, -80.0f, 60.0f));
+    AABB region(regionLower, regionLower + Vec2f(test::random(seed, 40.0f), test::random(seed, 40.0f)));
+
+    if(b % 50 == 0)
+      region.upperBound.x = std::numeric_limits<float>::quiet_NaN();
+
+    // Every count from 0 to the batch size, most of them not multiples of 4 or 8
+    const unsigned int count = b % (BoundsBatchSize + 1);
+
+    for(unsigned int i = 0; i < BoundsBatchSize + 4; i++)
+    {
+      lowerX[i] = randomCoordinate(seed, region);
+      lowerY[i] = randomCoordinate(seed, region);
+      upperX[i] = lowerX[i] + test::random(seed, 30.0f);
+      upperY[i] = lowerY[i] + test::random(seed, 30.0f);
+
+      // Boxes past count are garbage that has to be ignored, let some of them hit
+      if(i >= count && i % 2 == 0)
+      {
+        lowerX[i] = lowerY[i] = -std::numeric_limits<float>::infinity();
+        upperX[i] = upperY[i] = std::numeric_limits<float>::infinity();
+      }
+    }
+
+    unsigned int expected = 0;
+
+    for(unsigned int i = 0; i < count; i++)
+      if(AABB(Vec2f(lowerX[i], lowerY[i]), Vec2f(upperX[i], upperY[i])).intersects(region))
+        expected |= 1u << i;
+
+    unsigned int mask = intersectBounds(lowerX, lowerY, upperX, upperY, count, region);
+
+    if(mask != expected)
+    {
+      std::cerr << getKernelName() << " kernel, batch " << b << " of " << count << " boxes: mask " << std::hex << mask << ", AABB::intersects "
+                << expected << std::dec << std::endl;
+
+      return false;
+    }
+  }
+
+  return true;
+}
+}
+
+int main()
+{
+#if defined(LTBL_SIMD_AVX) && defined(__GNUC__)
+  if(!__builtin_cpu_supports("avx2"))
+  {
+    std::cout << "Skipped, the CPU has no AVX2" << std::endl;
+
+    return 0;
+  }
+#endif
+
+  bool passed = true;
+
+  // Set by CMakeLists.txt, so that a kernel quietly falling back to another one fails
+#ifdef EXPECTED_KERNEL
+  if(strcmp(getKernelName(), EXPECTED_KERNEL) != 0)
+  {
+    std::cerr << "Built with the " << getKernelName() << " kernel, expected " << EXPECTED_KERNEL << std::endl;
+
+    passed = false;
+  }
+#endif
+
+  if(!testBatches())
+    passed = false;
+
+  if(passed)
+    std::cout << "All intersectBounds tests passed with the " << getKernelName() << " kernel" << std::endl;
+
+  return passed ? 0 : 1;
+}
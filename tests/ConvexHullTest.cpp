@@ -0,0 +1,511 @@
+// Tests of the hull geometry against brute force versions working on the world vertices, and of the world vertices themselves
+
+#include "LTBL/ConvexHull.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <vector>
+
+using namespace ltbl;
+
+namespace
+{
+// Hulls with at least this many vertices use the binary search of findSilhouette
+const unsigned int SilhouetteSearchVertices = 64;
+
+bool isBackFacing(const std::vector<unsigned int> &mask, unsigned int edge)
+{
+  return ((mask[edge / 32] >> (edge % 32)) & 1) != 0;
+}
+
+// Scans all vertices for the boundaries of the classifyEdges mask. Keeps the last ones met going from vertex 1 around to vertex 0,
+// like findSilhouette does for small hulls, and returns how many boundaries there are.
+unsigned int scanBoundries(const ConvexHull &hull, const std::vector<unsigned int> &mask, int &first, int &second)
+{
+  const unsigned int numVertices = hull.vertices.size();
+
+  unsigned int numBoundries = 0;
+
+  for(unsigned int i = 1; i <= numVertices; i++)
+  {
+    unsigned int vertex = i % numVertices;
+
+    bool previous = isBackFacing(mask, i - 1);
+    bool current = isBackFacing(mask, vertex);
+
+    if(previous && !current)
+    {
+      first = vertex;
+      numBoundries++;
+    }
+    else if(!previous && current)
+    {
+      second = vertex;
+      numBoundries++;
+    }
+  }
+
+  return numBoundries;
+}
+
+bool isBoundry(const ConvexHull &hull, const std::vector<unsigned int> &mask, int vertex, bool entering)
+{
+  const unsigned int numVertices = hull.vertices.size();
+
+  if(vertex < 0 || vertex >= static_cast<int>(numVertices))
+    return false;
+
+  bool previous = isBackFacing(mask, (vertex + numVertices - 1) % numVertices);
+  bool current = isBackFacing(mask, vertex);
+
+  return entering ? previous && !current : !previous && current;
+}
+
+// The binary search of findSilhouette has to find the boundaries of classifyEdges on large convex hulls of either winding,
+// rotated and scaled. A light larger than the hull can make the classification turn more than twice, the documented case
+// where the pair found may differ. It must still be a pair of boundaries.
+bool testFindSilhouette()
+{
+  unsigned int seed = 11;
+
+  std::vector<unsigned int> scratch;
+  std::vector<unsigned int> mask;
+
+  unsigned int numManyBoundries = 0;
+  unsigned int numDiffering = 0;
+
+  for(unsigned int t = 0; t < 20000; t++)
+  {
+    const unsigned int numVertices = SilhouetteSearchVertices + test::randomIndex(seed, t % 2 == 0 ? 64 : 1000);
+    const bool counterClockwise = t % 4 < 2;
+    const float radius = test::random(seed, 20.0f, 100.0f);
+
+    ConvexHull* pHull = test::createHull(seed, numVertices, radius, counterClockwise);
+
+    // Every tenth hull is squashed and gets a light larger than it
+    const bool largeLight = t % 10 == 0;
+
+    if(largeLight)
+    {
+      const float aspect = test::random(seed, 2.0f, 8.0f);
+
+      for(unsigned int i = 0; i < numVertices; i++)
+        pHull->vertices[i].position.y /= aspect;
+
+      pHull->calculateNormals();
+      pHull->generateAABB();
+    }
+
+    pHull->setWorldCenter(Vec2f(test::random(seed, -500.0f, 500.0f), test::random(seed, -500.0f, 500.0f)));
+    pHull->setRotation(test::random(seed, -7.0f, 7.0f));
+    pHull->setScale(test::random(seed, 0.25f, 4.0f));
+
+    const float worldRadius = radius * pHull->getScale();
+
+    // Mostly lights outside the hull, some inside
+    Vec2f offset(test::random(seed, -1.0f, 1.0f), test::random(seed, -1.0f, 1.0f));
+    Vec2f lightCenter = pHull->getWorldCenter() + offset * worldRadius * (t % 7 == 0 ? 0.5f : test::random(seed, 1.5f, 10.0f));
+    float lightSize = largeLight ? worldRadius * test::random(seed, 1.0f, 4.0f) : test::random(seed, worldRadius * 0.2f);
+
+    mask.assign(pHull->getNumEdgeMaskWords(), 0);
+    pHull->classifyEdges(lightCenter, lightSize, &mask[0]);
+
+    int expectedFirst = 0, expectedSecond = 0;
+    unsigned int numBoundries = scanBoundries(*pHull, mask, expectedFirst, expectedSecond);
+
+    int first = -1, second = -1;
+    pHull->findSilhouette(lightCenter, lightSize, scratch, first, second);
+
+    if(numBoundries <= 2)
+    {
+      if(first != expectedFirst || second != expectedSecond)
+      {
+        std::cerr << "findSilhouette found " << first << ", " << second << " on a hull with " << numVertices << " vertices, the edge classification "
+                  << expectedFirst << ", " << expectedSecond << std::endl;
+
+        delete pHull;
+
+        return false;
+      }
+    }
+    else
+    {
+      numManyBoundries++;
+
+      if(first != expectedFirst || second != expectedSecond)
+        numDiffering++;
+
+      if(!isBoundry(*pHull, mask, first, true) || !isBoundry(*pHull, mask, second, false))
+      {
+        std::cerr << "findSilhouette found " << first << ", " << second << ", which are not boundaries of the edge classification" << std::endl;
+
+        delete pHull;
+
+        return false;
+      }
+    }
+
+    delete pHull;
+  }
+
+  // Make sure that the random lights do reach the documented case
+  if(numDiffering == 0)
+  {
+    std::cerr << "No light made findSilhouette differ from the edge classification, of " << numManyBoundries << " with more than two boundaries" << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+
+// Cross product of b - a and c - a, in double so that the brute force versions don't share the rounding of the hull
+double cross(const Vec2f &a, const Vec2f &b, const Vec2f &c)
+{
+  return (static_cast<double>(b.x) - a.x) * (static_cast<double>(c.y) - a.y) - (static_cast<double>(b.y) - a.y) * (static_cast<double>(c.x) - a.x);
+}
+
+float getDistanceToSegment(const Vec2f &point, const Vec2f &a, const Vec2f &b)
+{
+  Vec2f ab(b - a);
+
+  float lengthSquared = ab.dot(ab);
+  float t = lengthSquared == 0.0f ? 0.0f : std::max(0.0f, std::min(1.0f, (point - a).dot(ab) / lengthSquared));
+
+  return (a + ab * t - point).magnitude();
+}
+
+// Strictly inside, on the inner side of every edge
+bool isInside(const ConvexHull &hull, const Vec2f &point, bool counterClockwise)
+{
+  const unsigned int numVertices = hull.vertices.size();
+
+  for(unsigned int i = 0; i < numVertices; i++)
+  {
+    double side = cross(hull.getWorldVertex(i), hull.getWorldVertex((i + 1) % numVertices), point);
+
+    if(counterClockwise ? side <= 0.0 : side >= 0.0)
+      return false;
+  }
+
+  return true;
+}
+
+// Intersects the segment with every edge of the world polygon and keeps the crossing nearest to from
+bool crossEdges(const ConvexHull &hull, const Vec2f &from, const Vec2f &to, double &fraction, unsigned int &edge)
+{
+  const unsigned int numVertices = hull.vertices.size();
+
+  bool crossed = false;
+
+  for(unsigned int i = 0; i < numVertices; i++)
+  {
+    Vec2f a(hull.getWorldVertex(i));
+    Vec2f b(hull.getWorldVertex((i + 1) % numVertices));
+
+    // from + t * (to - from) = a + s * (b - a)
+    double denominator = cross(Vec2f(0.0f, 0.0f), to - from, b - a);
+
+    if(denominator == 0.0)
+      continue;
+
+    double t = cross(Vec2f(0.0f, 0.0f), a - from, b - a) / denominator;
+    double s = cross(Vec2f(0.0f, 0.0f), a - from, to - from) / denominator;
+
+    if(t >= 0.0 && t <= 1.0 && s >= 0.0 && s <= 1.0 && (!crossed || t < fraction))
+    {
+      crossed = true;
+      fraction = t;
+      edge = i;
+    }
+  }
+
+  return crossed;
+}
+
+// Whether the segment comes close enough to a vertex, or starts or ends close enough to an edge, that rounding decides
+// whether it hits, or which edge it enters through
+bool isNearBoundary(const ConvexHull &hull, const Vec2f &from, const Vec2f &to, float tolerance)
+{
+  const unsigned int numVertices = hull.vertices.size();
+
+  for(unsigned int i = 0; i < numVertices; i++)
+  {
+    Vec2f a(hull.getWorldVertex(i));
+    Vec2f b(hull.getWorldVertex((i + 1) % numVertices));
+
+    if(getDistanceToSegment(a, from, to) < tolerance || getDistanceToSegment(from, a, b) < tolerance || getDistanceToSegment(to, a, b) < tolerance)
+      return true;
+  }
+
+  return false;
+}
+
+// Clipping the segment against the edges has to agree with intersecting it with each edge: the same hulls are hit,
+// at the same fraction and through the same edge. Segments that start inside hit at 0 without a normal.
+bool testIntersectSegment()
+{
+  unsigned int seed = 5;
+
+  unsigned int numHits = 0;
+  unsigned int numInside = 0;
+  unsigned int numMisses = 0;
+
+  for(unsigned int t = 0; t < 20000; t++)
+  {
+    const unsigned int numVertices = 3 + test::randomIndex(seed, t % 2 == 0 ? 8 : 100);
+    const bool counterClockwise = t % 4 < 2;
+    const float radius = test::random(seed, 5.0f, 100.0f);
+
+    ConvexHull* pHull = test::createHull(seed, numVertices, radius, counterClockwise);
+
+    pHull->setWorldCenter(Vec2f(test::random(seed, -500.0f, 500.0f), test::random(seed, -500.0f, 500.0f)));
+
+    if(t % 3 != 0)
+    {
+      pHull->setRotation(test::random(seed, -7.0f, 7.0f));
+      pHull->setScale(test::random(seed, 0.25f, 4.0f));
+    }
+
+    const float worldRadius = radius * pHull->getScale();
+    const Vec2f center(pHull->getWorldCenter());
+
+    // Segments of all lengths around the hull, some starting near its center
+    float fromRange = t % 5 == 0 ? worldRadius * 0.5f : worldRadius * 3.0f;
+    float toRange = worldRadius * (t % 2 == 0 ? 3.0f : 0.5f);
+
+    Vec2f from(center + Vec2f(test::random(seed, -fromRange, fromRange), test::random(seed, -fromRange, fromRange)));
+    Vec2f to(center + Vec2f(test::random(seed, -toRange, toRange), test::random(seed, -toRange, toRange)));
+
+    if(isNearBoundary(*pHull, from, to, worldRadius * 0.001f))
+    {
+      delete pHull;
+
+      continue;
+    }
+
+    bool expectedHit = true;
+    double expectedFraction = 0.0;
+    Vec2f expectedNormal(0.0f, 0.0f);
+
+    unsigned int edge = 0;
+
+    if(isInside(*pHull, from, counterClockwise))
+      numInside++;
+    else if(crossEdges(*pHull, from, to, expectedFraction, edge))
+    {
+      Vec2f side(pHull->getWorldVertex((edge + 1) % numVertices) - pHull->getWorldVertex(edge));
+
+      expectedNormal = (counterClockwise ? Vec2f(side.y, -side.x) : Vec2f(-side.y, side.x)).normalize();
+
+      numHits++;
+    }
+    else
+    {
+      expectedHit = false;
+
+      numMisses++;
+    }
+
+    float fraction = -1.0f;
+    Vec2f normal(-1.0f, -1.0f);
+
+    bool hit = pHull->intersectSegment(from, to, fraction, normal);
+
+    if(hit != expectedHit || (hit && (fabs(fraction - expectedFraction) > 1e-4 || (normal - expectedNormal).magnitude() > 1e-3f)))
+    {
+      std::cerr << "intersectSegment gave " << (hit ? "a hit" : "no hit") << " at " << fraction << " with the normal (" << normal.x << ", " << normal.y << ") on a hull with "
+                << numVertices << " vertices, the edges " << (expectedHit ? "a hit" : "no hit") << " at " << expectedFraction
+                << " with the normal (" << expectedNormal.x << ", " << expectedNormal.y << ")" << std::endl;
+
+      delete pHull;
+
+      return false;
+    }
+
+    delete pHull;
+  }
+
+  // Make sure that every case came up often enough to mean something
+  if(numHits < 1000 || numInside < 1000 || numMisses < 1000)
+  {
+    std::cerr << "Only " << numHits << " hits, " << numInside << " segments starting inside and " << numMisses << " misses" << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+
+// Rotates and scales a local position or normal in double, and moves positions to the world center
+Vec2f transform(const ConvexHull &hull, const Vec2f &local, bool translate)
+{
+  double angle = hull.getRotation();
+  double scale = hull.getScale();
+
+  double x = (local.x * cos(angle) - local.y * sin(angle)) * scale;
+  double y = (local.x * sin(angle) + local.y * cos(angle)) * scale;
+
+  if(translate)
+  {
+    x += hull.getWorldCenter().x;
+    y += hull.getWorldCenter().y;
+  }
+
+  return Vec2f(static_cast<float>(x), static_cast<float>(y));
+}
+
+// Compares the world vertices, normals and AABB with transforming the local ones by hand
+bool checkWorldVertices(const ConvexHull &hull, float radius)
+{
+  const unsigned int numVertices = hull.vertices.size();
+
+  // Rounding of the float transform, relative to the size of the coordinates
+  const float tolerance = 1e-5f * (radius * hull.getScale() + hull.getWorldCenter().magnitude());
+
+  qdt::AABB expectedAABB(transform(hull, hull.vertices[0].position, true), transform(hull, hull.vertices[0].position, true));
+
+  for(unsigned int i = 0; i < numVertices; i++)
+  {
+    Vec2f expectedVertex(transform(hull, hull.vertices[i].position, true));
+    Vec2f expectedNormal(transform(hull, hull.normals[i], false));
+
+    if((hull.getWorldVertex(i) - expectedVertex).magnitude() > tolerance)
+    {
+      std::cerr << "World vertex " << i << " is (" << hull.getWorldVertex(i).x << ", " << hull.getWorldVertex(i).y << "), expected ("
+                << expectedVertex.x << ", " << expectedVertex.y << ")" << std::endl;
+
+      return false;
+    }
+
+    if((hull.getWorldNormal(i) - expectedNormal).magnitude() > 1e-5f * radius * hull.getScale())
+    {
+      std::cerr << "World normal " << i << " is (" << hull.getWorldNormal(i).x << ", " << hull.getWorldNormal(i).y << "), expected ("
+                << expectedNormal.x << ", " << expectedNormal.y << ")" << std::endl;
+
+      return false;
+    }
+
+    expectedAABB.lowerBound.x = std::min(expectedAABB.lowerBound.x, expectedVertex.x);
+    expectedAABB.lowerBound.y = std::min(expectedAABB.lowerBound.y, expectedVertex.y);
+    expectedAABB.upperBound.x = std::max(expectedAABB.upperBound.x, expectedVertex.x);
+    expectedAABB.upperBound.y = std::max(expectedAABB.upperBound.y, expectedVertex.y);
+  }
+
+  if((hull.aabb.lowerBound - expectedAABB.lowerBound).magnitude() > tolerance || (hull.aabb.upperBound - expectedAABB.upperBound).magnitude() > tolerance)
+  {
+    std::cerr << "The AABB is (" << hull.aabb.lowerBound.x << ", " << hull.aabb.lowerBound.y << ") to (" << hull.aabb.upperBound.x << ", " << hull.aabb.upperBound.y
+              << "), expected (" << expectedAABB.lowerBound.x << ", " << expectedAABB.lowerBound.y << ") to ("
+              << expectedAABB.upperBound.x << ", " << expectedAABB.upperBound.y << ")" << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+
+// Moving, turning and scaling hulls in any order has to keep the world vertices, normals and AABB equal to transforming
+// the local vertices by hand, and has to bump the transform version. So does changing the vertices themselves.
+bool testWorldVertices()
+{
+  unsigned int seed = 17;
+
+  for(unsigned int t = 0; t < 2000; t++)
+  {
+    const unsigned int numVertices = 3 + test::randomIndex(seed, t % 2 == 0 ? 8 : 300);
+    float radius = test::random(seed, 5.0f, 100.0f);
+
+    ConvexHull* pHull = test::createHull(seed, numVertices, radius, t % 4 < 2);
+
+    // Without rotation and scale the vertices are only moved
+    pHull->setWorldCenter(Vec2f(test::random(seed, -500.0f, 500.0f), test::random(seed, -500.0f, 500.0f)));
+
+    for(unsigned int i = 0; i < numVertices; i++)
+      if(!(pHull->getWorldVertex(i) == pHull->vertices[i].position + pHull->getWorldCenter()) || !(pHull->getWorldNormal(i) == pHull->normals[i]))
+      {
+        std::cerr << "World vertex " << i << " of a hull that was only moved is not its local vertex plus the center" << std::endl;
+
+        delete pHull;
+
+        return false;
+      }
+
+    for(unsigned int step = 0; step < 10; step++)
+    {
+      unsigned int version = pHull->getTransformVersion();
+
+      switch(test::randomIndex(seed, 5))
+      {
+      case 0:
+        pHull->setWorldCenter(Vec2f(test::random(seed, -500.0f, 500.0f), test::random(seed, -500.0f, 500.0f)));
+        break;
+      case 1:
+        pHull->incWorldCenter(Vec2f(test::random(seed, -50.0f, 50.0f), test::random(seed, -50.0f, 50.0f)));
+        break;
+      case 2:
+        pHull->setRotation(test::random(seed, -20.0f, 20.0f));
+        break;
+      case 3:
+        pHull->setScale(test::random(seed, 0.1f, 10.0f));
+        break;
+      default:
+        // New vertices, a scaled copy of the old ones
+        {
+          float factor = test::random(seed, 0.5f, 2.0f);
+
+          for(unsigned int i = 0; i < numVertices; i++)
+            pHull->vertices[i].position *= factor;
+
+          radius *= factor;
+
+          pHull->calculateNormals();
+          pHull->generateAABB();
+        }
+      }
+
+      if(pHull->getTransformVersion() == version)
+      {
+        std::cerr << "The transform version did not change" << std::endl;
+
+        delete pHull;
+
+        return false;
+      }
+
+      if(!checkWorldVertices(*pHull, radius))
+      {
+        std::cerr << "Hull " << t << " with " << numVertices << " vertices, rotated by " << pHull->getRotation() << " and scaled by " << pHull->getScale() << std::endl;
+
+        delete pHull;
+
+        return false;
+      }
+    }
+
+    delete pHull;
+  }
+
+  return true;
+}
+}
+
+int main()
+{
+  bool passed = true;
+
+  if(!testFindSilhouette())
+    passed = false;
+
+  if(!testIntersectSegment())
+    passed = false;
+
+  if(!testWorldVertices())
+    passed = false;
+
+  if(passed)
+    std::cout << "All convex hull tests passed" << std::endl;
+
+  return passed ? 0 : 1;
+}
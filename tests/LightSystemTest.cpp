@@ -0,0 +1,490 @@
+// Tests of the light system that check its results against brute force searches over all lights and hulls.
+// renderLights draws, so this needs a window like the sample does.
+
+#include "LTBL/LightSystem.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <set>
+#include <utility>
+#include <vector>
+
+using namespace qdt;
+using namespace ltbl;
+
+namespace
+{
+const float WorldSize = 1000.0f;
+
+typedef std::pair<Light*, ConvexHull*> Pair;
+
+ConvexHull* addHull(LightSystem &lightSystem, unsigned int &seed)
+{
+  ConvexHull* pHull = test::createHull(seed, 3 + test::randomIndex(seed, 8), test::random(seed, 5.0f, 20.0f), true);
+
+  pHull->setWorldCenter(Vec2f(test::random(seed, WorldSize), test::random(seed, WorldSize)));
+
+  lightSystem.addConvexHull(pHull);
+
+  return pHull;
+}
+
+// Every third light is directional, the others cover the full circle
+Light* addLight(LightSystem &lightSystem, unsigned int &seed, unsigned int index)
+{
+  Light* pLight = test::createLight(Vec2f(test::random(seed, WorldSize), test::random(seed, WorldSize)), test::random(seed, 50.0f, 200.0f));
+
+  if(index % 3 == 0)
+  {
+    pLight->directionAngle = test::random(seed, 6.0f);
+    pLight->spreadAngle = test::random(seed, 0.5f, 5.0f);
+    pLight->calculateAABB();
+  }
+
+  lightSystem.addLight(pLight);
+
+  return pLight;
+}
+
+void moveLight(Light* pLight, const Vec2f &offset)
+{
+  pLight->center += offset;
+
+  if(pLight->isDirectional())
+    pLight->calculateAABB();
+  else
+    pLight->aabb.incCenter(offset);
+
+  pLight->updateTreeStatus();
+}
+
+std::set<Pair> findPairs(const std::vector<Light*> &lights, const std::vector<ConvexHull*> &hulls)
+{
+  std::set<Pair> pairs;
+
+  for(unsigned int i = 0; i < lights.size(); i++)
+    for(unsigned int j = 0; j < hulls.size(); j++)
+      if(lights[i]->affectsHull(hulls[j]->aabb))
+        pairs.insert(Pair(lights[i], hulls[j]));
+
+  return pairs;
+}
+
+// Moves random lights and hulls every frame, and checks that the pair events turn the pairs of the last frame into
+// those found by testing every light against every hull. Pairs that were kept have a Moved event exactly if their
+// light or hull moved.
+bool testPairEvents()
+{
+  sf::RenderWindow window;
+  window.create(sf::VideoMode(64, 64), "LightSystemTest");
+
+  LightSystem lightSystem(AABB(Vec2f(0.0f, 0.0f), Vec2f(WorldSize, WorldSize)), &window);
+
+  unsigned int seed = 7;
+
+  std::vector<Light*> lights;
+  std::vector<ConvexHull*> hulls;
+
+  for(unsigned int i = 0; i < 40; i++)
+    lights.push_back(addLight(lightSystem, seed, i));
+
+  for(unsigned int i = 0; i < 500; i++)
+    hulls.push_back(addHull(lightSystem, seed));
+
+  std::set<Pair> pairs;
+
+  for(unsigned int frame = 0; frame < 100; frame++)
+  {
+    std::set<Light*> movedLights;
+    std::set<ConvexHull*> movedHulls;
+
+    if(frame != 0)
+    {
+      for(unsigned int i = 0; i < 20; i++)
+      {
+        ConvexHull* pHull = hulls[test::randomIndex(seed, hulls.size())];
+
+        if(i % 4 == 0)
+          pHull->setRotation(test::random(seed, 6.0f));
+        else
+          pHull->incWorldCenter(Vec2f(test::random(seed, -20.0f, 20.0f), 1.0f + test::random(seed, 20.0f)));
+
+        movedHulls.insert(pHull);
+      }
+
+      for(unsigned int i = 0; i < 3; i++)
+      {
+        Light* pLight = lights[test::randomIndex(seed, lights.size())];
+
+        moveLight(pLight, Vec2f(test::random(seed, -30.0f, 30.0f), 1.0f + test::random(seed, 30.0f)));
+
+        movedLights.insert(pLight);
+      }
+
+      // Reporting a light that did not change must not raise events
+      lights[test::randomIndex(seed, lights.size())]->updateTreeStatus();
+    }
+
+    lightSystem.renderLights();
+
+    const std::vector<LightHullPairEvent> &events = lightSystem.getPairEvents();
+
+    std::set<Pair> eventPairs;
+    std::set<Pair> movedPairs;
+
+    for(unsigned int i = 0; i < events.size(); i++)
+    {
+      Pair pair(events[i].pLight, events[i].pHull);
+
+      if(!eventPairs.insert(pair).second)
+      {
+        std::cerr << "Frame " << frame << ": more than one event for a pair" << std::endl;
+
+        return false;
+      }
+
+      if(events[i].type == LightHullPairEvent::Added)
+        pairs.insert(pair);
+      else if(events[i].type == LightHullPairEvent::Removed)
+        pairs.erase(pair);
+      else
+        movedPairs.insert(pair);
+    }
+
+    std::set<Pair> expected = findPairs(lights, hulls);
+
+    if(pairs != expected)
+    {
+      std::cerr << "Frame " << frame << ": " << pairs.size() << " pairs after the events, " << expected.size() << " by brute force" << std::endl;
+
+      return false;
+    }
+
+    for(std::set<Pair>::iterator it = expected.begin(); it != expected.end(); it++)
+    {
+      bool moved = movedLights.count(it->first) != 0 || movedHulls.count(it->second) != 0;
+
+      if(moved && eventPairs.count(*it) == 0)
+      {
+        std::cerr << "Frame " << frame << ": no event for a pair that moved" << std::endl;
+
+        return false;
+      }
+
+      if(!moved && movedPairs.count(*it) != 0)
+      {
+        std::cerr << "Frame " << frame << ": Moved event for a pair that did not move" << std::endl;
+
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Lights and hulls that changed are queued until the next renderLights, clearing them must drop them from the queue
+bool testClearBeforeRender()
+{
+  sf::RenderWindow window;
+  window.create(sf::VideoMode(64, 64), "LightSystemTest");
+
+  LightSystem lightSystem(AABB(Vec2f(0.0f, 0.0f), Vec2f(WorldSize, WorldSize)), &window);
+
+  unsigned int seed = 3;
+
+  std::vector<Light*> lights;
+  std::vector<ConvexHull*> hulls;
+
+  for(unsigned int i = 0; i < 10; i++)
+    hulls.push_back(addHull(lightSystem, seed));
+
+  lightSystem.addLight(test::createLight(Vec2f(500.0f, 500.0f), 600.0f));
+  lightSystem.clearLights();
+  lightSystem.renderLights();
+
+  if(!lightSystem.getPairEvents().empty())
+  {
+    std::cerr << "Pair events after clearLights" << std::endl;
+
+    return false;
+  }
+
+  for(unsigned int i = 0; i < 5; i++)
+    lights.push_back(addLight(lightSystem, seed, i));
+
+  lightSystem.renderLights();
+
+  hulls[0]->incWorldCenter(Vec2f(5.0f, 5.0f));
+  lightSystem.clearConvexHulls();
+  hulls.clear();
+  lightSystem.renderLights();
+
+  for(unsigned int i = 0; i < 10; i++)
+    hulls.push_back(addHull(lightSystem, seed));
+
+  moveLight(lights[0], Vec2f(10.0f, 0.0f));
+  lightSystem.renderLights();
+
+  // Both lists were cleared and refilled, the pairs have to be the same as the ones found from scratch
+  const std::vector<LightHullPairEvent> &events = lightSystem.getPairEvents();
+
+  std::set<Pair> pairs;
+
+  for(unsigned int i = 0; i < events.size(); i++)
+    if(events[i].type == LightHullPairEvent::Added)
+      pairs.insert(Pair(events[i].pLight, events[i].pHull));
+
+  if(pairs != findPairs(lights, hulls))
+  {
+    std::cerr << "Pairs after clearing differ from a brute force search" << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+
+// The first hull along a segment, found by clipping it against every hull
+RaycastHit findFirstHit(const std::vector<ConvexHull*> &hulls, const Vec2f &from, const Vec2f &to)
+{
+  RaycastHit hit;
+
+  for(unsigned int i = 0; i < hulls.size(); i++)
+  {
+    float fraction;
+    Vec2f normal;
+
+    if(hulls[i]->intersectSegment(from, to, fraction, normal) && (hit.pHull == NULL || fraction < hit.fraction))
+    {
+      hit.pHull = hulls[i];
+      hit.fraction = fraction;
+      hit.normal = normal;
+    }
+  }
+
+  hit.point = from + (to - from) * hit.fraction;
+
+  return hit;
+}
+
+// raycast and raycastMany have to find the same first hull as clipping the segment against every hull, with each kind of hull index.
+// Hulls are rotated and scaled, and some segments start inside a hull.
+bool testRaycast()
+{
+  sf::RenderWindow window;
+  window.create(sf::VideoMode(64, 64), "LightSystemTest");
+
+  const SpatialIndexType indexTypes[] = { SpatialIndexQuadTree, SpatialIndexLooseQuadTree, SpatialIndexDynamicAABBTree, SpatialIndexHashGrid };
+
+  for(unsigned int type = 0; type < 4; type++)
+  {
+    LightSystem lightSystem(AABB(Vec2f(0.0f, 0.0f), Vec2f(WorldSize, WorldSize)), &window);
+    lightSystem.setHullIndexType(indexTypes[type]);
+
+    unsigned int seed = 3;
+
+    std::vector<ConvexHull*> hulls;
+
+    for(unsigned int i = 0; i < 300; i++)
+    {
+      hulls.push_back(addHull(lightSystem, seed));
+
+      hulls.back()->setRotation(test::random(seed, 6.0f));
+      hulls.back()->setScale(test::random(seed, 0.5f, 2.0f));
+    }
+
+    std::vector<RaycastSegment> segments;
+
+    for(unsigned int i = 0; i < 2000; i++)
+    {
+      RaycastSegment segment;
+
+      segment.from = i % 10 == 0 ? hulls[i % hulls.size()]->getWorldCenter() : Vec2f(test::random(seed, WorldSize), test::random(seed, WorldSize));
+
+      // Short and long segments, some leaving the region of the index
+      float length = i % 2 == 0 ? test::random(seed, 50.0f) : test::random(seed, WorldSize);
+      float angle = test::random(seed, 6.3f);
+
+      segment.to = segment.from + Vec2f(cosf(angle), sinf(angle)) * length;
+
+      segments.push_back(segment);
+    }
+
+    std::vector<RaycastHit> hits(segments.size());
+    lightSystem.raycastMany(&segments[0], segments.size(), &hits[0]);
+
+    unsigned int numHits = 0;
+
+    for(unsigned int i = 0; i < segments.size(); i++)
+    {
+      RaycastHit expected(findFirstHit(hulls, segments[i].from, segments[i].to));
+      RaycastHit hit(lightSystem.raycast(segments[i].from, segments[i].to));
+
+      // Hulls may overlap, so another hull entered at the same fraction is as good
+      if(hit.pHull != expected.pHull && !(hit.pHull != NULL && expected.pHull != NULL && hit.fraction == expected.fraction))
+      {
+        std::cerr << "Index type " << type << ": raycast " << i << " hit " << (hit.pHull == NULL ? "nothing" : "a hull") << " at " << hit.fraction
+                  << ", the brute force " << (expected.pHull == NULL ? "nothing" : "a hull") << " at " << expected.fraction << std::endl;
+
+        return false;
+      }
+
+      if(hit.fraction != expected.fraction || !(hit.point == expected.point) || (hit.pHull != NULL && hit.pHull == expected.pHull && !(hit.normal == expected.normal)))
+      {
+        std::cerr << "Index type " << type << ": raycast " << i << " hit at " << hit.fraction << " instead of " << expected.fraction << std::endl;
+
+        return false;
+      }
+
+      if(hits[i].pHull != hit.pHull || hits[i].fraction != hit.fraction || !(hits[i].point == hit.point) || (hit.pHull != NULL && !(hits[i].normal == hit.normal)))
+      {
+        std::cerr << "Index type " << type << ": raycastMany differs from raycast for segment " << i << std::endl;
+
+        return false;
+      }
+
+      if(hit.pHull != NULL)
+        numHits++;
+    }
+
+    if(numHits < segments.size() / 10 || numHits > segments.size() * 9 / 10)
+    {
+      std::cerr << "Index type " << type << ": " << numHits << " of " << segments.size() << " segments hit a hull" << std::endl;
+
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool isBrighter(const LightContribution &first, const LightContribution &second)
+{
+  return first.intensity > second.intensity;
+}
+
+// lightsAffecting has to give the k lights with the most intensity at a point, found by asking every light.
+// Lights with the same intensity may come in any order, so the intensities are compared.
+bool testLightsAffecting()
+{
+  sf::RenderWindow window;
+  window.create(sf::VideoMode(64, 64), "LightSystemTest");
+
+  LightSystem lightSystem(AABB(Vec2f(0.0f, 0.0f), Vec2f(WorldSize, WorldSize)), &window);
+
+  unsigned int seed = 13;
+
+  std::vector<Light*> lights;
+
+  for(unsigned int i = 0; i < 300; i++)
+  {
+    lights.push_back(addLight(lightSystem, seed, i));
+
+    lights.back()->intensity = test::random(seed, 0.1f, 1.0f);
+  }
+
+  const unsigned int ks[] = { 1, 3, 8, 500 };
+
+  unsigned int numLit = 0;
+
+  for(unsigned int frame = 0; frame < 5; frame++)
+  {
+    for(unsigned int i = 0; i < 400; i++)
+    {
+      Vec2f point(test::random(seed, -100.0f, WorldSize + 100.0f), test::random(seed, -100.0f, WorldSize + 100.0f));
+
+      std::vector<LightContribution> expected;
+
+      for(unsigned int j = 0; j < lights.size(); j++)
+      {
+        LightContribution contribution = { lights[j], lights[j]->getIntensityAt(point) };
+
+        if(contribution.intensity > 0.0f)
+          expected.push_back(contribution);
+      }
+
+      std::stable_sort(expected.begin(), expected.end(), isBrighter);
+
+      const unsigned int k = ks[i % 4];
+
+      if(expected.size() > k)
+        expected.resize(k);
+
+      std::vector<LightContribution> results(k);
+      unsigned int numResults = lightSystem.lightsAffecting(point, k, &results[0]);
+
+      if(numResults != expected.size())
+      {
+        std::cerr << "lightsAffecting found " << numResults << " lights, the brute force " << expected.size() << std::endl;
+
+        return false;
+      }
+
+      std::vector<Light*> found;
+
+      for(unsigned int j = 0; j < numResults; j++)
+      {
+        if(results[j].intensity != expected[j].intensity || results[j].intensity != results[j].pLight->getIntensityAt(point))
+        {
+          std::cerr << "lightsAffecting result " << j << " has the intensity " << results[j].intensity << ", expected " << expected[j].intensity << std::endl;
+
+          return false;
+        }
+
+        found.push_back(results[j].pLight);
+      }
+
+      std::sort(found.begin(), found.end());
+
+      if(std::adjacent_find(found.begin(), found.end()) != found.end())
+      {
+        std::cerr << "lightsAffecting reported a light twice" << std::endl;
+
+        return false;
+      }
+
+      if(numResults != 0)
+        numLit++;
+    }
+
+    for(unsigned int i = 0; i < 50; i++)
+      moveLight(lights[test::randomIndex(seed, lights.size())], Vec2f(test::random(seed, -50.0f, 50.0f), test::random(seed, -50.0f, 50.0f)));
+
+    lightSystem.renderLights();
+  }
+
+  if(numLit < 1000)
+  {
+    std::cerr << "Only " << numLit << " points were lit" << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+}
+
+int main()
+{
+  bool passed = true;
+
+  if(!testClearBeforeRender())
+    passed = false;
+
+  if(!testPairEvents())
+    passed = false;
+
+  if(!testRaycast())
+    passed = false;
+
+  if(!testLightsAffecting())
+    passed = false;
+
+  if(passed)
+    std::cout << "All light system tests passed" << std::endl;
+
+  return passed ? 0 : 1;
+}
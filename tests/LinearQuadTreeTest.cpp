@@ -0,0 +1,372 @@
+// Tests of LinearQuadTree: queries against a brute force search before and after a save and load,
+// and loading files that were cut short or whose nodes do not form a tree.
+
+#include "LTBL/LinearQuadTree.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace qdt;
+
+namespace
+{
+const char* const FileName = "LinearQuadTreeTest.bin";
+
+// Same layout as the header that LinearQuadTree::saveToFile writes
+struct FileHeader {
+  char magic[4];
+  unsigned int version;
+
+  float rootLowerX;
+  float rootLowerY;
+  float rootUpperX;
+  float rootUpperY;
+
+  unsigned int numNodes;
+  unsigned int numItems;
+};
+
+bool writeFile(const std::vector<char> &data)
+{
+  std::ofstream file(FileName, std::ios::binary | std::ios::trunc);
+
+  file.write(data.empty() ? NULL : &data[0], data.size());
+
+  return static_cast<bool>(file);
+}
+
+bool readFile(std::vector<char> &data)
+{
+  std::ifstream file(FileName, std::ios::binary);
+
+  data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+  return static_cast<bool>(file) || file.eof();
+}
+
+std::vector<char> createFile(const FileHeader &header, const std::vector<LinearQuadTreeNode> &nodes, const std::vector<LinearQuadTreeItem> &items)
+{
+  std::vector<char> data(reinterpret_cast<const char*>(&header), reinterpret_cast<const char*>(&header) + sizeof(header));
+
+  if(!nodes.empty())
+    data.insert(data.end(), reinterpret_cast<const char*>(&nodes[0]), reinterpret_cast<const char*>(&nodes[0] + nodes.size()));
+
+  if(!items.empty())
+    data.insert(data.end(), reinterpret_cast<const char*>(&items[0]), reinterpret_cast<const char*>(&items[0] + items.size()));
+
+  return data;
+}
+
+FileHeader createHeader(unsigned int numNodes, unsigned int numItems)
+{
+  FileHeader header = { { 'L', 'T', 'Q', 'T' }, 1, 0.0f, 0.0f, 100.0f, 100.0f, numNodes, numItems };
+
+  return header;
+}
+
+LinearQuadTreeNode createNode(unsigned int firstChild, unsigned int childMask, unsigned int firstItem)
+{
+  LinearQuadTreeNode node = { firstChild << 4 | childMask, firstItem };
+
+  return node;
+}
+
+// Items covering their whole node
+LinearQuadTreeItem createItem(unsigned int id)
+{
+  LinearQuadTreeItem item = { 0, 0, 0xffff, 0xffff, id };
+
+  return item;
+}
+
+std::vector<unsigned int> queryTree(const LinearQuadTree &tree, const AABB &region)
+{
+  std::vector<unsigned int> result;
+  tree.query(region, result);
+
+  std::sort(result.begin(), result.end());
+
+  return result;
+}
+
+// Queries must report every item whose bounds intersect the region, and may only report others by the quantization error.
+// Saving and loading the tree must give back the same results.
+bool testRoundTrip()
+{
+  unsigned int seed = 9;
+
+  std::vector<AABB> bounds;
+
+  for(unsigned int i = 0; i < 5000; i++)
+  {
+    // A tight cluster in one corner makes the tree go deep there
+    Vec2f lower = i % 5 == 0 ? Vec2f(test::random(seed, 20.0f), test::random(seed, 20.0f)) : Vec2f(test::random(seed, 4000.0f), test::random(seed, 3000.0f));
+
+    bounds.push_back(AABB(lower, lower + Vec2f(test::random(seed, 0.5f, 30.0f), test::random(seed, 0.5f, 30.0f))));
+  }
+
+  LinearQuadTree tree;
+  tree.build(&bounds[0], bounds.size());
+
+  AABB root(tree.getRootAABB());
+
+  // The item bounds are quantized relative to their node, which is at most as large as the root
+  Vec2f tolerance((root.upperBound.x - root.lowerBound.x) / 65535.0f, (root.upperBound.y - root.lowerBound.y) / 65535.0f);
+
+  std::vector<AABB> regions;
+
+  for(unsigned int i = 0; i < 500; i++)
+  {
+    Vec2f lower(test::random(seed, -100.0f, 4000.0f), test::random(seed, -100.0f, 3000.0f));
+    float size = i % 2 == 0 ? test::random(seed, 5.0f) : test::random(seed, 400.0f);
+
+    regions.push_back(AABB(lower, lower + Vec2f(size, size)));
+  }
+
+  std::vector<std::vector<unsigned int> > results;
+
+  for(unsigned int r = 0; r < regions.size(); r++)
+  {
+    results.push_back(queryTree(tree, regions[r]));
+
+    const std::vector<unsigned int> &result = results.back();
+
+    if(std::adjacent_find(result.begin(), result.end()) != result.end())
+    {
+      std::cerr << "Query " << r << " reported an item twice" << std::endl;
+
+      return false;
+    }
+
+    AABB grownRegion(regions[r].lowerBound - tolerance, regions[r].upperBound + tolerance);
+
+    for(unsigned int i = 0; i < bounds.size(); i++)
+    {
+      bool reported = std::binary_search(result.begin(), result.end(), i);
+
+      if(bounds[i].intersects(regions[r]) && !reported)
+      {
+        std::cerr << "Query " << r << " missed item " << i << std::endl;
+
+        return false;
+      }
+
+      if(reported && !bounds[i].intersects(grownRegion))
+      {
+        std::cerr << "Query " << r << " reported item " << i << ", which is further off than the quantization" << std::endl;
+
+        return false;
+      }
+    }
+  }
+
+  if(!tree.saveToFile(FileName))
+  {
+    std::cerr << "Could not save the tree" << std::endl;
+
+    return false;
+  }
+
+  LinearQuadTree loaded;
+
+  if(!loaded.loadFromFile(FileName))
+  {
+    std::cerr << "Could not load the saved tree" << std::endl;
+
+    return false;
+  }
+
+  if(loaded.getNumNodes() != tree.getNumNodes() || loaded.getNumItems() != tree.getNumItems())
+  {
+    std::cerr << "The loaded tree has " << loaded.getNumNodes() << " nodes and " << loaded.getNumItems() << " items, the saved one "
+              << tree.getNumNodes() << " and " << tree.getNumItems() << std::endl;
+
+    return false;
+  }
+
+  for(unsigned int r = 0; r < regions.size(); r++)
+    if(queryTree(loaded, regions[r]) != results[r])
+    {
+      std::cerr << "Query " << r << " differs after loading the tree" << std::endl;
+
+      return false;
+    }
+
+  return true;
+}
+
+// Loads data, expecting it to be accepted or not. A rejected file must leave the tree empty.
+bool checkLoad(const char* name, const std::vector<char> &data, bool valid)
+{
+  if(!writeFile(data))
+  {
+    std::cerr << name << ": could not write the file" << std::endl;
+
+    return false;
+  }
+
+  // Starts out with a tree, which a failed load has to drop
+  AABB bounds(Vec2f(0.0f, 0.0f), Vec2f(10.0f, 10.0f));
+
+  LinearQuadTree tree;
+  tree.build(&bounds, 1);
+
+  if(tree.loadFromFile(FileName) != valid)
+  {
+    std::cerr << name << ": loading " << (valid ? "failed" : "succeeded") << std::endl;
+
+    return false;
+  }
+
+  if(!valid && (tree.getNumNodes() != 0 || tree.getNumItems() != 0 || !queryTree(tree, bounds).empty()))
+  {
+    std::cerr << name << ": the tree is not empty after the failed load" << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+
+bool testMalformedFiles()
+{
+  bool passed = true;
+
+  // A root with two children and an item in each node, then the end marker
+  std::vector<LinearQuadTreeNode> nodes;
+  nodes.push_back(createNode(1, 0x3, 0));
+  nodes.push_back(createNode(0, 0, 1));
+  nodes.push_back(createNode(0, 0, 2));
+  nodes.push_back(createNode(0, 0, 3));
+
+  std::vector<LinearQuadTreeItem> items;
+
+  for(unsigned int i = 0; i < 3; i++)
+    items.push_back(createItem(i));
+
+  const std::vector<char> valid(createFile(createHeader(nodes.size(), items.size()), nodes, items));
+
+  if(!checkLoad("Valid file", valid, true))
+    passed = false;
+
+  std::vector<char> data(valid.begin(), valid.end() - 5);
+
+  if(!checkLoad("Truncated items", data, false))
+    passed = false;
+
+  data.assign(valid.begin(), valid.begin() + sizeof(FileHeader) / 2);
+
+  if(!checkLoad("Truncated header", data, false))
+    passed = false;
+
+  if(!checkLoad("Too many items counted", createFile(createHeader(nodes.size(), items.size() + 1), nodes, items), false))
+    passed = false;
+
+  // Agrees with the file size, but the items no longer end where the last node says
+  if(!checkLoad("Counts traded", createFile(createHeader(nodes.size() + 3, items.size() - 2), nodes, items), false))
+    passed = false;
+
+  // The item offsets run backwards
+  std::vector<LinearQuadTreeNode> badNodes(nodes);
+  badNodes[1].firstItem = 2;
+  badNodes[2].firstItem = 1;
+
+  if(!checkLoad("Item offsets decreasing", createFile(createHeader(badNodes.size(), items.size()), badNodes, items), false))
+    passed = false;
+
+  // The root is its own child
+  badNodes = nodes;
+  badNodes[0] = createNode(0, 0x3, 0);
+
+  if(!checkLoad("Child at its parent", createFile(createHeader(badNodes.size(), items.size()), badNodes, items), false))
+    passed = false;
+
+  // The second child points back at the first, and that one at the second: a cycle
+  badNodes = nodes;
+  badNodes[1] = createNode(2, 0x1, 1);
+  badNodes[2] = createNode(1, 0x1, 2);
+
+  if(!checkLoad("Cycle", createFile(createHeader(badNodes.size(), items.size()), badNodes, items), false))
+    passed = false;
+
+  // Children past the last node would be read from the end marker and beyond
+  badNodes = nodes;
+  badNodes[0] = createNode(2, 0x3, 0);
+
+  if(!checkLoad("Child past the end", createFile(createHeader(badNodes.size(), items.size()), badNodes, items), false))
+    passed = false;
+
+  // A chain of single children, just deep enough and one level too deep
+  for(unsigned int depth = LinearMaxLevels; depth <= LinearMaxLevels + 1; depth++)
+  {
+    std::vector<LinearQuadTreeNode> chain;
+
+    for(unsigned int i = 0; i < depth; i++)
+      chain.push_back(createNode(i + 1, 0x1, 0));
+
+    chain.push_back(createNode(0, 0, 0));
+    chain.push_back(createNode(0, 0, 0));
+
+    if(!checkLoad(depth == LinearMaxLevels ? "Deepest chain" : "Chain too deep", createFile(createHeader(chain.size(), 0), chain, std::vector<LinearQuadTreeItem>()),
+                  depth == LinearMaxLevels))
+      passed = false;
+  }
+
+  FileHeader header(createHeader(nodes.size(), items.size()));
+  header.version = 2;
+
+  if(!checkLoad("Unknown version", createFile(header, nodes, items), false))
+    passed = false;
+
+  // Every shorter prefix of a saved tree is rejected
+  unsigned int seed = 4;
+
+  std::vector<AABB> bounds;
+
+  for(unsigned int i = 0; i < 100; i++)
+  {
+    Vec2f lower(test::random(seed, 500.0f), test::random(seed, 500.0f));
+    bounds.push_back(AABB(lower, lower + Vec2f(10.0f, 10.0f)));
+  }
+
+  LinearQuadTree tree;
+  tree.build(&bounds[0], bounds.size());
+
+  std::vector<char> saved;
+
+  if(!tree.saveToFile(FileName) || !readFile(saved) || !checkLoad("Saved tree", saved, true))
+    return false;
+
+  for(unsigned int size = 0; size < saved.size() && passed; size += 7)
+  {
+    data.assign(saved.begin(), saved.begin() + size);
+
+    if(!checkLoad("Saved tree cut short", data, false))
+      passed = false;
+  }
+
+  return passed;
+}
+}
+
+int main()
+{
+  bool passed = true;
+
+  if(!testRoundTrip())
+    passed = false;
+
+  if(!testMalformedFiles())
+    passed = false;
+
+  std::remove(FileName);
+
+  if(passed)
+    std::cout << "All linear quad tree tests passed" << std::endl;
+
+  return passed ? 0 : 1;
+}
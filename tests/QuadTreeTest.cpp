@@ -0,0 +1,679 @@
+// Tests of the queries only QuadTree has, against brute force searches over all occupants.
+// Each runs on tight and on loose trees, with some occupants outside the root.
+
+#include "LTBL/QuadTree.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <utility>
+#include <vector>
+
+using namespace qdt;
+
+namespace
+{
+const float WorldSize = 1000.0f;
+
+struct TestOccupant : public QuadTreeOccupant {};
+
+// Mostly small boxes in the root region, a few large ones and a few past its edges
+void placeOccupant(TestOccupant &occupant, unsigned int &seed, unsigned int index)
+{
+  Vec2f lower(test::random(seed, -100.0f, WorldSize + 100.0f), test::random(seed, -100.0f, WorldSize + 100.0f));
+  float size = index % 20 == 0 ? test::random(seed, 300.0f) : test::random(seed, 20.0f);
+
+  occupant.aabb = AABB(lower, lower + Vec2f(size, test::random(seed, 20.0f)));
+}
+
+// The results have to be the k nearest occupants, nearest first. Occupants at the same distance may come in any order,
+// so the distances are compared, and every occupant has to be reported at its own distance.
+bool checkNearest(const QuadTree &tree, std::vector<TestOccupant> &occupants, const Vec2f &point, unsigned int k)
+{
+  std::vector<float> distances;
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+    distances.push_back(occupants[i].aabb.distanceSquared(point));
+
+  std::sort(distances.begin(), distances.end());
+
+  const unsigned int numExpected = std::min<unsigned int>(k, distances.size());
+
+  std::vector<NearestOccupant> results(k);
+  unsigned int numResults = tree.queryNearest(point, k, &results[0]);
+
+  if(numResults != numExpected)
+  {
+    std::cerr << "queryNearest found " << numResults << " of " << k << " occupants, expected " << numExpected << std::endl;
+
+    return false;
+  }
+
+  std::vector<QuadTreeOccupant*> found;
+
+  for(unsigned int i = 0; i < numResults; i++)
+  {
+    if(results[i].distanceSquared != distances[i] || results[i].distanceSquared != results[i].pOccupant->aabb.distanceSquared(point))
+    {
+      std::cerr << "queryNearest result " << i << " of " << k << " is at " << results[i].distanceSquared << ", expected " << distances[i] << std::endl;
+
+      return false;
+    }
+
+    found.push_back(results[i].pOccupant);
+  }
+
+  std::sort(found.begin(), found.end());
+
+  if(std::adjacent_find(found.begin(), found.end()) != found.end())
+  {
+    std::cerr << "queryNearest reported an occupant twice" << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+
+// Points inside occupants, between them and far outside the root, before and after moving and removing occupants
+bool testQueryNearest(bool loose)
+{
+  QuadTree tree(AABB(Vec2f(0.0f, 0.0f), Vec2f(WorldSize, WorldSize)), loose);
+
+  unsigned int seed = 2;
+
+  std::vector<TestOccupant> occupants(2000);
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+  {
+    placeOccupant(occupants[i], seed, i);
+
+    tree.addOccupant(&occupants[i]);
+  }
+
+  const unsigned int ks[] = { 1, 2, 7, 64, 3000 };
+
+  for(unsigned int round = 0; round < 3; round++)
+  {
+    for(unsigned int i = 0; i < 300; i++)
+    {
+      Vec2f point(i % 10 == 0 ? Vec2f(test::random(seed, -3000.0f, 3000.0f), test::random(seed, -3000.0f, 3000.0f))
+                              : Vec2f(test::random(seed, WorldSize), test::random(seed, WorldSize)));
+
+      if(!checkNearest(tree, occupants, point, ks[i % 5]))
+      {
+        std::cerr << (loose ? "Loose" : "Tight") << " tree, round " << round << ", query " << i << std::endl;
+
+        return false;
+      }
+    }
+
+    // Move a third of the occupants, then remove the last few hundred
+    for(unsigned int i = round; i < occupants.size(); i += 3)
+    {
+      placeOccupant(occupants[i], seed, i);
+
+      occupants[i].updateTreeStatus();
+    }
+
+    for(unsigned int i = 0; i < 200; i++)
+    {
+      occupants.back().removeFromTree();
+      occupants.pop_back();
+    }
+  }
+
+  return true;
+}
+
+typedef std::pair<QuadTreeOccupant*, QuadTreeOccupant*> Pair;
+
+// Compares queryPairs with testing every occupant of the first list against every one of the second
+bool checkPairs(const QuadTree &tree, std::vector<TestOccupant> &occupants, const QuadTree &otherTree, std::vector<TestOccupant> &otherOccupants, const AABB &region)
+{
+  std::vector<Pair> expected;
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+    if(occupants[i].aabb.intersects(region))
+      for(unsigned int j = 0; j < otherOccupants.size(); j++)
+        if(occupants[i].aabb.intersects(otherOccupants[j].aabb))
+          expected.push_back(Pair(&occupants[i], &otherOccupants[j]));
+
+  std::vector<Pair> pairs;
+  tree.queryPairs(otherTree, region, [&](QuadTreeOccupant* pOc, QuadTreeOccupant* pOtherOc) { pairs.push_back(Pair(pOc, pOtherOc)); });
+
+  std::sort(expected.begin(), expected.end());
+  std::sort(pairs.begin(), pairs.end());
+
+  if(std::adjacent_find(pairs.begin(), pairs.end()) != pairs.end())
+  {
+    std::cerr << "queryPairs reported a pair twice" << std::endl;
+
+    return false;
+  }
+
+  if(pairs != expected)
+  {
+    std::cerr << "queryPairs found " << pairs.size() << " pairs, the brute force " << expected.size() << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+
+// Pairs between trees of either kind with different root regions, so that the nodes don't line up and some occupants
+// of each are outside the root of the other. A tree paired with itself gives every ordered pair, including each occupant with itself.
+bool testQueryPairs(bool loose, bool otherLoose)
+{
+  QuadTree tree(AABB(Vec2f(0.0f, 0.0f), Vec2f(WorldSize, WorldSize)), loose);
+  QuadTree otherTree(AABB(Vec2f(-300.0f, 200.0f), Vec2f(WorldSize * 0.7f - 300.0f, WorldSize * 0.7f + 200.0f)), otherLoose);
+
+  unsigned int seed = 8;
+
+  std::vector<TestOccupant> occupants(800);
+  std::vector<TestOccupant> otherOccupants(600);
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+  {
+    placeOccupant(occupants[i], seed, i);
+
+    tree.addOccupant(&occupants[i]);
+  }
+
+  for(unsigned int i = 0; i < otherOccupants.size(); i++)
+  {
+    placeOccupant(otherOccupants[i], seed, i);
+
+    otherTree.addOccupant(&otherOccupants[i]);
+  }
+
+  for(unsigned int round = 0; round < 2; round++)
+  {
+    // The whole world, the region of either root, small regions and one far away
+    std::vector<AABB> regions;
+    regions.push_back(AABB(Vec2f(-5000.0f, -5000.0f), Vec2f(5000.0f, 5000.0f)));
+    regions.push_back(tree.getRootAABB());
+    regions.push_back(otherTree.getRootAABB());
+    regions.push_back(AABB(Vec2f(3000.0f, 3000.0f), Vec2f(3100.0f, 3100.0f)));
+
+    for(unsigned int i = 0; i < 10; i++)
+    {
+      Vec2f lower(test::random(seed, -200.0f, WorldSize), test::random(seed, -200.0f, WorldSize));
+
+      regions.push_back(AABB(lower, lower + Vec2f(test::random(seed, 1.0f, 200.0f), test::random(seed, 1.0f, 200.0f))));
+    }
+
+    for(unsigned int i = 0; i < regions.size(); i++)
+      if(!checkPairs(tree, occupants, otherTree, otherOccupants, regions[i]) || !checkPairs(otherTree, otherOccupants, tree, occupants, regions[i]) ||
+         !checkPairs(tree, occupants, tree, occupants, regions[i]))
+      {
+        std::cerr << (loose ? "Loose" : "Tight") << " tree with a " << (otherLoose ? "loose" : "tight") << " one, round " << round << ", region " << i << std::endl;
+
+        return false;
+      }
+
+    // Move a third of each
+    for(unsigned int i = round; i < occupants.size(); i += 3)
+    {
+      placeOccupant(occupants[i], seed, i);
+
+      occupants[i].updateTreeStatus();
+    }
+
+    for(unsigned int i = round; i < otherOccupants.size(); i += 3)
+    {
+      placeOccupant(otherOccupants[i], seed, i);
+
+      otherOccupants[i].updateTreeStatus();
+    }
+  }
+
+  return true;
+}
+
+// Region queries against a brute force search, and the outside root count against the occupants the root does not contain
+bool checkGrownTree(const QuadTree &tree, std::vector<TestOccupant> &occupants, unsigned int &seed)
+{
+  AABB root(tree.getRootAABB());
+
+  unsigned int numOutside = 0;
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+    if(!root.contains(occupants[i].aabb))
+      numOutside++;
+
+  if(tree.getStats().numOutsideRoot != numOutside)
+  {
+    std::cerr << "The tree has " << tree.getStats().numOutsideRoot << " occupants outside the root, the root does not contain " << numOutside << std::endl;
+
+    return false;
+  }
+
+  for(unsigned int i = 0; i < 30; i++)
+  {
+    // Around a random occupant, wherever they have drifted to
+    Vec2f lower(occupants[test::randomIndex(seed, occupants.size())].aabb.getCenter() - Vec2f(test::random(seed, 300.0f), test::random(seed, 300.0f)));
+    AABB region(lower, lower + Vec2f(test::random(seed, 1.0f, 600.0f), test::random(seed, 1.0f, 600.0f)));
+
+    std::vector<QuadTreeOccupant*> result;
+    tree.query(region, result);
+
+    std::vector<QuadTreeOccupant*> expected;
+
+    for(unsigned int j = 0; j < occupants.size(); j++)
+      if(occupants[j].aabb.intersects(region))
+        expected.push_back(&occupants[j]);
+
+    std::sort(result.begin(), result.end());
+    std::sort(expected.begin(), expected.end());
+
+    if(result != expected)
+    {
+      std::cerr << "A query found " << result.size() << " occupants, the brute force " << expected.size() << std::endl;
+
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Whether the outliers are few enough that the root is allowed to stay as it is
+bool isRootSettled(const QuadTree &tree)
+{
+  unsigned int numOutside = tree.getStats().numOutsideRoot;
+
+  return numOutside <= RootGrowthMinOutside || numOutside * RootGrowthOutsideRatio <= tree.getNumOccupants() + numOutside;
+}
+
+// Occupants drift away from the start region, one by one and in deferred batches. The root has to grow after them,
+// only ever getting larger, and queries have to keep finding everything. A few far away outliers must not make it grow.
+bool testRootGrowth(bool loose)
+{
+  const AABB startRegion(Vec2f(0.0f, 0.0f), Vec2f(WorldSize, WorldSize));
+
+  QuadTree tree(startRegion, loose);
+
+  unsigned int seed = 6;
+
+  std::vector<TestOccupant> occupants(1000);
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+  {
+    Vec2f lower(test::random(seed, WorldSize - 20.0f), test::random(seed, WorldSize - 20.0f));
+
+    occupants[i].aabb = AABB(lower, lower + Vec2f(test::random(seed, 20.0f), test::random(seed, 20.0f)));
+
+    tree.addOccupant(&occupants[i]);
+  }
+
+  // Outliers just above the limit of RootGrowthMinOutside, but far fewer than 1 / RootGrowthOutsideRatio of all
+  for(unsigned int i = 0; i < RootGrowthMinOutside + 1; i++)
+  {
+    occupants[i].aabb.incCenter(Vec2f(1e6f, -1e6f));
+    occupants[i].updateTreeStatus();
+  }
+
+  if(!(tree.getRootAABB().getCenter() == startRegion.getCenter()) || !checkGrownTree(tree, occupants, seed))
+  {
+    std::cerr << (loose ? "Loose" : "Tight") << " tree: the root did not stay put for a few outliers" << std::endl;
+
+    return false;
+  }
+
+  for(unsigned int frame = 0; frame < 30; frame++)
+  {
+    AABB previousRoot(tree.getRootAABB());
+
+    // Odd frames defer the moves, so that the root grows in commitUpdates
+    tree.setDeferredUpdates(frame % 2 == 1);
+
+    for(unsigned int i = RootGrowthMinOutside + 1; i < occupants.size(); i++)
+    {
+      occupants[i].aabb.incCenter(Vec2f(test::random(seed, -50.0f, 300.0f), test::random(seed, -50.0f, 200.0f)));
+      occupants[i].updateTreeStatus();
+    }
+
+    tree.commitUpdates();
+
+    if(!tree.getRootAABB().contains(previousRoot))
+    {
+      std::cerr << (loose ? "Loose" : "Tight") << " tree, frame " << frame << ": the root got smaller" << std::endl;
+
+      return false;
+    }
+
+    if(!isRootSettled(tree) || !checkGrownTree(tree, occupants, seed))
+    {
+      std::cerr << (loose ? "Loose" : "Tight") << " tree, frame " << frame << ": " << tree.getStats().numOutsideRoot << " of "
+                << tree.getNumOccupants() << " occupants are outside the root" << std::endl;
+
+      return false;
+    }
+  }
+
+  if(!tree.getRootAABB().contains(AABB(startRegion.lowerBound, startRegion.upperBound + Vec2f(3000.0f, 2000.0f))))
+  {
+    std::cerr << (loose ? "Loose" : "Tight") << " tree: the root did not grow after the occupants" << std::endl;
+
+    return false;
+  }
+
+  // Without growth the outliers stay outside, turning it back on takes them in
+  tree.setDeferredUpdates(false);
+  tree.setRootGrowth(false);
+
+  AABB grownRoot(tree.getRootAABB());
+
+  for(unsigned int i = RootGrowthMinOutside + 1; i < occupants.size(); i++)
+  {
+    occupants[i].aabb.incCenter(Vec2f(-30000.0f, 0.0f));
+    occupants[i].updateTreeStatus();
+  }
+
+  if(!(tree.getRootAABB().lowerBound == grownRoot.lowerBound && tree.getRootAABB().upperBound == grownRoot.upperBound) || isRootSettled(tree) ||
+     !checkGrownTree(tree, occupants, seed))
+  {
+    std::cerr << (loose ? "Loose" : "Tight") << " tree: the root changed while growth was off" << std::endl;
+
+    return false;
+  }
+
+  tree.setRootGrowth(true);
+
+  // Each check doubles the root at most MaxRootGrowthSteps times, one more update gives it another go
+  for(unsigned int i = 0; i < 4 && !isRootSettled(tree); i++)
+    occupants.back().updateTreeStatus();
+
+  if(!isRootSettled(tree) || !checkGrownTree(tree, occupants, seed))
+  {
+    std::cerr << (loose ? "Loose" : "Tight") << " tree: the root did not grow once growth was back on" << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+
+// Loose roots also hold the occupants centered outside of their cell. When the root grows over them,
+// they have to move down into their own cell instead of staying in the old root, high above where they belong.
+bool testLooseRootGrowth()
+{
+  QuadTree tree(AABB(Vec2f(0.0f, 0.0f), Vec2f(WorldSize, WorldSize)), true);
+
+  tree.setRootGrowth(false);
+
+  unsigned int seed = 8;
+
+  std::vector<TestOccupant> occupants(1200);
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+  {
+    // Most just right of the root cell but inside the loose root, the rest right of the root
+    float lowerX = i < 1000 ? test::random(seed, WorldSize * 1.02f, WorldSize * 1.4f) : test::random(seed, WorldSize * 1.6f, WorldSize * 1.9f);
+    Vec2f lower(lowerX, test::random(seed, 20.0f, WorldSize - 20.0f));
+
+    occupants[i].aabb = AABB(lower, lower + Vec2f(test::random(seed, 1.0f, 10.0f), test::random(seed, 1.0f, 10.0f)));
+
+    tree.addOccupant(&occupants[i]);
+  }
+
+  tree.setRootGrowth(true);
+
+  if(!isRootSettled(tree) || !checkGrownTree(tree, occupants, seed))
+  {
+    std::cerr << "Loose tree: the root did not grow over the outliers" << std::endl;
+
+    return false;
+  }
+
+  // Only the first few to reach a leaf stay that high up
+  SpatialIndexStats stats(tree.getStats());
+
+  unsigned int numHigh = stats.occupantsPerDepth[0] + (stats.occupantsPerDepth.size() > 1 ? stats.occupantsPerDepth[1] : 0);
+
+  if(numHigh > MaximumOccupants * 4)
+  {
+    std::cerr << "Loose tree: " << numHigh << " occupants are left in the root or its children after it grew" << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+
+// Bulk loads a level far larger than the root into a tree that already holds some occupants.
+// The root has to be sized for everything, with the depths close to those of a tree built one by one.
+bool testBulkLoad(bool loose)
+{
+  unsigned int seed = 10;
+
+  std::vector<TestOccupant> occupants(3000);
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+  {
+    Vec2f lower(test::random(seed, -WorldSize * 4.0f, WorldSize * 12.0f), test::random(seed, WorldSize * 8.0f));
+
+    occupants[i].aabb = AABB(lower, lower + Vec2f(test::random(seed, 1.0f, 30.0f), test::random(seed, 1.0f, 30.0f)));
+  }
+
+  const AABB startRegion(Vec2f(0.0f, 0.0f), Vec2f(WorldSize, WorldSize));
+
+  QuadTree tree(startRegion, loose);
+
+  for(unsigned int i = 0; i < 100; i++)
+    tree.addOccupant(&occupants[i]);
+
+  std::vector<QuadTreeOccupant*> level;
+
+  for(unsigned int i = 100; i < occupants.size(); i++)
+    level.push_back(&occupants[i]);
+
+  tree.bulkLoad(level.begin(), level.end());
+
+  if(tree.getNumOccupants() + tree.getStats().numOutsideRoot != occupants.size() || !isRootSettled(tree) || !checkGrownTree(tree, occupants, seed))
+  {
+    std::cerr << (loose ? "Loose" : "Tight") << " tree: the root was not sized for the bulk loaded occupants" << std::endl;
+
+    return false;
+  }
+
+  float bulkDepth = tree.getStats().averageDepth;
+
+  QuadTree incremental(startRegion, loose);
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+  {
+    occupants[i].removeFromTree();
+    incremental.addOccupant(&occupants[i]);
+  }
+
+  // Leaves differ, but a bulk loaded tree must not keep the occupants much higher up
+  float incrementalDepth = incremental.getStats().averageDepth;
+
+  if(bulkDepth < incrementalDepth - 1.0f)
+  {
+    std::cerr << (loose ? "Loose" : "Tight") << " tree: the bulk loaded occupants are at an average depth of " << bulkDepth
+              << ", added one by one " << incrementalDepth << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+
+// Checks the stats that can be told from the outside: the histogram covers every occupant in the root and gives the average depth,
+// the nodes are the root and the pooled blocks of 4, and the outside root count is what the root does not contain
+bool checkStats(const QuadTree &tree, std::vector<TestOccupant> &occupants)
+{
+  SpatialIndexStats stats(tree.getStats());
+
+  unsigned int numCounted = 0;
+  double depthSum = 0.0;
+
+  for(unsigned int depth = 0; depth < stats.occupantsPerDepth.size(); depth++)
+  {
+    numCounted += stats.occupantsPerDepth[depth];
+    depthSum += static_cast<double>(depth) * stats.occupantsPerDepth[depth];
+  }
+
+  unsigned int numOutside = 0;
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+    if(!tree.getRootAABB().contains(occupants[i].aabb))
+      numOutside++;
+
+  if(numCounted != tree.getNumOccupants() || stats.numOutsideRoot != numOutside || numCounted + numOutside != occupants.size())
+  {
+    std::cerr << "The stats count " << numCounted << " occupants in the root and " << stats.numOutsideRoot << " outside, the tree holds "
+              << tree.getNumOccupants() << " and the root does not contain " << numOutside << " of " << occupants.size() << std::endl;
+
+    return false;
+  }
+
+  if(numCounted != 0 && fabs(stats.averageDepth - depthSum / numCounted) > 1e-4)
+  {
+    std::cerr << "The average depth is " << stats.averageDepth << ", the histogram gives " << depthSum / numCounted << std::endl;
+
+    return false;
+  }
+
+  if(stats.occupantsPerDepth.size() != stats.maxDepth + 1 || stats.maxDepth >= MaxLevels)
+  {
+    std::cerr << "The histogram has " << stats.occupantsPerDepth.size() << " depths, the maximum depth is " << stats.maxDepth << std::endl;
+
+    return false;
+  }
+
+  if(stats.numNodes != 1 + 4 * tree.getNumLiveNodeBlocks() || stats.numStraddling > numCounted)
+  {
+    std::cerr << "The stats count " << stats.numNodes << " nodes and " << stats.numStraddling << " straddling occupants, the pool has "
+              << tree.getNumLiveNodeBlocks() << " blocks" << std::endl;
+
+    return false;
+  }
+
+  return true;
+}
+
+// Stats of a tree that is split and then moved about. One occupant across the center of the root has to stay in it, straddling the children.
+// The query counters are checked against the queries run when built with LTBL_QUERY_STATS, and have to stay zero otherwise.
+bool testStats(bool loose)
+{
+  QuadTree tree(AABB(Vec2f(0.0f, 0.0f), Vec2f(WorldSize, WorldSize)), loose);
+
+  unsigned int seed = 10;
+
+  std::vector<TestOccupant> occupants(1000);
+
+  occupants[0].aabb = AABB(Vec2f(WorldSize * 0.45f, WorldSize * 0.45f), Vec2f(WorldSize * 0.55f, WorldSize * 0.55f));
+  tree.addOccupant(&occupants[0]);
+
+  // Small and clear of the lines between the children of the root
+  for(unsigned int i = 1; i < occupants.size(); i++)
+  {
+    Vec2f lower(test::random(seed, WorldSize * 0.4f), test::random(seed, WorldSize * 0.4f));
+
+    if(i % 2 == 0)
+      lower.x += WorldSize * 0.55f;
+
+    if(i % 4 < 2)
+      lower.y += WorldSize * 0.55f;
+
+    occupants[i].aabb = AABB(lower, lower + Vec2f(test::random(seed, 10.0f), test::random(seed, 10.0f)));
+
+    tree.addOccupant(&occupants[i]);
+  }
+
+  SpatialIndexStats stats(tree.getStats());
+
+  if(!loose && (stats.occupantsPerDepth[0] < 1 || stats.numStraddling < stats.occupantsPerDepth[0] || stats.maxDepth < 2))
+  {
+    std::cerr << "The root holds " << stats.occupantsPerDepth[0] << " occupants of " << stats.numStraddling << " straddling, "
+              << "at a maximum depth of " << stats.maxDepth << std::endl;
+
+    return false;
+  }
+
+  for(unsigned int round = 0; round < 3; round++)
+  {
+    if(!checkStats(tree, occupants))
+    {
+      std::cerr << (loose ? "Loose" : "Tight") << " tree, round " << round << std::endl;
+
+      return false;
+    }
+
+    tree.resetQueryCounters();
+
+    unsigned long long numHits = 0;
+
+    for(unsigned int i = 0; i < 100; i++)
+    {
+      Vec2f lower(test::random(seed, -100.0f, WorldSize), test::random(seed, -100.0f, WorldSize));
+
+      std::vector<QuadTreeOccupant*> result;
+      tree.query(AABB(lower, lower + Vec2f(test::random(seed, 200.0f), test::random(seed, 200.0f))), result);
+
+      numHits += result.size();
+    }
+
+    stats = tree.getStats();
+
+#ifdef LTBL_QUERY_STATS
+    if(stats.numQueries != 100 || stats.hits != numHits || stats.nodesVisited < stats.numQueries || stats.boundsTests < stats.hits)
+#else
+    if(stats.numQueries != 0 || stats.hits != 0 || stats.nodesVisited != 0 || stats.boundsTests != 0)
+#endif
+    {
+      std::cerr << (loose ? "Loose" : "Tight") << " tree, round " << round << ": the counters show " << stats.numQueries << " queries with "
+                << stats.hits << " hits, " << stats.nodesVisited << " nodes and " << stats.boundsTests << " bounds tests, after 100 queries with " << numHits << " hits" << std::endl;
+
+      return false;
+    }
+
+    for(unsigned int i = 1 + round; i < occupants.size(); i += 3)
+    {
+      placeOccupant(occupants[i], seed, i);
+
+      occupants[i].updateTreeStatus();
+    }
+  }
+
+  return true;
+}
+}
+
+int main()
+{
+  bool passed = true;
+
+  for(unsigned int loose = 0; loose < 2; loose++)
+  {
+    if(!testQueryNearest(loose != 0))
+      passed = false;
+
+    for(unsigned int otherLoose = 0; otherLoose < 2; otherLoose++)
+      if(!testQueryPairs(loose != 0, otherLoose != 0))
+        passed = false;
+
+    if(!testRootGrowth(loose != 0))
+      passed = false;
+
+    if(!testStats(loose != 0))
+      passed = false;
+
+    if(!testBulkLoad(loose != 0))
+      passed = false;
+  }
+
+  if(!testLooseRootGrowth())
+    passed = false;
+
+  if(passed)
+    std::cout << "All quad tree tests passed" << std::endl;
+
+  return passed ? 0 : 1;
+}
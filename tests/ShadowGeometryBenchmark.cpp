@@ -0,0 +1,74 @@
+// Times ShadowGeometryBuilder::addHullShadow for hulls of increasing vertex counts around one light.
+// Not run by ctest, run it by hand on a release build.
+
+#include "LTBL/ShadowGeometryBuilder.h"
+#include "TestUtils.h"
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+using namespace ltbl;
+
+namespace
+{
+const unsigned int NumHulls = 1000;
+const unsigned int NumRepeats = 20;
+
+void benchmark(unsigned int numVertices)
+{
+  unsigned int seed = numVertices;
+
+  Light light;
+  light.center = Vec2f(0.0f, 0.0f);
+  light.radius = 500.0f;
+  light.size = 10.0f;
+
+  std::vector<ConvexHull*> hulls;
+
+  for(unsigned int i = 0; i < NumHulls; i++)
+  {
+    hulls.push_back(test::createHull(seed, numVertices, test::random(seed, 5.0f, 20.0f), i % 2 == 0));
+
+    // Outside the light, so that every hull casts a shadow
+    Vec2f direction(test::random(seed, -1.0f, 1.0f), test::random(seed, -1.0f, 1.0f));
+    hulls.back()->setWorldCenter(direction.normalize() * test::random(seed, 50.0f, 400.0f));
+    hulls.back()->setRotation(test::random(seed, 6.0f));
+  }
+
+  ShadowGeometryBuilder builder;
+  ShadowGeometry geometry;
+
+  unsigned int numVertexWrites = 0;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  for(unsigned int r = 0; r < NumRepeats; r++)
+  {
+    geometry.clear();
+
+    for(unsigned int i = 0; i < hulls.size(); i++)
+      builder.addHullShadow(light, *hulls[i], 1.0f, 2.0f, geometry);
+
+    numVertexWrites += geometry.umbraVertices.size() + geometry.finVertices.size();
+  }
+
+  double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << numVertices << " vertices: " << elapsed / (NumHulls * NumRepeats) << " ns per hull, "
+            << static_cast<double>(numVertexWrites) / (NumHulls * NumRepeats) << " shadow vertices per hull" << std::endl;
+
+  for(unsigned int i = 0; i < hulls.size(); i++)
+    delete hulls[i];
+}
+}
+
+int main()
+{
+  const unsigned int vertexCounts[] = { 4, 8, 16, 32, 64, 128, 512, 2048 };
+
+  for(unsigned int i = 0; i < sizeof(vertexCounts) / sizeof(vertexCounts[0]); i++)
+    benchmark(vertexCounts[i]);
+
+  return 0;
+}
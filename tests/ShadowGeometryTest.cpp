@@ -0,0 +1,355 @@
+// Tests of the shadow geometry built on the CPU, which needs no window
+
+#include "LTBL/ShadowGeometryBuilder.h"
+#include "LTBL/ShadowGeometryCache.h"
+
+#include <iostream>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+using namespace ltbl;
+
+namespace
+{
+const float Tolerance = 0.001f;
+
+struct ExpectedVertex {
+  float x, y, z;
+  float u, v;
+};
+
+bool compareVertices(const char* name, const std::vector<ShadowVertex> &vertices, const ExpectedVertex* pExpected, unsigned int numExpected)
+{
+  if(vertices.size() != numExpected)
+  {
+    std::cerr << vertices.size() << " " << name << " vertices, expected " << numExpected << std::endl;
+
+    return false;
+  }
+
+  for(unsigned int i = 0; i < numExpected; i++)
+  {
+    const ShadowVertex &vertex = vertices[i];
+    const ExpectedVertex &expected = pExpected[i];
+
+    if(fabsf(vertex.x - expected.x) > Tolerance || fabsf(vertex.y - expected.y) > Tolerance || vertex.z != expected.z ||
+       vertex.u != expected.u || vertex.v != expected.v)
+    {
+      std::cerr << name << " vertex " << i << " is (" << vertex.x << ", " << vertex.y << ", " << vertex.z << "; " << vertex.u << ", " << vertex.v
+                << "), expected (" << expected.x << ", " << expected.y << ", " << expected.z << "; " << expected.u << ", " << expected.v << ")" << std::endl;
+
+      return false;
+    }
+  }
+
+  return true;
+}
+
+ConvexHull* createSquare(float halfSize)
+{
+  ConvexHull* pHull = new ConvexHull();
+
+  const Vec2f corners[4] = { Vec2f(-halfSize, -halfSize), Vec2f(halfSize, -halfSize), Vec2f(halfSize, halfSize), Vec2f(-halfSize, halfSize) };
+
+  for(unsigned int i = 0; i < 4; i++)
+  {
+    ConvexHullVertex vertex;
+    vertex.position = corners[i];
+
+    pHull->vertices.push_back(vertex);
+  }
+
+  pHull->calculateNormals();
+  pHull->generateAABB();
+
+  return pHull;
+}
+
+// A light of radius 100 and size 2 at the origin, and a 20 by 20 square centered at (50, 0). The silhouette runs through
+// the corners (40, -10) and (40, 10). The sides of the light are 2 * (1, 4) / sqrt(17) away from its center across the ray
+// to (40, -10), so the umbra leaves that corner along (40.485, -8.060) and the penumbra along (39.515, -11.940), both
+// 41.279 long and scaled to the radius. The other corner mirrors it. The penumbras do not reach into the square, so there
+// are no extra fins, and the umbra runs through the hull center to (150, 0).
+bool testHullShadow()
+{
+  Light light;
+  light.center = Vec2f(0.0f, 0.0f);
+  light.radius = 100.0f;
+  light.size = 2.0f;
+
+  const ExpectedVertex expectedFins[6] = {
+    { 40.0f, -10.0f, 2.0f, 0.0f, 1.0f }, { 135.7252f, -38.9254f, 2.0f, 0.0f, 0.0f }, { 138.0754f, -29.5247f, 2.0f, 1.0f, 0.0f },
+    { 40.0f, 10.0f, 2.0f, 0.0f, 1.0f }, { 135.7252f, 38.9254f, 2.0f, 0.0f, 0.0f }, { 138.0754f, 29.5247f, 2.0f, 1.0f, 0.0f }
+  };
+
+  const ExpectedVertex expectedUmbra[12] = {
+    { 40.0f, -10.0f, 1.0f, 0.0f, 0.0f }, { 138.0754f, -29.5247f, 1.0f, 0.0f, 0.0f }, { 50.0f, 0.0f, 1.0f, 0.0f, 0.0f },
+    { 50.0f, 0.0f, 1.0f, 0.0f, 0.0f }, { 138.0754f, -29.5247f, 1.0f, 0.0f, 0.0f }, { 150.0f, 0.0f, 1.0f, 0.0f, 0.0f },
+    { 50.0f, 0.0f, 1.0f, 0.0f, 0.0f }, { 150.0f, 0.0f, 1.0f, 0.0f, 0.0f }, { 40.0f, 10.0f, 1.0f, 0.0f, 0.0f },
+    { 40.0f, 10.0f, 1.0f, 0.0f, 0.0f }, { 150.0f, 0.0f, 1.0f, 0.0f, 0.0f }, { 138.0754f, 29.5247f, 1.0f, 0.0f, 0.0f }
+  };
+
+  ShadowGeometryBuilder builder;
+
+  ConvexHull* pSquare = createSquare(10.0f);
+  pSquare->setWorldCenter(Vec2f(50.0f, 0.0f));
+
+  // The same square, turned a quarter and scaled up from half the size
+  ConvexHull* pTransformed = createSquare(5.0f);
+  pTransformed->setWorldCenter(Vec2f(50.0f, 0.0f));
+  pTransformed->setRotation(static_cast<float>(PI) / 2.0f);
+  pTransformed->setScale(2.0f);
+
+  bool passed = true;
+
+  ConvexHull* hulls[2] = { pSquare, pTransformed };
+
+  for(unsigned int i = 0; i < 2 && passed; i++)
+  {
+    ShadowGeometry geometry;
+    builder.addHullShadow(light, *hulls[i], 1.0f, 2.0f, geometry);
+
+    if(!compareVertices("Fin", geometry.finVertices, expectedFins, 6) || !compareVertices("Umbra", geometry.umbraVertices, expectedUmbra, 12))
+    {
+      std::cerr << "Wrong shadow of the " << (i == 0 ? "square" : "turned and scaled square") << std::endl;
+
+      passed = false;
+    }
+  }
+
+  delete pSquare;
+  delete pTransformed;
+
+  return passed;
+}
+
+bool sameVertices(const std::vector<ShadowVertex> &first, const std::vector<ShadowVertex> &second)
+{
+  return first.size() == second.size() && (first.empty() || memcmp(&first[0], &second[0], first.size() * sizeof(ShadowVertex)) == 0);
+}
+
+class CacheTest {
+ private:
+  ShadowGeometryCache cache;
+  ShadowGeometryBuilder builder;
+
+  Light lights[2];
+  ConvexHull* hulls[4];
+
+  unsigned int lightVersions[2];
+  unsigned int hullVersions[4];
+
+  bool passed;
+
+  void fail(const char* message)
+  {
+    std::cerr << "Shadow geometry cache: " << message << std::endl;
+
+    passed = false;
+  }
+
+ public:
+  CacheTest()
+  : passed(true)
+  {
+    for(unsigned int l = 0; l < 2; l++)
+    {
+      lights[l].center = Vec2f(l * 300.0f, 0.0f);
+      lights[l].radius = 500.0f;
+      lights[l].size = 2.0f;
+      lightVersions[l] = 1;
+    }
+
+    for(unsigned int h = 0; h < 4; h++)
+    {
+      hulls[h] = createSquare(10.0f);
+      hulls[h]->setWorldCenter(Vec2f(h * 100.0f, 200.0f));
+      hullVersions[h] = 1;
+    }
+  }
+
+  ~CacheTest()
+  {
+    for(unsigned int h = 0; h < 4; h++)
+      delete hulls[h];
+  }
+
+  unsigned int getPairIndex(unsigned int l, unsigned int h) const
+  {
+    return l * 4 + h;
+  }
+
+  // Acquires the pair and builds its geometry if the entry is not up to date, like LightSystem::renderLights.
+  // Returns whether the geometry was built, or was reused if not.
+  bool use(unsigned int l, unsigned int h)
+  {
+    ShadowGeometryCache::Entry* pEntry = cache.acquire(&lights[l], lightVersions[l], hulls[h], hullVersions[h]);
+
+    if(pEntry == NULL)
+    {
+      fail("a pair could not be acquired");
+
+      return false;
+    }
+
+    bool rebuilt = !pEntry->upToDate;
+
+    if(rebuilt)
+    {
+      pEntry->geometry.clear();
+      builder.addHullShadow(lights[l], *hulls[h], 2.0f, 1.0f, pEntry->geometry);
+      pEntry->upToDate = true;
+    }
+
+    // Whether reused or not, the geometry has to be what a fresh build gives
+    ShadowGeometry fresh;
+    ShadowGeometryBuilder().addHullShadow(lights[l], *hulls[h], 2.0f, 1.0f, fresh);
+
+    if(!sameVertices(pEntry->geometry.umbraVertices, fresh.umbraVertices) || !sameVertices(pEntry->geometry.finVertices, fresh.finVertices))
+      fail("cached geometry differs from a fresh build");
+
+    return rebuilt;
+  }
+
+  // Uses the pairs in the order given, pairIndex = light * 4 + hull, and returns a bit per pair that was rebuilt
+  unsigned int runFrame(const unsigned int* pPairs, unsigned int numPairs)
+  {
+    cache.beginFrame();
+
+    unsigned int rebuilt = 0;
+
+    for(unsigned int i = 0; i < numPairs; i++)
+      if(use(pPairs[i] / 4, pPairs[i] % 4))
+        rebuilt |= 1u << pPairs[i];
+
+    cache.trim();
+
+    return rebuilt;
+  }
+
+  bool run()
+  {
+    const unsigned int allPairs[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+
+    if(runFrame(allPairs, 8) != 0xff || cache.getNumEntries() != 8)
+      fail("new pairs were not built");
+
+    // All entries hold the same number of vertices, so they take up the same memory
+    const unsigned int entryBytes = cache.getMemoryUsage() / 8;
+
+    if(entryBytes == 0 || cache.getMemoryUsage() != entryBytes * 8)
+      fail("the entries do not take up the same memory");
+
+    if(runFrame(allPairs, 8) != 0)
+      fail("unchanged pairs were built again");
+
+    // A pair is handed out once per frame
+    cache.beginFrame();
+
+    if(cache.acquire(&lights[0], lightVersions[0], hulls[0], hullVersions[0]) == NULL ||
+       cache.acquire(&lights[0], lightVersions[0], hulls[0], hullVersions[0]) != NULL)
+      fail("a pair was acquired twice in one frame");
+
+    cache.trim();
+
+    // Moving a hull rebuilds its pairs with both lights, moving a light all of its pairs
+    hulls[1]->setWorldCenter(Vec2f(150.0f, 250.0f));
+    hullVersions[1] = hulls[1]->getTransformVersion();
+
+    if(runFrame(allPairs, 8) != (1u << getPairIndex(0, 1) | 1u << getPairIndex(1, 1)))
+      fail("moving a hull did not rebuild exactly its pairs");
+
+    lights[1].center = Vec2f(320.0f, -10.0f);
+    lightVersions[1]++;
+
+    if(runFrame(allPairs, 8) != 0xf0)
+      fail("moving a light did not rebuild exactly its pairs");
+
+    // Over budget, the least recently used pairs go first, here 5, 6 and 7
+    const unsigned int recent[5] = { 1, 2, 3, 0, 4 };
+    runFrame(recent, 5);
+
+    cache.setBudget(entryBytes * 5);
+
+    if(cache.getNumEntries() != 5 || cache.getMemoryUsage() > cache.getBudget())
+      fail("lowering the budget did not evict down to it");
+
+    if(runFrame(recent, 5) != 0)
+      fail("the most recently used pairs were evicted");
+
+    // trim keeps the cache within the budget too, evicting the pairs used longest ago, now 1, 2 and 3
+    const unsigned int older[3] = { 5, 6, 7 };
+
+    if(runFrame(older, 3) != 0xe0 || cache.getNumEntries() != 5 || cache.getMemoryUsage() > cache.getBudget())
+      fail("trim did not evict down to the budget");
+
+    const unsigned int kept[2] = { 0, 4 };
+
+    if(runFrame(kept, 2) != 0)
+      fail("trim evicted pairs that were used more recently than others it kept");
+
+    const unsigned int evicted[3] = { 1, 2, 3 };
+
+    if(runFrame(evicted, 3) != 0xe)
+      fail("trim kept pairs that were used longest ago");
+
+    // Removing a light or hull drops exactly its pairs
+    cache.setBudget(DefaultShadowCacheBudget);
+    runFrame(allPairs, 8);
+
+    cache.removeLight(&lights[0]);
+
+    if(cache.getNumEntries() != 4 || cache.getMemoryUsage() != entryBytes * 4)
+      fail("removeLight did not drop the pairs of the light");
+
+    cache.removeHull(hulls[2]);
+
+    if(cache.getNumEntries() != 3 || cache.getMemoryUsage() != entryBytes * 3)
+      fail("removeHull did not drop the pair of the hull");
+
+    // Removing what is not cached does nothing
+    cache.removeLight(&lights[0]);
+    cache.removeHull(hulls[2]);
+
+    const unsigned int remaining[3] = { 4, 5, 7 };
+
+    if(cache.getNumEntries() != 3 || runFrame(remaining, 3) != 0)
+      fail("removing lost pairs that were not removed");
+
+    if(runFrame(allPairs, 8) != 0x4f)
+      fail("removed pairs were not built again");
+
+    cache.removeLight(&lights[1]);
+    cache.removeLight(&lights[0]);
+
+    if(cache.getNumEntries() != 0 || cache.getMemoryUsage() != 0)
+      fail("entries or memory left after removing all lights");
+
+    return passed;
+  }
+};
+
+bool testCache()
+{
+  CacheTest test;
+
+  return test.run();
+}
+}
+
+int main()
+{
+  bool passed = true;
+
+  if(!testHullShadow())
+    passed = false;
+
+  if(!testCache())
+    passed = false;
+
+  if(passed)
+    std::cout << "All shadow geometry tests passed" << std::endl;
+
+  return passed ? 0 : 1;
+}
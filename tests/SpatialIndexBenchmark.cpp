@@ -0,0 +1,111 @@
+// Times building, moving occupants in and querying each spatial index with 1k, 10k and 100k occupants.
+// The world grows with the count so that the density and the query results stay the same.
+// Not run by ctest, run it by hand on a release build.
+
+#include "LTBL/SpatialIndex.h"
+#include "TestUtils.h"
+
+#include <chrono>
+#include <iostream>
+#include <math.h>
+#include <vector>
+
+using namespace qdt;
+
+namespace
+{
+const unsigned int NumFrames = 50;
+const unsigned int QueriesPerFrame = 200;
+
+// Each frame moves this fraction of the occupants
+const unsigned int MovedFraction = 10;
+
+const char* const IndexNames[] = { "quad tree", "loose quad tree", "dynamic AABB tree", "hash grid" };
+
+struct BenchmarkOccupant : public QuadTreeOccupant {};
+
+double getMilliseconds(const std::chrono::steady_clock::time_point &start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void benchmark(SpatialIndexType type, unsigned int numOccupants)
+{
+  const float worldSize = sqrtf(static_cast<float>(numOccupants)) * 40.0f;
+
+  unsigned int seed = numOccupants;
+
+  std::vector<BenchmarkOccupant> occupants(numOccupants);
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+  {
+    Vec2f lower(test::random(seed, worldSize), test::random(seed, worldSize));
+
+    occupants[i].aabb = AABB(lower, lower + Vec2f(test::random(seed, 8.0f, 32.0f), test::random(seed, 8.0f, 32.0f)));
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  SpatialIndex* pIndex = createSpatialIndex(type, AABB(Vec2f(0.0f, 0.0f), Vec2f(worldSize, worldSize)));
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+    pIndex->addOccupant(&occupants[i]);
+
+  double buildTime = getMilliseconds(start);
+
+  double updateTime = 0.0;
+  double queryTime = 0.0;
+
+  unsigned int numHits = 0;
+
+  std::vector<QuadTreeOccupant*> result;
+
+  for(unsigned int frame = 0; frame < NumFrames; frame++)
+  {
+    start = std::chrono::steady_clock::now();
+
+    for(unsigned int i = frame % MovedFraction; i < occupants.size(); i += MovedFraction)
+    {
+      occupants[i].aabb.incCenter(Vec2f(test::random(seed, -10.0f, 10.0f), test::random(seed, -10.0f, 10.0f)));
+      occupants[i].updateTreeStatus();
+    }
+
+    updateTime += getMilliseconds(start);
+
+    start = std::chrono::steady_clock::now();
+
+    for(unsigned int i = 0; i < QueriesPerFrame; i++)
+    {
+      Vec2f lower(test::random(seed, worldSize), test::random(seed, worldSize));
+
+      result.clear();
+      pIndex->query(AABB(lower, lower + Vec2f(300.0f, 300.0f)), result);
+
+      numHits += result.size();
+    }
+
+    queryTime += getMilliseconds(start);
+  }
+
+  std::cout << numOccupants << " occupants, " << IndexNames[type] << ": build " << buildTime << " ms, update "
+            << updateTime / NumFrames << " ms per frame, query " << queryTime * 1000.0 / (NumFrames * QueriesPerFrame) << " us, "
+            << static_cast<double>(numHits) / (NumFrames * QueriesPerFrame) << " hits per query" << std::endl;
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+    occupants[i].removeFromTree();
+
+  delete pIndex;
+}
+}
+
+int main()
+{
+  const unsigned int counts[] = { 1000, 10000, 100000 };
+  const SpatialIndexType types[] = { SpatialIndexQuadTree, SpatialIndexLooseQuadTree, SpatialIndexDynamicAABBTree, SpatialIndexHashGrid };
+
+  for(unsigned int c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+    for(unsigned int t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+      benchmark(types[t], counts[c]);
+
+  return 0;
+}
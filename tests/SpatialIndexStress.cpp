@@ -0,0 +1,157 @@
+// Stress test for the concurrency model of the spatial indices, see SpatialIndex.h.
+// Reader threads query while writer threads move occupants with deferred updates on,
+// then the sync point commits the moves and the index is checked against a brute force search.
+// Meant to be run under ThreadSanitizer as well.
+
+#include "LTBL/SpatialIndex.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace qdt;
+
+namespace
+{
+const unsigned int NumOccupants = 3000;
+const unsigned int NumFrames = 30;
+const unsigned int NumReaders = 4;
+const unsigned int NumWriters = 2;
+const unsigned int QueriesPerReader = 300;
+const float WorldSize = 1000.0f;
+
+struct TestOccupant : public QuadTreeOccupant {};
+
+bool checkAgainstBruteForce(const SpatialIndex* pIndex, std::vector<TestOccupant> &occupants, unsigned int &seed)
+{
+  for(unsigned int i = 0; i < 50; i++)
+  {
+    Vec2f lower(test::random(seed, WorldSize), test::random(seed, WorldSize));
+    AABB region(lower, lower + Vec2f(150.0f, 150.0f));
+
+    std::vector<QuadTreeOccupant*> result;
+    pIndex->query(region, result);
+
+    std::vector<QuadTreeOccupant*> expected;
+
+    for(unsigned int j = 0; j < occupants.size(); j++)
+      if(occupants[j].aabb.intersects(region))
+        expected.push_back(&occupants[j]);
+
+    std::sort(result.begin(), result.end());
+    std::sort(expected.begin(), expected.end());
+
+    if(result != expected)
+      return false;
+  }
+
+  return true;
+}
+
+bool runStress(SpatialIndexType type)
+{
+  SpatialIndex* pIndex = createSpatialIndex(type, AABB(Vec2f(0.0f, 0.0f), Vec2f(WorldSize, WorldSize)));
+
+  pIndex->setDeferredUpdates(true);
+
+  std::vector<TestOccupant> occupants(NumOccupants);
+  unsigned int seed = 1;
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+  {
+    Vec2f lower(test::random(seed, WorldSize + 100.0f) - 50.0f, test::random(seed, WorldSize + 100.0f) - 50.0f);
+
+    occupants[i].aabb = AABB(lower, lower + Vec2f(test::random(seed, 30.0f), test::random(seed, 30.0f)));
+
+    pIndex->addOccupant(&occupants[i]);
+  }
+
+  std::atomic<unsigned int> numHits(0);
+  bool passed = true;
+
+  for(unsigned int frame = 0; frame < NumFrames && passed; frame++)
+  {
+    // Read phase
+    std::vector<std::thread> threads;
+
+    for(unsigned int r = 0; r < NumReaders; r++)
+      threads.push_back(std::thread([&, r]()
+      {
+        std::vector<QuadTreeOccupant*> result;
+        unsigned int readerSeed = r + frame * 7;
+        unsigned int hits = 0;
+
+        for(unsigned int k = 0; k < QueriesPerReader; k++)
+        {
+          Vec2f lower(test::random(readerSeed, WorldSize), test::random(readerSeed, WorldSize));
+
+          result.clear();
+          pIndex->query(AABB(lower, lower + Vec2f(100.0f, 100.0f)), result);
+
+          hits += result.size();
+        }
+
+        numHits += hits;
+      }));
+
+    // Each writer only moves its own occupants
+    for(unsigned int w = 0; w < NumWriters; w++)
+      threads.push_back(std::thread([&, w]()
+      {
+        unsigned int writerSeed = w * 99 + frame;
+
+        for(unsigned int i = w; i < occupants.size(); i += NumWriters)
+        {
+          occupants[i].aabb.incCenter(Vec2f(test::random(writerSeed, 20.0f) - 10.0f, test::random(writerSeed, 20.0f) - 10.0f));
+          occupants[i].updateTreeStatus();
+        }
+      }));
+
+    for(unsigned int i = 0; i < threads.size(); i++)
+      threads[i].join();
+
+    // Sync point
+    if(pIndex->getNumDirtyOccupants() != occupants.size())
+    {
+      std::cerr << "Index " << type << ", frame " << frame << ": " << pIndex->getNumDirtyOccupants() << " dirty occupants, expected " << occupants.size() << std::endl;
+
+      passed = false;
+    }
+
+    pIndex->commitUpdates();
+
+    if(passed && !checkAgainstBruteForce(pIndex, occupants, seed))
+    {
+      std::cerr << "Index " << type << ", frame " << frame << ": query results differ from a brute force search" << std::endl;
+
+      passed = false;
+    }
+  }
+
+  for(unsigned int i = 0; i < occupants.size(); i++)
+    occupants[i].removeFromTree();
+
+  delete pIndex;
+
+  return passed;
+}
+}
+
+int main()
+{
+  const SpatialIndexType types[] = { SpatialIndexQuadTree, SpatialIndexLooseQuadTree, SpatialIndexDynamicAABBTree, SpatialIndexHashGrid };
+
+  bool passed = true;
+
+  for(unsigned int i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+    if(!runStress(types[i]))
+      passed = false;
+
+  if(passed)
+    std::cout << "All spatial index stress tests passed" << std::endl;
+
+  return passed ? 0 : 1;
+}
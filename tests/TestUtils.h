@@ -0,0 +1,71 @@
+#ifndef LTBL_TEST_UTILS_H
+#define LTBL_TEST_UTILS_H
+
+#include "LTBL/ConvexHull.h"
+#include "LTBL/Light.h"
+
+#include <math.h>
+
+// Helpers shared by the tests
+namespace test
+{
+// Small LCG, so every test and thread has its own deterministic sequence
+inline float random(unsigned int &seed, float range)
+{
+  seed = seed * 1664525u + 1013904223u;
+
+  return range * ((seed >> 8) & 0xffff) / 65535.0f;
+}
+
+inline float random(unsigned int &seed, float lower, float upper)
+{
+  return lower + random(seed, upper - lower);
+}
+
+inline unsigned int randomIndex(unsigned int &seed, unsigned int count)
+{
+  seed = seed * 1664525u + 1013904223u;
+
+  return (seed >> 8) % count;
+}
+
+// Convex polygon with numVertices vertices at uneven angles on a circle around the origin, wound either way
+inline ltbl::ConvexHull* createHull(unsigned int &seed, unsigned int numVertices, float radius, bool counterClockwise)
+{
+  ltbl::ConvexHull* pHull = new ltbl::ConvexHull();
+
+  const float step = 2.0f * static_cast<float>(PI) / numVertices;
+
+  for(unsigned int i = 0; i < numVertices; i++)
+  {
+    float angle = (i + random(seed, 0.1f, 0.9f)) * step;
+
+    if(!counterClockwise)
+      angle = -angle;
+
+    ltbl::ConvexHullVertex vertex;
+    vertex.position = Vec2f(radius * cosf(angle), radius * sinf(angle));
+
+    pHull->vertices.push_back(vertex);
+  }
+
+  pHull->calculateNormals();
+  pHull->generateAABB();
+
+  return pHull;
+}
+
+// Light covering the full circle, with the AABB set to the square around it
+inline ltbl::Light* createLight(const Vec2f &center, float radius)
+{
+  ltbl::Light* pLight = new ltbl::Light();
+
+  pLight->center = center;
+  pLight->radius = radius;
+  pLight->aabb = qdt::AABB(center - Vec2f(radius, radius), center + Vec2f(radius, radius));
+
+  return pLight;
+}
+}
+
+#endif